@@ -0,0 +1,388 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <random>
+
+#include <benchmark/benchmark.h>
+#include <boost/filesystem.hpp>
+
+#include "FaceTrackStore.hpp"
+#include "MetricBatch.hpp"
+#include "MetricSmoother.hpp"
+#include "PlottingImageListener.hpp"
+#include "ResultBus.h"
+#include "Visualizer.h"
+#include "affdex_small_logo.h"
+
+using namespace affdex;
+
+// --------------------
+// Allocation accounting
+// --------------------
+// Every benchmark reports heap allocations and bytes allocated per iteration next to its timings.
+
+namespace
+{
+    std::atomic<uint64_t> gAllocations(0);
+    std::atomic<uint64_t> gAllocatedBytes(0);
+}
+
+void * operator new(std::size_t size)
+{
+    gAllocations.fetch_add(1, std::memory_order_relaxed);
+    gAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+    /** @brief Snapshot of the allocation counters, reports the delta as per-iteration benchmark counters
+     */
+    class AllocationScope
+    {
+    public:
+        AllocationScope() : mAllocations(gAllocations.load()), mBytes(gAllocatedBytes.load()) {}
+
+        void report(benchmark::State &state) const
+        {
+            state.counters["allocs"] = benchmark::Counter(double(gAllocations.load() - mAllocations),
+                                                          benchmark::Counter::kAvgIterations);
+            state.counters["alloc_bytes"] = benchmark::Counter(double(gAllocatedBytes.load() - mBytes),
+                                                               benchmark::Counter::kAvgIterations);
+        }
+
+    private:
+        const uint64_t mAllocations;
+        const uint64_t mBytes;
+    };
+
+    const int NUM_LANDMARKS = 34;
+
+    /** @brief Deterministic face with all metrics populated and landmarks inside a box at (x, y)
+     */
+    Face makeFace(std::mt19937 &rng, FaceId id, float x, float y, float size)
+    {
+        std::uniform_real_distribution<float> metric(0.0f, 100.0f);
+        std::normal_distribution<float> jitter(0.0f, 2.0f);
+
+        Face f;
+        f.id = id;
+        for (const auto &field : EMOTION_FIELDS) f.emotions.*field.member = metric(rng);
+        for (const auto &field : EXPRESSION_FIELDS) f.expressions.*field.member = metric(rng);
+        for (const auto &field : EMOJI_FIELDS) f.emojis.*field.member = metric(rng);
+        f.emojis.dominantEmoji = Emoji::Smiley;
+        f.measurements.orientation.pitch = jitter(rng);
+        f.measurements.orientation.yaw = jitter(rng);
+        f.measurements.orientation.roll = jitter(rng);
+        f.measurements.interocularDistance = size / 3;
+        f.appearance.gender = Gender::Female;
+        f.appearance.glasses = Glasses::No;
+        f.appearance.age = Age::AGE_25_34;
+        f.appearance.ethnicity = Ethnicity::UNKNOWN;
+        for (int i = 0; i < NUM_LANDMARKS; i++)
+        {
+            FeaturePoint p;
+            p.id = i;
+            p.x = x + size * (i % 6) / 5.0f + jitter(rng);
+            p.y = y + size * (i / 6) / 5.0f + jitter(rng);
+            f.featurePoints.push_back(p);
+        }
+        return f;
+    }
+
+    std::map<FaceId, Face> makeFaces(int count, int width, int height)
+    {
+        std::mt19937 rng(42);
+        std::map<FaceId, Face> faces;
+        const float cell = (float)width / count;
+        for (int i = 0; i < count; i++)
+        {
+            faces[i] = makeFace(rng, i, cell * i + cell * 0.2f, height * 0.3f, (std::min)(cell * 0.6f, height * 0.4f));
+        }
+        return faces;
+    }
+
+    const int FRAME_SIZES[][2] = { { 640, 480 }, { 1280, 720 }, { 1920, 1080 } };
+}
+
+// --------------------
+// Visualizer
+// --------------------
+
+/** Logo overlay as done by Visualizer::updateImage for every displayed frame */
+static void BM_OverlayImage(benchmark::State &state)
+{
+    const int width = FRAME_SIZES[state.range(0)][0];
+    const int height = FRAME_SIZES[state.range(0)][1];
+    Visualizer viz;
+    cv::Mat frame(height, width, CV_8UC3, cv::Scalar(40, 80, 120));
+    viz.updateImage(frame);    // Resizes the logo for this frame size
+
+    // Same foreground updateImage uses: the affdex logo (BGRA) scaled to a quarter of the frame width
+    cv::Mat logo = cv::imdecode(cv::InputArray(small_logo), CV_LOAD_IMAGE_UNCHANGED);
+    const int logoWidth = (std::min)(logo.cols, width / 4);
+    cv::resize(logo, logo, cv::Size(logoWidth, logoWidth * logo.rows / logo.cols));
+    cv::Mat roi = frame(cv::Rect(width - logo.cols - 10, 10, logo.cols, logo.rows));
+
+    AllocationScope allocations;
+    for (auto _ : state)
+    {
+        viz.overlayImage(logo, roi, cv::Point(0, 0));
+        benchmark::ClobberMemory();
+    }
+    allocations.report(state);
+    state.SetBytesProcessed(int64_t(state.iterations()) * logo.total() * logo.channels());
+    state.SetLabel(std::to_string(width) + "x" + std::to_string(height));
+}
+BENCHMARK(BM_OverlayImage)->DenseRange(0, 2);
+
+/** Bounding box plus the 30 equalizers and text per face drawn by drawFaceMetrics */
+static void BM_DrawFaceMetrics(benchmark::State &state)
+{
+    const int numFaces = state.range(0);
+    const int width = 1280, height = 720;
+    std::ofstream devnull("/dev/null");
+    PlottingImageListener listener(devnull, false);
+    MetricBatch rows;
+    rows.append(0, makeFaces(numFaces, width, height));
+    const size_t valence = MetricBatch::metricIndex("valence");
+    Visualizer viz;
+    cv::Mat frame(height, width, CV_8UC3, cv::Scalar(40, 80, 120));
+    viz.updateImage(frame);
+
+    AllocationScope allocations;
+    for (auto _ : state)
+    {
+        for (size_t row = 0; row < rows.rows(); row++)
+        {
+            const BoundingBox &bounding_box = rows.boundingBox(row);
+            viz.drawBoundingBox(bounding_box, rows.value(valence, row));
+            viz.drawFaceMetrics(rows, row, bounding_box);
+        }
+        benchmark::ClobberMemory();
+    }
+    allocations.report(state);
+    state.SetBytesProcessed(int64_t(state.iterations()) * frame.total() * frame.channels());
+    state.counters["faces_per_sec"] = benchmark::Counter(double(state.iterations()) * numFaces, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_DrawFaceMetrics)->DenseRange(1, 10);
+
+// --------------------
+// PlottingImageListener
+// --------------------
+
+static void BM_CalculateBoundingBox(benchmark::State &state)
+{
+    std::ofstream devnull("/dev/null");
+    PlottingImageListener listener(devnull, false);
+    std::mt19937 rng(7);
+    const Face face = makeFace(rng, 0, 100, 100, 200);
+
+    AllocationScope allocations;
+    for (auto _ : state)
+    {
+        BoundingBox box = listener.CalculateBoundingBox(face.featurePoints);
+        benchmark::DoNotOptimize(box);
+    }
+    allocations.report(state);
+    state.SetBytesProcessed(int64_t(state.iterations()) * NUM_LANDMARKS * sizeof(FeaturePoint));
+}
+BENCHMARK(BM_CalculateBoundingBox);
+
+/** csv rows per second, range(0) selects the sink: 0 = /dev/null, 1 = a file on tmpfs (/dev/shm) */
+static void BM_OutputToFile(benchmark::State &state)
+{
+    const bool tmpfs = state.range(0) == 1;
+    const int numFaces = state.range(1);
+    boost::filesystem::path path("/dev/null");
+    if (tmpfs)
+    {
+        if (!boost::filesystem::is_directory("/dev/shm"))
+        {
+            state.SkipWithError("/dev/shm is not available");
+            return;
+        }
+        path = boost::filesystem::path("/dev/shm") / boost::filesystem::unique_path("affdex-bench-%%%%%%.csv");
+    }
+
+    std::ofstream csv(path.c_str());
+    PlottingImageListener listener(csv, false);
+    const std::map<FaceId, Face> faces = makeFaces(numFaces, 1280, 720);
+    const std::streampos start = csv.tellp();
+
+    AllocationScope allocations;
+    double timestamp = 0.0;
+    for (auto _ : state)
+    {
+        listener.outputToFile(faces, timestamp);
+        timestamp += 1.0 / 30;
+    }
+    allocations.report(state);
+    if (tmpfs) state.SetBytesProcessed(int64_t(csv.tellp() - start));
+    state.counters["rows_per_sec"] = benchmark::Counter(double(state.iterations()) * numFaces, benchmark::Counter::kIsRate);
+    state.SetLabel(tmpfs ? "tmpfs" : "/dev/null");
+
+    csv.close();
+    if (tmpfs) boost::filesystem::remove(path);
+}
+BENCHMARK(BM_OutputToFile)->Args({ 0, 1 })->Args({ 0, 4 })->Args({ 1, 1 })->Args({ 1, 4 });
+
+/** Detector callback -> consumer hand-off through the listener queue */
+static void BM_ResultQueueRoundTrip(benchmark::State &state)
+{
+    const int numFaces = state.range(0);
+    const int width = 640, height = 480;
+    std::ofstream devnull("/dev/null");
+    PlottingImageListener listener(devnull, false);
+    const std::map<FaceId, Face> faces = makeFaces(numFaces, width, height);
+    std::vector<uint8_t> pixels(width * height * 3, 128);
+    Frame frame(width, height, pixels.data(), Frame::COLOR_FORMAT::BGR, 0.0f);
+
+    AllocationScope allocations;
+    for (auto _ : state)
+    {
+        listener.onImageResults(faces, frame);
+        std::pair<Frame, std::map<FaceId, Face>> result = listener.getData();
+        benchmark::DoNotOptimize(result.second.size());
+    }
+    allocations.report(state);
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ResultQueueRoundTrip)->Arg(0)->Arg(1)->Arg(4)->Arg(10);
+
+/** Recording a frame's results in the face track ring buffers, as onImageResults does with a track store */
+static void BM_FaceTrackStoreAdd(benchmark::State &state)
+{
+    const int numFaces = state.range(0);
+    FaceTrackStore store(10, 30);
+    const std::map<FaceId, Face> faces = makeFaces(numFaces, 1280, 720);
+    double timestamp = 0;
+
+    AllocationScope allocations;
+    for (auto _ : state)
+    {
+        store.add(timestamp, faces);
+        timestamp += 1.0 / 30;
+    }
+    allocations.report(state);
+    state.SetItemsProcessed(state.iterations() * numFaces);
+}
+BENCHMARK(BM_FaceTrackStoreAdd)->Arg(1)->Arg(4)->Arg(10);
+
+// --------------------
+// MetricBatch
+// --------------------
+
+/** Conversion of a frame's faces into the columns the sinks read, done once per frame */
+static void BM_MetricBatchAppend(benchmark::State &state)
+{
+    const int numFaces = state.range(0);
+    const std::map<FaceId, Face> faces = makeFaces(numFaces, 1280, 720);
+    MetricBatch rows;
+
+    AllocationScope allocations;
+    for (auto _ : state)
+    {
+        rows.clear();
+        rows.append(0, faces);
+        benchmark::DoNotOptimize(rows.column(0));
+    }
+    allocations.report(state);
+    state.SetItemsProcessed(state.iterations() * numFaces);
+}
+BENCHMARK(BM_MetricBatchAppend)->Arg(1)->Arg(4)->Arg(10);
+
+/** Sum of one metric over every row of a batch of 30 frames, reading its column */
+static void BM_MetricBatchColumn(benchmark::State &state)
+{
+    const int numFaces = state.range(0);
+    const std::map<FaceId, Face> faces = makeFaces(numFaces, 1280, 720);
+    MetricBatch rows;
+    for (int i = 0; i < 30; i++) rows.append(i / 30.0, faces);
+    const size_t joy = MetricBatch::metricIndex("joy");
+
+    for (auto _ : state)
+    {
+        const float *values = rows.column(joy);
+        float sum = 0;
+        for (size_t row = 0; row < rows.rows(); row++) sum += values[row];
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * rows.rows());
+}
+BENCHMARK(BM_MetricBatchColumn)->Arg(1)->Arg(4)->Arg(10);
+
+// --------------------
+// MetricSmoother
+// --------------------
+
+/** Smoothing of every metric of every face in a frame, range(0) selects the filter: 0 = EMA, 1 = one euro */
+static void BM_MetricSmootherApply(benchmark::State &state)
+{
+    const bool oneEuro = state.range(0) == 1;
+    const int numFaces = state.range(1);
+    MetricSmoother smoother(oneEuro ? MetricSmoother::Filter::OneEuro : MetricSmoother::Filter::Ema);
+
+    // A second of frames, smoothed in place over and over; the wrap back to the first restarts the filters
+    const std::map<FaceId, Face> faces = makeFaces(numFaces, 1280, 720);
+    std::vector<MetricBatch> frames(30);
+    for (size_t i = 0; i < frames.size(); i++) frames[i].append(i / 30.0, faces);
+    size_t i = 0;
+
+    AllocationScope allocations;
+    for (auto _ : state)
+    {
+        smoother.apply(frames[i]);
+        benchmark::DoNotOptimize(frames[i].column(0));
+        if (++i == frames.size()) i = 0;
+    }
+    allocations.report(state);
+    state.SetItemsProcessed(state.iterations() * numFaces * MetricBatch::NUM_METRICS);
+    state.SetLabel(oneEuro ? "one euro" : "ema");
+}
+BENCHMARK(BM_MetricSmootherApply)->Args({ 0, 1 })->Args({ 0, 10 })->Args({ 1, 1 })->Args({ 1, 10 });
+
+// --------------------
+// ResultBus
+// --------------------
+
+/** Publishing a frame on the shared memory bus and reading its records back, as a reader keeping up would */
+static void BM_ResultBusPublishRead(benchmark::State &state)
+{
+    const int numFaces = state.range(0);
+    ResultBusWriter writer("/affdex-benchmark", 1024);
+    ResultBusReader reader("/affdex-benchmark");
+    if (!writer.open() || !reader.open())
+    {
+        state.SkipWithError(("Unable to open the bus: " + writer.getError() + reader.getError()).c_str());
+        return;
+    }
+    MetricBatch rows;
+    rows.append(0, makeFaces(numFaces, 1280, 720));
+    ResultBusRecord record;
+
+    AllocationScope allocations;
+    for (auto _ : state)
+    {
+        writer.publish(rows);
+        while (reader.read(record)) benchmark::DoNotOptimize(record.metrics[0]);
+    }
+    allocations.report(state);
+    state.SetItemsProcessed(state.iterations() * numFaces);
+}
+BENCHMARK(BM_ResultBusPublishRead)->Arg(1)->Arg(10);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+"""Benchmark regression gate for common-benchmarks.
+
+Runs the benchmark binary with several repetitions, computes the median time of every benchmark with a
+bootstrapped confidence interval and compares it with the committed baseline (baseline.json).  A benchmark
+fails the gate when even the lower end of its confidence interval is slower than the baseline median by more
+than the threshold, so noisy-but-unchanged results don't trip it.
+
+    compare_baseline.py --benchmark ./common-benchmarks --baseline baseline.json
+    compare_baseline.py --benchmark ./common-benchmarks --baseline baseline.json --update
+"""
+
+import argparse
+import json
+import random
+import statistics
+import subprocess
+import sys
+
+TIME_UNITS_NS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def run_benchmarks(binary, repetitions, bench_filter, min_time):
+    cmd = [binary,
+           "--benchmark_format=json",
+           "--benchmark_repetitions=%d" % repetitions,
+           "--benchmark_report_aggregates_only=false"]
+    if bench_filter:
+        cmd.append("--benchmark_filter=%s" % bench_filter)
+    if min_time:
+        cmd.append("--benchmark_min_time=%s" % min_time)
+    out = subprocess.run(cmd, check=True, stdout=subprocess.PIPE).stdout
+    return json.loads(out.decode("utf-8"))
+
+
+def collect_samples(report, metric):
+    """Group the individual repetitions (not the aggregates) by benchmark name, in nanoseconds."""
+    samples = {}
+    for b in report.get("benchmarks", []):
+        if b.get("run_type", "iteration") != "iteration" or b.get("error_occurred"):
+            continue
+        name = b.get("run_name", b["name"])
+        scale = TIME_UNITS_NS[b.get("time_unit", "ns")]
+        samples.setdefault(name, []).append(b[metric] * scale)
+    return samples
+
+
+def bootstrap_ci(values, confidence, rounds=2000):
+    """Percentile bootstrap confidence interval of the median (deterministic)."""
+    if len(values) < 2:
+        return values[0], values[0]
+    rng = random.Random(0)
+    medians = sorted(statistics.median(rng.choice(values) for _ in values) for _ in range(rounds))
+    lo = medians[int((1.0 - confidence) / 2 * rounds)]
+    hi = medians[min(rounds - 1, int((1.0 + confidence) / 2 * rounds))]
+    return lo, hi
+
+
+def summarize(samples, confidence):
+    summary = {}
+    for name, values in samples.items():
+        lo, hi = bootstrap_ci(values, confidence)
+        summary[name] = {"median": statistics.median(values), "ci_low": lo, "ci_high": hi, "samples": len(values)}
+    return summary
+
+
+def fmt_ns(ns):
+    for unit, scale in (("s", 1e9), ("ms", 1e6), ("us", 1e3)):
+        if ns >= scale:
+            return "%.3f %s" % (ns / scale, unit)
+    return "%.1f ns" % ns
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--benchmark", required=True, help="Path to the common-benchmarks binary")
+    parser.add_argument("--baseline", required=True, help="Baseline JSON file")
+    parser.add_argument("--repetitions", type=int, default=10, help="Repetitions of every benchmark")
+    parser.add_argument("--threshold", type=float, default=None,
+                        help="Allowed slowdown as a fraction (default: from the baseline, else 0.10)")
+    parser.add_argument("--confidence", type=float, default=0.95, help="Confidence level of the interval")
+    parser.add_argument("--metric", default=None, choices=["cpu_time", "real_time"],
+                        help="Time to compare (default: from the baseline, else cpu_time)")
+    parser.add_argument("--filter", default="", help="Only run benchmarks matching this regex")
+    parser.add_argument("--min-time", default="", help="Forwarded as --benchmark_min_time")
+    parser.add_argument("--update", action="store_true", help="Write the results as the new baseline")
+    args = parser.parse_args()
+
+    try:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    except FileNotFoundError:
+        baseline = {}
+    metric = args.metric or baseline.get("metric", "cpu_time")
+    threshold = args.threshold if args.threshold is not None else baseline.get("threshold", 0.10)
+    if not args.update and not baseline.get("benchmarks"):
+        # Without a baseline every benchmark would pass as new, and the gate would never catch anything
+        print("ERROR: %s has no benchmarks. Record one on the reference machine with `make benchmark-baseline`"
+              " (or --update) and commit it." % args.baseline, file=sys.stderr)
+        return 2
+
+    report = run_benchmarks(args.benchmark, args.repetitions, args.filter, args.min_time)
+    results = summarize(collect_samples(report, metric), args.confidence)
+
+    if args.update:
+        baseline = {
+            "metric": metric,
+            "threshold": threshold,
+            "context": {k: report.get("context", {}).get(k) for k in ("host_name", "num_cpus", "mhz_per_cpu", "library_build_type")},
+            "benchmarks": {name: {"median_ns": r["median"]} for name, r in sorted(results.items())},
+        }
+        with open(args.baseline, "w") as f:
+            json.dump(baseline, f, indent=2, sort_keys=True)
+            f.write("\n")
+        print("Baseline with %d benchmarks written to %s" % (len(results), args.baseline))
+        return 0
+
+    reference = baseline.get("benchmarks", {})
+    regressions = []
+    unchecked = []
+    print("%-50s %12s %38s %8s  %s" % ("benchmark", "baseline", "median [%d%% CI]" % (args.confidence * 100),
+                                       "change", "status"))
+    for name in sorted(results):
+        r = results[name]
+        ci = "%s [%s, %s]" % (fmt_ns(r["median"]), fmt_ns(r["ci_low"]), fmt_ns(r["ci_high"]))
+        if name not in reference:
+            print("%-50s %12s %38s %8s  %s" % (name, "-", ci, "-", "NEW (no baseline)"))
+            unchecked.append(name)
+            continue
+        base = reference[name]["median_ns"]
+        change = r["median"] / base - 1.0
+        status = "ok"
+        if r["ci_low"] > base * (1.0 + threshold):
+            status = "REGRESSION"
+            regressions.append((name, change))
+        elif r["ci_high"] < base * (1.0 - threshold):
+            status = "faster"
+        print("%-50s %12s %38s %+7.1f%%  %s" % (name, fmt_ns(base), ci, change * 100, status))
+
+    # With --filter the others aren't expected to run, otherwise a renamed or removed benchmark would go unchecked
+    missing = [] if args.filter else sorted(set(reference) - set(results))
+    for name in missing:
+        print("%-50s %12s %38s %8s  %s" % (name, fmt_ns(reference[name]["median_ns"]), "-", "-", "MISSING"))
+
+    if unchecked:
+        print("\nWARNING: %d benchmark(s) have no baseline and were not checked, update %s:"
+              % (len(unchecked), args.baseline))
+        for name in unchecked:
+            print("  %s" % name)
+
+    if missing:
+        print("\n%d benchmark(s) of the baseline did not run, update %s if they were renamed or removed:"
+              % (len(missing), args.baseline))
+        for name in missing:
+            print("  %s" % name)
+
+    if regressions:
+        print("\n%d benchmark(s) regressed by more than %.0f%% (%s):" % (len(regressions), threshold * 100, metric))
+        for name, change in regressions:
+            print("  %s: %+.1f%%" % (name, change * 100))
+        return 1
+    if missing:
+        return 1
+    print("\nNo regressions beyond %.0f%% (%s)." % (threshold * 100, metric))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -1,17 +1,47 @@
 #pragma once
 
+#include <vector>
+
 #include "FaceListener.h"
+#include "Logger.h"
+#include "FaceTrackStore.hpp"
+#include "MetricSmoother.hpp"
+#include "ResultSink.hpp"
 
 using namespace affdex;
 
 class AFaceListener : public FaceListener
 {
+public:
+
+    /** @brief AFaceListener
+     * @param tracks   -- Store to start and end the face tracks in as well, or nullptr (must outlive the listener)
+     * @param smoother -- Smoother to drop the lost faces from, or nullptr (must outlive the listener)
+     */
+    explicit AFaceListener(FaceTrackStore *tracks = nullptr, MetricSmoother *smoother = nullptr)
+        : mTracks(tracks), mSmoother(smoother) {}
+
+    /** @brief AddSink passes the lost faces on to a sink as well, call before the detector starts
+     * @param sink -- The sink, must outlive the listener
+     */
+    void addSink(ResultSink *sink) { mSinks.push_back(sink); }
+
+private:
+
     void onFaceFound(float timestamp, FaceId faceId)
     {
-        std::cout << "Face id " << faceId << " found at timestamp " << timestamp << std::endl;
+        LOG(LogLevel::Info) << "Face id " << faceId << " found at timestamp " << timestamp;
+        if (mTracks) mTracks->onFaceFound(timestamp, faceId);
     }
     void onFaceLost(float timestamp, FaceId faceId)
     {
-        std::cout << "Face id " << faceId << " lost at timestamp " << timestamp << std::endl;
+        LOG(LogLevel::Info) << "Face id " << faceId << " lost at timestamp " << timestamp;
+        if (mTracks) mTracks->onFaceLost(timestamp, faceId);
+        if (mSmoother) mSmoother->onFaceLost(timestamp, faceId);
+        for (ResultSink *sink : mSinks) sink->onFaceLost(timestamp, faceId);
     }
+
+    FaceTrackStore *mTracks;
+    MetricSmoother *mSmoother;
+    std::vector<ResultSink *> mSinks;
 };
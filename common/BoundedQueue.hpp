@@ -0,0 +1,73 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+/** @brief Blocking queue with a fixed capacity, for handing work between pipeline stages
+ * push() waits while the queue is full, so a fast producer can only run so far ahead of its consumers.
+ * Once close() is called pushes fail and pop() returns false after the remaining items are taken.
+ */
+template<class T>
+class BoundedQueue
+{
+public:
+
+    explicit BoundedQueue(const size_t capacity) : mCapacity(capacity > 0 ? capacity : 1), mClosed(false) {}
+
+    /** @brief Push waits for room and appends an item
+     * @return false if the queue was closed
+     */
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNotFull.wait(lock, [this]() { return mClosed || mItems.size() < mCapacity; });
+        if (mClosed) return false;
+        mItems.push_back(std::move(item));
+        lock.unlock();
+        mNotEmpty.notify_one();
+        return true;
+    }
+
+    /** @brief Pop waits for an item and removes it
+     * @return false once the queue is closed and empty
+     */
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNotEmpty.wait(lock, [this]() { return mClosed || !mItems.empty(); });
+        if (mItems.empty()) return false;
+        item = std::move(mItems.front());
+        mItems.pop_front();
+        lock.unlock();
+        mNotFull.notify_one();
+        return true;
+    }
+
+    /** @brief Close wakes every waiting thread, the items already queued can still be popped
+     */
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lg(mMutex);
+            mClosed = true;
+        }
+        mNotFull.notify_all();
+        mNotEmpty.notify_all();
+    }
+
+    size_t size()
+    {
+        std::lock_guard<std::mutex> lg(mMutex);
+        return mItems.size();
+    }
+
+private:
+    const size_t mCapacity;
+    std::mutex mMutex;
+    std::condition_variable mNotFull;
+    std::condition_variable mNotEmpty;
+    std::deque<T> mItems;
+    bool mClosed;
+};
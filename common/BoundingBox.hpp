@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <opencv2/core/core.hpp>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define AFFDEX_BOUNDING_BOX_SSE
+#include <xmmintrin.h>
+#endif
+
+#include "Face.h"
+
+/** @brief Axis aligned box around a face's landmarks, small enough to pass by value
+ */
+struct BoundingBox
+{
+    float left;
+    float top;
+    float right;
+    float bottom;
+
+    cv::Point2f topLeft() const { return cv::Point2f(left, top); }
+    cv::Point2f topRight() const { return cv::Point2f(right, top); }
+    cv::Point2f bottomLeft() const { return cv::Point2f(left, bottom); }
+    cv::Point2f bottomRight() const { return cv::Point2f(right, bottom); }
+    float width() const { return right - left; }
+    float height() const { return bottom - top; }
+};
+
+/** @brief ComputeBoundingBox finds the box around a set of landmarks in one pass
+ * With SSE the x and y of two points are compared per instruction, [x0 y0 x1 y1] against the running
+ * minimum and maximum, across two independent accumulators so consecutive min/max don't wait on each other.
+ * The points are read 8 bytes at a time from their x (movlps/movhps, which may alias the floats), which
+ * relies on y following x in FeaturePoint.
+ * @param points -- The landmarks
+ * @return the box, all zeros when there are no points
+ */
+inline BoundingBox computeBoundingBox(const affdex::VecFeaturePoint &points)
+{
+    BoundingBox box = { 0, 0, 0, 0 };
+    const size_t n = points.size();
+    if (n == 0) return box;
+    const affdex::FeaturePoint *p = points.data();
+
+#ifdef AFFDEX_BOUNDING_BOX_SSE
+    static_assert(offsetof(affdex::FeaturePoint, y) == offsetof(affdex::FeaturePoint, x) + sizeof(float),
+                  "FeaturePoint x and y must be adjacent");
+    // Seed all four accumulators with the first point in both halves
+    __m128 first = _mm_loadl_pi(_mm_setzero_ps(), (const __m64 *)&p[0].x);
+    first = _mm_movelh_ps(first, first);
+    __m128 min0 = first, min1 = first, max0 = first, max1 = first;
+    size_t i = 1;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128 a = _mm_loadh_pi(_mm_loadl_pi(first, (const __m64 *)&p[i].x), (const __m64 *)&p[i + 1].x);
+        const __m128 b = _mm_loadh_pi(_mm_loadl_pi(first, (const __m64 *)&p[i + 2].x), (const __m64 *)&p[i + 3].x);
+        min0 = _mm_min_ps(min0, a);
+        max0 = _mm_max_ps(max0, a);
+        min1 = _mm_min_ps(min1, b);
+        max1 = _mm_max_ps(max1, b);
+    }
+    for (; i < n; i++)
+    {
+        // The upper half keeps the first point, which is already in the accumulators
+        const __m128 a = _mm_loadl_pi(first, (const __m64 *)&p[i].x);
+        min0 = _mm_min_ps(min0, a);
+        max0 = _mm_max_ps(max0, a);
+    }
+    // Fold the two points of each register together, then the two accumulators
+    min0 = _mm_min_ps(min0, min1);
+    max0 = _mm_max_ps(max0, max1);
+    min0 = _mm_min_ps(min0, _mm_movehl_ps(min0, min0));
+    max0 = _mm_max_ps(max0, _mm_movehl_ps(max0, max0));
+    float lo[4], hi[4];
+    _mm_storeu_ps(lo, min0);
+    _mm_storeu_ps(hi, max0);
+    box.left = lo[0];
+    box.top = lo[1];
+    box.right = hi[0];
+    box.bottom = hi[1];
+#else
+    box.left = box.right = p[0].x;
+    box.top = box.bottom = p[0].y;
+    for (size_t i = 1; i < n; i++)
+    {
+        const float x = p[i].x, y = p[i].y;
+        box.left = x < box.left ? x : box.left;
+        box.right = x > box.right ? x : box.right;
+        box.top = y < box.top ? y : box.top;
+        box.bottom = y > box.bottom ? y : box.bottom;
+    }
+#endif
+    return box;
+}
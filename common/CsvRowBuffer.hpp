@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstring>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+/** @brief Memory a csv's rows are formatted into before they are written to the csv in one go
+ * The buffer keeps its memory from one write to the next, and the number of bytes written is simply its
+ * size: there is no need to ask the output stream for its position, which costs a seek per call and isn't
+ * available at all on pipes.
+ */
+class CsvRowBuffer : public std::streambuf
+{
+public:
+
+    CsvRowBuffer() : mData(4096)
+    {
+        setp(mData.data(), mData.data() + mData.size());
+    }
+
+    /** @brief WriteTo writes everything formatted so far to the stream and empties the buffer
+     * @return The number of bytes written
+     */
+    size_t writeTo(std::ostream &out)
+    {
+        const size_t size = pptr() - pbase();
+        out.write(pbase(), size);
+        setp(mData.data(), mData.data() + mData.size());
+        return size;
+    }
+
+protected:
+
+    int_type overflow(int_type c) override
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+        reserve(1);
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+        return c;
+    }
+
+    std::streamsize xsputn(const char *s, const std::streamsize n) override
+    {
+        reserve((size_t)n);
+        std::memcpy(pptr(), s, (size_t)n);
+        pbump((int)n);
+        return n;
+    }
+
+private:
+
+    /** Grows the buffer, keeping its contents, until n more bytes fit */
+    void reserve(const size_t n)
+    {
+        const size_t size = pptr() - pbase();
+        if (size + n <= mData.size()) return;
+        size_t capacity = mData.size();
+        while (size + n > capacity) capacity *= 2;
+        mData.resize(capacity);
+        setp(mData.data(), mData.data() + mData.size());
+        pbump((int)size);
+    }
+
+    std::vector<char> mData;
+};
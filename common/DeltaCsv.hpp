@@ -0,0 +1,200 @@
+#pragma once
+
+#include <chrono>
+#include <cmath>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "ResultSink.hpp"
+#include "PipelineMetrics.hpp"
+#include "CsvRowBuffer.hpp"
+#include "MetricBatch.hpp"
+#include "Logger.h"
+
+/** @brief Writes the results in the csv format of PlottingImageListener::outputToFile, leaving out the values
+ * that haven't changed
+ * A value is written when it differs by more than epsilon from the last value written for that face, and
+ * every value of a face is written when it is first seen and then at least every keyframe interval.  The
+ * other cells are left empty, so the rows and columns are those of the full csv and the full series is
+ * recovered by carrying each face's last written value forward, see expandDeltaCsv.  Most metrics barely
+ * move between frames of a calm face, and an empty cell takes one byte instead of eight or more.
+ */
+class DeltaCsvSink : public ResultSink
+{
+public:
+
+    /** @brief DeltaCsvSink
+     * @param csv              -- Output stream, must outlive the sink
+     * @param epsilon          -- Smallest change of a value that is written
+     * @param keyframeInterval -- Longest time in seconds between two rows with every value of a face
+     * @param metrics          -- Counters to update, or nullptr (must outlive the sink)
+     */
+    DeltaCsvSink(std::ostream &csv, const float epsilon, const double keyframeInterval, PipelineMetrics *metrics = nullptr)
+        : mCsv(csv), mEpsilon(epsilon), mKeyframeInterval(keyframeInterval), mMetrics(metrics), mFormatter(false),
+          mRows(&mRowBuffer), mValuesWritten(0), mValuesSkipped(0)
+    {
+        mRows.precision(4);
+        mRows << std::fixed;
+        mFormatter.setMetrics(metrics);
+        mFormatter.setOutputStream(csv);
+    }
+
+    const char * name() const override { return "delta csv"; }
+
+    void consume(Frame &frame, const MetricBatch &rows) override
+    {
+        if (rows.rows() == 1 && !rows.hasFace(0))
+        {
+            mFormatter.outputToFile(rows);  // The same row of nan as the full csv
+            mFaces.clear();
+            return;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        for (auto it = mFaces.begin(); it != mFaces.end();)
+        {
+            if (rows.contains(it->first)) ++it;
+            else it = mFaces.erase(it);    // A face seen again starts with a keyframe
+        }
+        for (size_t row = 0; row < rows.rows(); row++)
+        {
+            if (rows.hasFace(row)) write(rows, row);
+        }
+        const size_t bytes = mRowBuffer.writeTo(mCsv);
+
+        if (mMetrics)
+        {
+            mMetrics->csvBytesWritten.inc(bytes);
+            mMetrics->csvLatency.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
+    }
+
+    void finish() override
+    {
+        mCsv.flush();
+        const uint64_t total = mValuesWritten + mValuesSkipped;
+        LOG(LogLevel::Info) << "Delta csv: wrote " << mValuesWritten << " of " << total << " values ("
+            << (total ? 100.0 * mValuesWritten / total : 0) << "%)";
+    }
+
+private:
+
+    static const int NUM_LABELS = 5;
+
+    struct FaceState
+    {
+        double lastKeyframe;
+        std::vector<float> values;      // interocularDistance, then by metric index
+        std::string labels[NUM_LABELS];
+    };
+
+    void write(const MetricBatch &rows, const size_t row)
+    {
+        const double timestamp = rows.timestamp(row);
+        const FaceId faceId = rows.faceId(row);
+        const Appearance &appearance = rows.appearance(row);
+        const std::string labels[NUM_LABELS] = {
+            mViz.GLASSES_MAP[appearance.glasses], mViz.AGE_MAP[appearance.age],
+            mViz.ETHNICITY_MAP[appearance.ethnicity], mViz.GENDER_MAP[appearance.gender],
+            affdex::EmojiToString(rows.dominantEmoji(row))
+        };
+
+        auto it = mFaces.find(faceId);
+        const bool keyframe = it == mFaces.end() || timestamp - it->second.lastKeyframe >= mKeyframeInterval ||
+            timestamp < it->second.lastKeyframe;
+        if (it == mFaces.end()) it = mFaces.insert(std::make_pair(faceId, FaceState())).first;
+        FaceState &state = it->second;
+        if (keyframe)
+        {
+            state.lastKeyframe = timestamp;
+            state.values.resize(1 + MetricBatch::NUM_METRICS);
+        }
+
+        // interocularDistance, the labels, then the head angles, emotions, expressions and emojis, as in the csv
+        mRows << timestamp << "," << faceId << ",";
+        cell(state.values[0], rows.interocularDistance(row), keyframe);
+        for (int i = 0; i < NUM_LABELS; i++)
+        {
+            if (keyframe || labels[i] != state.labels[i])
+            {
+                mRows << labels[i];
+                state.labels[i] = labels[i];
+            }
+            mRows << ",";
+        }
+        for (size_t m = 0; m < MetricBatch::NUM_METRICS; m++) cell(state.values[1 + m], rows.value(m, row), keyframe);
+        mRows << "\n";
+    }
+
+    /** Writes the value if it moved past epsilon from the last one written, or became or stopped being NaN */
+    void cell(float &last, const float value, const bool force)
+    {
+        const bool changed = std::isnan(value) != std::isnan(last) || std::fabs(value - last) > mEpsilon;
+        if (force || changed)
+        {
+            mRows << value;
+            last = value;
+            mValuesWritten++;
+        }
+        else mValuesSkipped++;
+        mRows << ",";
+    }
+
+    std::ostream &mCsv;
+    const float mEpsilon;
+    const double mKeyframeInterval;
+    PipelineMetrics *mMetrics;
+    PlottingImageListener mFormatter;
+    CsvRowBuffer mRowBuffer;    // The rows of a consume call, written to mCsv in one go
+    std::ostream mRows;
+    Visualizer mViz;
+    std::map<FaceId, FaceState> mFaces;
+    uint64_t mValuesWritten;
+    uint64_t mValuesSkipped;
+};
+
+/** @brief ExpandDeltaCsv rebuilds the full csv from one written by DeltaCsvSink
+ * Each empty cell gets the last value written for the same face in that column.  The values come out as
+ * they were written, so the result is the csv outputToFile would have written except for the changes
+ * smaller than the epsilon.
+ * @param in  -- The delta csv
+ * @param out -- Receives the full csv
+ * @return false if the input is not a delta csv (a row with an empty cell for a face seen for the first time)
+ */
+inline bool expandDeltaCsv(std::istream &in, std::ostream &out)
+{
+    std::string line;
+    if (!std::getline(in, line)) return false;
+    out << line << "\n";
+
+    std::map<std::string, std::vector<std::string> > last;    // faceId -> cells
+    std::vector<std::string> cells;
+    while (std::getline(in, line))
+    {
+        cells.clear();
+        std::stringstream ss(line);
+        std::string cell;
+        while (std::getline(ss, cell, ',')) cells.push_back(cell);
+        if (cells.size() < 2 || cells[1] == "nan")
+        {
+            out << line << "\n";
+            continue;
+        }
+
+        std::vector<std::string> &previous = last[cells[1]];
+        if (previous.size() < cells.size()) previous.resize(cells.size());
+        for (size_t i = 2; i < cells.size(); i++)
+        {
+            if (!cells[i].empty()) previous[i] = cells[i];
+            else if (previous[i].empty()) return false;
+            else cells[i] = previous[i];
+        }
+        for (const std::string &c : cells) out << c << ",";
+        out << "\n";
+    }
+    return true;
+}
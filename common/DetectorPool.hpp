@@ -0,0 +1,318 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Detector.h"
+#include "FrameDetector.h"
+#include "VideoDetector.h"
+#include "PhotoDetector.h"
+#include "AffdexException.h"
+
+#include "PlottingImageListener.hpp"
+#include "ThreadPlacement.hpp"
+#include "PipelineMetrics.hpp"
+#include "Logger.h"
+
+using namespace affdex;
+
+/** @brief Detector configuration shared by every detector a pool creates
+ */
+struct DetectorSettings
+{
+    int processFrameRate;
+    unsigned int numFaces;
+    FaceDetectorMode faceMode;
+    affdex::path classifierPath;
+    int frameBufferSize;        // FrameDetector only
+};
+
+enum class DetectorType { Video = 0, Photo = 1, Frame = 2 };
+
+/** @brief Keeps started detectors warm so they can be reused from one input to the next
+ * Loading the classifiers in start() costs far more than processing a short clip, so instead of creating
+ * and starting a detector per file, jobs check one out of the pool and check it back in when done.  Every
+ * detector comes with its own PlottingImageListener (without an output file, see setOutputStream).  On
+ * check-in the detector and the listener are reset and the status listener is cleared.
+ *
+ * The pool holds at most the configured number of detectors of each type; they are created on demand,
+ * or up front with warmUp(), and checkout() blocks while all of them are in use.
+ */
+class DetectorPool
+{
+    struct Entry
+    {
+        DetectorType type;
+        std::unique_ptr<PlottingImageListener> listener;
+        std::unique_ptr<Detector> detector;
+        bool inUse;
+    };
+
+public:
+
+    /** @brief A checked out detector, returned to the pool when the lease goes out of scope
+     */
+    class Lease
+    {
+    public:
+
+        Lease() : mPool(nullptr), mEntry(nullptr), mDiscard(false) {}
+        Lease(Lease &&other) : mPool(other.mPool), mEntry(other.mEntry), mDiscard(other.mDiscard) { other.mEntry = nullptr; }
+        Lease& operator=(Lease &&other)
+        {
+            release();
+            mPool = other.mPool;
+            mEntry = other.mEntry;
+            mDiscard = other.mDiscard;
+            other.mEntry = nullptr;
+            return *this;
+        }
+        ~Lease() { release(); }
+
+        bool valid() const { return mEntry != nullptr; }
+        DetectorType type() const { return mEntry->type; }
+        Detector& detector() { return *mEntry->detector; }
+        PlottingImageListener& listener() { return *mEntry->listener; }
+
+        template<class T> T& as() { return *(T *)mEntry->detector.get(); }
+
+        /** @brief Discard stops and destroys the detector on check-in instead of reusing it, for detectors
+         * that threw and may be left in an unknown state
+         */
+        void discard() { mDiscard = true; }
+
+        /** @brief Release checks the detector back in early
+         */
+        void release()
+        {
+            if (mEntry) mPool->checkin(mEntry, mDiscard);
+            mEntry = nullptr;
+            mDiscard = false;
+        }
+
+    private:
+        friend class DetectorPool;
+        Lease(DetectorPool *pool, Entry *entry) : mPool(pool), mEntry(entry), mDiscard(false) {}
+        Lease(const Lease&);
+        Lease& operator=(const Lease&);
+
+        DetectorPool *mPool;
+        Entry *mEntry;
+        bool mDiscard;
+    };
+
+    /** @brief DetectorPool
+     * @param settings -- Detector configuration
+     * @param capacity -- Maximum number of detectors per type, indexed by DetectorType
+     * @param metrics  -- Pipeline counters for the listeners, or nullptr (must outlive the pool)
+     */
+    DetectorPool(const DetectorSettings &settings, const std::vector<unsigned int> &capacity, PipelineMetrics *metrics = nullptr)
+        : mSettings(settings), mMetrics(metrics), mPlacement(nullptr)
+    {
+        for (int i = 0; i < NUM_TYPES; i++)
+        {
+            mCapacity[i] = i < (int)capacity.size() ? capacity[i] : 0;
+            mCreated[i] = 0;
+        }
+    }
+
+    ~DetectorPool()
+    {
+        for (std::unique_ptr<Entry> &entry : mEntries)
+        {
+            try { entry->detector->stop(); } catch (AffdexException) {}
+        }
+    }
+
+    /** @brief SetPlacement spreads the detectors started by warmUp() over the nodes of the placement
+     * The SDK's worker threads inherit the affinity of the thread that starts the detector.
+     * @param placement -- Thread placement, or nullptr (must outlive the pool)
+     */
+    void setPlacement(ThreadPlacement *placement) { mPlacement = placement; }
+
+    /** @brief WarmUp creates and starts detectors of a type until there are count of them (up to the capacity)
+     * The detectors are started concurrently, so the classifier loading overlaps.
+     */
+    void warmUp(const DetectorType type, const unsigned int count)
+    {
+        std::vector<Lease> leases;
+        std::vector<std::thread> threads;
+        std::mutex errorsMutex;
+        std::vector<std::string> errors;
+        {
+            std::lock_guard<std::mutex> lg(mMutex);
+            while (mCreated[(int)type] < std::min(count, mCapacity[(int)type]))
+            {
+                leases.push_back(Lease(this, reserve(type)));
+            }
+        }
+        for (Lease &lease : leases)
+        {
+            Entry *entry = lease.mEntry;
+            threads.push_back(std::thread([this, entry, &errorsMutex, &errors]()
+            {
+                if (mPlacement) mPlacement->bind(mPlacement->next(), "detector start", true);
+                try { create(*entry); }
+                catch (AffdexException ex)
+                {
+                    std::lock_guard<std::mutex> lg(errorsMutex);
+                    errors.push_back(ex.what());
+                }
+            }));
+        }
+        for (std::thread &t : threads) t.join();
+        for (Lease &lease : leases)
+        {
+            if (!lease.mEntry->detector) lease.discard();
+        }
+        leases.clear();
+        if (!errors.empty()) throw AffdexException(errors.front());
+    }
+
+    /** @brief Checkout returns a started detector of the type, waiting for one if all are in use
+     * @throws AffdexException if the pool holds none of this type or the detector fails to start
+     */
+    Lease checkout(const DetectorType type)
+    {
+        Entry *entry = nullptr;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (mCapacity[(int)type] == 0) throw AffdexException("The detector pool has no room for this detector type");
+            for (;;)
+            {
+                for (std::unique_ptr<Entry> &e : mEntries)
+                {
+                    if (!e->inUse && e->type == type && e->detector)
+                    {
+                        entry = e.get();
+                        entry->inUse = true;
+                        break;
+                    }
+                }
+                if (entry) return Lease(this, entry);
+                if (mCreated[(int)type] < mCapacity[(int)type])
+                {
+                    entry = reserve(type);
+                    break;
+                }
+                mAvailable.wait(lock);
+            }
+        }
+
+        // Start outside the lock, it takes a while
+        Lease lease(this, entry);
+        try
+        {
+            create(*entry);
+        }
+        catch (AffdexException)
+        {
+            lease.discard();
+            throw;
+        }
+        return lease;
+    }
+
+private:
+
+    static const int NUM_TYPES = 3;
+
+    /** Adds an entry without a detector yet, counted against the capacity. Called with mMutex held */
+    Entry* reserve(const DetectorType type)
+    {
+        std::unique_ptr<Entry> entry(new Entry());
+        entry->type = type;
+        entry->inUse = true;
+        mEntries.push_back(std::move(entry));
+        mCreated[(int)type]++;
+        return mEntries.back().get();
+    }
+
+    void create(Entry &entry)
+    {
+        std::unique_ptr<PlottingImageListener> listener(new PlottingImageListener(false));
+        listener->setMetrics(mMetrics);
+
+        std::unique_ptr<Detector> detector;
+        switch (entry.type)
+        {
+            case DetectorType::Video:
+                detector.reset(new VideoDetector(mSettings.processFrameRate, mSettings.numFaces, mSettings.faceMode));
+                break;
+            case DetectorType::Photo:
+                detector.reset(new PhotoDetector(mSettings.numFaces, mSettings.faceMode));
+                break;
+            case DetectorType::Frame:
+                detector.reset(new FrameDetector(std::max(1, mSettings.frameBufferSize), (float)mSettings.processFrameRate,
+                                                 mSettings.numFaces, mSettings.faceMode));
+                break;
+        }
+        detector->setClassifierPath(mSettings.classifierPath);
+        detector->setDetectAllEmotions(true);
+        detector->setDetectAllExpressions(true);
+        detector->setDetectAllEmojis(true);
+        detector->setDetectAllAppearances(true);
+        detector->setImageListener(listener.get());
+        detector->start();
+
+        entry.listener = std::move(listener);
+        entry.detector = std::move(detector);
+    }
+
+    void checkin(Entry *entry, const bool discard)
+    {
+        bool keep = !discard && entry->detector;
+        if (keep)
+        {
+            try
+            {
+                entry->detector->setProcessStatusListener(nullptr);
+                entry->detector->setFaceListener(nullptr);
+                entry->detector->reset();
+                entry->listener->reset();
+            }
+            catch (AffdexException ex)
+            {
+                LOG(LogLevel::Warning) << "Unable to reset a pooled detector, replacing it: " << ex.what();
+                keep = false;
+            }
+        }
+
+        std::unique_ptr<Entry> dropped;
+        {
+            std::lock_guard<std::mutex> lg(mMutex);
+            if (keep)
+            {
+                entry->inUse = false;
+            }
+            else
+            {
+                auto it = std::find_if(mEntries.begin(), mEntries.end(),
+                                       [entry](const std::unique_ptr<Entry> &e) { return e.get() == entry; });
+                dropped = std::move(*it);
+                mEntries.erase(it);
+                mCreated[(int)entry->type]--;
+            }
+        }
+        mAvailable.notify_all();
+
+        if (dropped && dropped->detector)
+        {
+            try { dropped->detector->stop(); } catch (AffdexException) {}
+        }
+    }
+
+    const DetectorSettings mSettings;
+    PipelineMetrics *mMetrics;
+    ThreadPlacement *mPlacement;
+
+    std::mutex mMutex;
+    std::condition_variable mAvailable;
+    std::vector<std::unique_ptr<Entry> > mEntries;
+    unsigned int mCapacity[NUM_TYPES];
+    unsigned int mCreated[NUM_TYPES];
+};
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+
+#include "ResultSink.hpp"
+#include "MetricBatch.hpp"
+#include "Logger.h"
+
+/** @brief A condition on one metric that makes an event while it holds
+ * The event starts once the metric has been past the enter threshold (above it for '>', below it for '<')
+ * for minDuration seconds, and ends when the metric goes back past the exit threshold.  An exit threshold
+ * short of the enter threshold gives hysteresis, so a metric hovering around the threshold doesn't make a
+ * string of short events.
+ */
+struct EventRule
+{
+    std::string name;
+    std::string metric;
+    bool above;             // true for '>', false for '<'
+    float enter;
+    float exit;
+    double minDuration;     // seconds
+};
+
+/** @brief ReadEventRules reads rules from a file, one per line, '#' starts a comment
+ *     <name> <metric> <'>' or '<'> <enter> [exit (=enter)] [minimum seconds (=0)]
+ * for instance "sustained_joy joy > 60 40 2" or "attention_lost attention < 30 50 1".  The metric is one
+ * of the emotions or expressions of MetricBatch::metricNames().
+ * @param path  -- The rules file
+ * @param rules -- Receives the rules
+ * @param error -- Receives what is wrong with the file when it can't be used
+ * @return false if the file can't be read or a rule is not valid
+ */
+inline bool readEventRules(const boost::filesystem::path &path, std::vector<EventRule> &rules, std::string &error)
+{
+    std::ifstream in(path.c_str());
+    if (!in.is_open())
+    {
+        error = "unable to read " + path.string();
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line))
+    {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        EventRule rule;
+        std::string op;
+        if (!(fields >> rule.name)) continue;
+        const std::string where = path.string() + ":" + std::to_string(lineNumber) + ": ";
+        if (!(fields >> rule.metric >> op >> rule.enter) || (op != ">" && op != "<"))
+        {
+            error = where + "expected <name> <metric> <'>' or '<'> <enter> [exit] [minimum seconds]";
+            return false;
+        }
+        rule.above = op == ">";
+        if (!(fields >> rule.exit)) rule.exit = rule.enter;
+        if (!(fields >> rule.minDuration)) rule.minDuration = 0;
+        const int metric = MetricBatch::metricIndex(rule.metric);
+        if (metric < (int)MetricBatch::FIRST_EMOTION || metric >= (int)MetricBatch::FIRST_EMOJI)
+        {
+            error = where + "unknown metric " + rule.metric;
+            return false;
+        }
+        if (rule.above ? rule.exit > rule.enter : rule.exit < rule.enter)
+        {
+            error = where + "the exit threshold must not be past the enter threshold";
+            return false;
+        }
+        if (rule.minDuration < 0)
+        {
+            error = where + "the minimum duration can't be negative";
+            return false;
+        }
+        rules.push_back(rule);
+    }
+    if (rules.empty())
+    {
+        error = path.string() + " has no rules";
+        return false;
+    }
+    return true;
+}
+
+/** @brief Evaluates event rules on every face as the results arrive and writes only the events
+ * Each face keeps a small state per rule (idle, pending until the minimum duration is reached, or active),
+ * so a result costs one comparison per rule and face and nothing is buffered.  Every event gives two rows:
+ * a start row when it is confirmed, with the time the metric crossed the threshold as its onset, and an
+ * end row when the metric goes back past the exit threshold or the face is lost, with the event's duration
+ * and the peak value of the metric during it.  A face is lost when the detector reports it and the results
+ * have caught up with the loss, not when a result merely comes without it.
+ */
+class EventSink : public ResultSink
+{
+public:
+
+    /** @brief EventSink
+     * @param out   -- Output stream for the events, must outlive the sink
+     * @param rules -- The rules to evaluate
+     */
+    EventSink(std::ostream &out, const std::vector<EventRule> &rules) : mOut(out), mRules(rules), mEvents(0)
+    {
+        for (const EventRule &rule : mRules) mMetrics.push_back(MetricBatch::metricIndex(rule.metric));
+
+        mOut << "TimeStamp,faceId,event,edge,onset,duration,value" << std::endl;
+        mOut.precision(4);
+        mOut << std::fixed;
+    }
+
+    const char * name() const override { return "events"; }
+
+    void consume(Frame &frame, const MetricBatch &rows) override
+    {
+        const double timestamp = frame.getTimestamp();
+        for (size_t row = 0; row < rows.rows(); row++)
+        {
+            if (!rows.hasFace(row)) continue;
+            const FaceId faceId = rows.faceId(row);
+            auto it = mFaces.find(faceId);
+            if (it == mFaces.end()) it = mFaces.insert(std::make_pair(faceId, std::vector<State>(mRules.size()))).first;
+            for (size_t r = 0; r < mRules.size(); r++)
+            {
+                evaluate(faceId, r, it->second[r], rows.value(mMetrics[r], row), timestamp);
+            }
+        }
+
+        // Results queued before the loss may still come in, so a face's events end once they are past it
+        std::lock_guard<std::mutex> lg(mMutex);
+        for (auto it = mLost.begin(); it != mLost.end();)
+        {
+            if (it->second > timestamp) ++it;
+            else
+            {
+                auto face = mFaces.find(it->first);
+                if (face != mFaces.end())
+                {
+                    for (size_t r = 0; r < mRules.size(); r++) end(face->first, r, face->second[r], face->second[r].lastSeen);
+                    mFaces.erase(face);
+                }
+                it = mLost.erase(it);
+            }
+        }
+    }
+
+    void onFaceLost(const float timestamp, const FaceId faceId) override
+    {
+        std::lock_guard<std::mutex> lg(mMutex);
+        mLost[faceId] = timestamp;
+    }
+
+    void finish() override
+    {
+        for (auto &face : mFaces)
+        {
+            for (size_t r = 0; r < mRules.size(); r++) end(face.first, r, face.second[r], face.second[r].lastSeen);
+        }
+        mFaces.clear();
+        std::lock_guard<std::mutex> lg(mMutex);
+        mLost.clear();
+        mOut.flush();
+        LOG(LogLevel::Info) << mEvents << " event(s) detected";
+    }
+
+private:
+
+    enum class Phase { Idle, Pending, Active };
+
+    struct State
+    {
+        State() : phase(Phase::Idle), onset(0), peak(0), lastSeen(0) {}
+        Phase phase;
+        double onset;
+        float peak;
+        double lastSeen;
+    };
+
+    void evaluate(const FaceId faceId, const size_t r, State &state, const float value, const double timestamp)
+    {
+        const EventRule &rule = mRules[r];
+        const bool entered = !std::isnan(value) && (rule.above ? value > rule.enter : value < rule.enter);
+        const bool exited = std::isnan(value) || (rule.above ? value < rule.exit : value > rule.exit);
+        switch (state.phase)
+        {
+        case Phase::Idle:
+            if (!entered) break;
+            state.phase = Phase::Pending;
+            state.onset = timestamp;
+            state.peak = value;
+            // With no minimum duration the event starts right away
+            // fall through
+        case Phase::Pending:
+            // Until it is confirmed the metric must stay past the enter threshold, the hysteresis only holds an active event
+            if (!entered)
+            {
+                state.phase = Phase::Idle;
+                break;
+            }
+            state.peak = rule.above ? std::max(state.peak, value) : std::min(state.peak, value);
+            if (timestamp - state.onset >= rule.minDuration)
+            {
+                state.phase = Phase::Active;
+                write(timestamp, faceId, rule.name, "start", state.onset, timestamp - state.onset, value);
+                mEvents++;
+            }
+            break;
+        case Phase::Active:
+            if (exited)
+            {
+                end(faceId, r, state, timestamp);
+                break;
+            }
+            state.peak = rule.above ? std::max(state.peak, value) : std::min(state.peak, value);
+            break;
+        }
+        state.lastSeen = timestamp;
+    }
+
+    void end(const FaceId faceId, const size_t r, State &state, const double timestamp)
+    {
+        if (state.phase == Phase::Active)
+        {
+            write(timestamp, faceId, mRules[r].name, "end", state.onset, timestamp - state.onset, state.peak);
+        }
+        state.phase = Phase::Idle;
+    }
+
+    void write(const double timestamp, const FaceId faceId, const std::string &event, const char *edge,
+               const double onset, const double duration, const float value)
+    {
+        // Events are few, flushing each keeps the file current for whoever is watching it
+        mOut << timestamp << "," << faceId << "," << event << "," << edge << "," << onset << "," << duration
+            << "," << value << std::endl;
+    }
+
+    std::ostream &mOut;
+    const std::vector<EventRule> mRules;
+    std::vector<size_t> mMetrics;     // Metric index of each rule
+    std::map<FaceId, std::vector<State> > mFaces;
+    std::map<FaceId, double> mLost;   // Faces reported lost, by the timestamp of the loss
+    std::mutex mMutex;                // Guards mLost
+    size_t mEvents;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "ResultSink.hpp"
+#include "FramePool.hpp"
+#include "Logger.h"
+
+/** @brief Writes a fixed-size crop of every face to a binary stream, ready to be fed to another model
+ * The crops come from the landmarks the detector already found: the square around the face's bounding box
+ * (computeBoundingBox), grown by a margin on every side and optionally turned by the head's roll so the
+ * eyes are level, is resampled straight from the frame into a pooled buffer of the output size with one
+ * warpAffine.  There is no second face detection, and no copy of the frame.  The stream is
+ *     header:  "AFDXCROP", then uint32 version (1), height, width, channels (3)
+ *     records: float64 timestamp, int32 faceId, float32 roll (degrees), float32 left, top, right, bottom
+ *              (the landmark box in the frame), then height * width * channels bytes of BGR pixels, row
+ *              by row
+ * in the host's byte order, with nothing in between, so every record has the same size and the file can be
+ * mapped as an array.  Parts of the square outside the frame are black.
+ */
+class FaceCropSink : public ResultSink
+{
+public:
+
+    static const uint32_t VERSION = 1;
+    static const size_t RECORD_HEADER_SIZE = 32;
+
+    /** @brief FaceCropSink
+     * @param out    -- Output stream for the crops, opened in binary mode, must outlive the sink
+     * @param size   -- Width and height of the crops in pixels
+     * @param margin -- Added on every side of the face's box, as a fraction of the box's larger side
+     * @param align  -- Turn the crops by the head's roll so the faces are upright
+     */
+    FaceCropSink(std::ostream &out, const int size, const float margin = 0.25f, const bool align = true)
+        : mOut(out), mSize(size), mMargin(margin), mAlign(align), mPool(1), mCrops(0)
+    {
+        const uint32_t header[] = { VERSION, (uint32_t)size, (uint32_t)size, 3 };
+        mOut.write("AFDXCROP", 8);
+        mOut.write((const char *)header, sizeof(header));
+    }
+
+    const char * name() const override { return "crops"; }
+
+    void consume(Frame &frame, const MetricBatch &rows) override
+    {
+        std::shared_ptr<unsigned char> imgdata;
+        cv::Mat img;
+        for (size_t row = 0; row < rows.rows(); row++)
+        {
+            const BoundingBox &box = rows.boundingBox(row);
+            if (!rows.hasFace(row) || box.width() <= 0 || box.height() <= 0) continue;
+            if (!imgdata)
+            {
+                imgdata = frame.getBGRByteArray();
+                img = cv::Mat(frame.getHeight(), frame.getWidth(), CV_8UC3, imgdata.get());
+            }
+
+            // Maps the square around the box, rotated by the roll, onto the crop: scale and rotate about
+            // the box's center, then move the center to the crop's
+            float roll = mAlign ? rows.orientation(row).roll : 0.f;
+            if (std::isnan(roll)) roll = 0.f;
+            const double side = std::max(box.width(), box.height()) * (1 + 2 * mMargin);
+            const double scale = mSize / side;
+            const double angle = roll * CV_PI / 180;
+            const double a = scale * std::cos(angle), b = scale * std::sin(angle);
+            const double cx = (box.left + box.right) / 2, cy = (box.top + box.bottom) / 2;
+            double m[6] = { a, b, mSize / 2.0 - a * cx - b * cy, -b, a, mSize / 2.0 + b * cx - a * cy };
+            cv::Mat crop = mPool.next(mSize, mSize);
+            cv::warpAffine(img, crop, cv::Mat(2, 3, CV_64F, m), cv::Size(mSize, mSize), cv::INTER_LINEAR,
+                           cv::BORDER_CONSTANT, cv::Scalar(0, 0, 0));
+
+            const double timestamp = rows.timestamp(row);
+            const int32_t faceId = rows.faceId(row);
+            const float coordinates[] = { roll, box.left, box.top, box.right, box.bottom };
+            char header[RECORD_HEADER_SIZE];
+            std::memcpy(header, &timestamp, 8);
+            std::memcpy(header + 8, &faceId, 4);
+            std::memcpy(header + 12, coordinates, sizeof(coordinates));
+            mOut.write(header, sizeof(header));
+            mOut.write((const char *)crop.data, (size_t)mSize * mSize * 3);
+            mCrops++;
+        }
+    }
+
+    void finish() override
+    {
+        mOut.flush();
+        LOG(LogLevel::Info) << mCrops << " face crop(s) of " << mSize << "x" << mSize << " written";
+    }
+
+private:
+    std::ostream &mOut;
+    const int mSize;
+    const float mMargin;
+    const bool mAlign;
+    FramePool mPool;    // The crop buffer, allocated once
+    uint64_t mCrops;
+};
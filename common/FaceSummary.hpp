@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ResultSink.hpp"
+#include "Logger.h"
+
+/** @brief Online summary of one metric of one face, in constant memory however long the face is tracked
+ * The mean and variance are kept with Welford's update, the quantiles come from a histogram with one bin
+ * per unit over the metric range [-100, 100] (finer than the classifiers resolve), and the time above the
+ * threshold counts the interval after every sample that was at or above it.
+ */
+class MetricStatistics
+{
+public:
+
+    static const int RANGE_LOW = -100;
+    static const int NUM_BINS = 200;
+
+    explicit MetricStatistics(const float threshold)
+        : mThreshold(threshold), mCount(0), mMean(0), mM2(0), mMin(0), mMax(0), mSecondsAbove(0),
+          mAbove(false), mBins(NUM_BINS, 0)
+    {
+    }
+
+    /** @brief Add records a sample
+     * @param value   -- The metric value, NaN samples are skipped
+     * @param elapsed -- Seconds since the face's previous sample
+     */
+    void add(const float value, const double elapsed)
+    {
+        if (mAbove) mSecondsAbove += elapsed;
+        if (std::isnan(value))
+        {
+            mAbove = false;
+            return;
+        }
+        mAbove = value >= mThreshold;
+
+        mCount++;
+        const double delta = value - mMean;
+        mMean += delta / mCount;
+        mM2 += delta * (value - mMean);
+        mMin = mCount == 1 ? value : std::min(mMin, value);
+        mMax = mCount == 1 ? value : std::max(mMax, value);
+
+        const int bin = (int)std::floor(value) - RANGE_LOW;
+        mBins[std::max(0, std::min(NUM_BINS - 1, bin))]++;
+    }
+
+    uint64_t count() const { return mCount; }
+    double mean() const { return mMean; }
+    double stddev() const { return mCount > 1 ? std::sqrt(mM2 / (mCount - 1)) : 0; }
+    float min() const { return mMin; }
+    float max() const { return mMax; }
+    double secondsAbove() const { return mSecondsAbove; }
+
+    /** @brief Quantile estimates a quantile from the histogram, interpolating within the bin
+     * @param q -- The quantile, in [0, 1]
+     */
+    double quantile(const double q) const
+    {
+        if (mCount == 0) return 0;
+        const double rank = q * mCount;
+        uint64_t below = 0;
+        for (int i = 0; i < NUM_BINS; i++)
+        {
+            if (mBins[i] == 0 || below + mBins[i] < rank)
+            {
+                below += mBins[i];
+                continue;
+            }
+            const double value = RANGE_LOW + i + (rank - below) / mBins[i];
+            return std::max<double>(mMin, std::min<double>(mMax, value));
+        }
+        return mMax;
+    }
+
+private:
+    const float mThreshold;
+    uint64_t mCount;
+    double mMean;
+    double mM2;
+    float mMin;
+    float mMax;
+    double mSecondsAbove;
+    bool mAbove;
+    std::vector<uint32_t> mBins;
+};
+
+/** @brief Keeps streaming statistics of the emotions and expressions of every tracked face and writes a
+ * summary of each face when it is lost and of the faces still tracked at the end
+ * A face's statistics are written and dropped once the detector reports it lost and the results have caught
+ * up with the loss, so the memory used depends on the faces in view rather than on the length of the input.
+ * A face missing from a result or two without being lost keeps its statistics.  The summary has one
+ * row per face and metric: when the face was tracked, how many samples, the mean, standard deviation,
+ * extremes, 10th/50th/90th percentiles and the seconds spent at or above the threshold.
+ */
+class FaceSummarySink : public ResultSink
+{
+public:
+
+    /** @brief FaceSummarySink
+     * @param out       -- Output stream for the summary, must outlive the sink
+     * @param threshold -- Metric value from which time is counted as above the threshold
+     */
+    FaceSummarySink(std::ostream &out, const float threshold = 50.f) : mOut(out), mThreshold(threshold), mFacesWritten(0)
+    {
+        // The emotions and expressions are adjacent in the batch
+        mMetricNames = MetricBatch::metricNames(MetricBatch::FIRST_EMOTION,
+                                                MetricBatch::NUM_EMOTIONS + MetricBatch::NUM_EXPRESSIONS);
+
+        mOut << "faceId,metric,firstSeen,lastSeen,samples,mean,stddev,min,max,p10,p50,p90,secondsAbove" << std::endl;
+        mOut.precision(4);
+        mOut << std::fixed;
+    }
+
+    const char * name() const override { return "summary"; }
+
+    void consume(Frame &frame, const MetricBatch &rows) override
+    {
+        const double timestamp = frame.getTimestamp();
+        for (size_t row = 0; row < rows.rows(); row++)
+        {
+            if (!rows.hasFace(row)) continue;
+            auto it = mTracks.find(rows.faceId(row));
+            if (it == mTracks.end())
+            {
+                it = mTracks.insert(std::make_pair(rows.faceId(row), Track(timestamp, mMetricNames.size(), mThreshold))).first;
+            }
+            Track &track = it->second;
+            const double elapsed = std::max(0.0, timestamp - track.lastSeen);
+            for (size_t i = 0; i < track.metrics.size(); i++)
+            {
+                track.metrics[i].add(rows.value(MetricBatch::FIRST_EMOTION + i, row), elapsed);
+            }
+            track.lastSeen = timestamp;
+        }
+
+        // Results queued before the loss may still come in, so a face is written once they are past it
+        std::lock_guard<std::mutex> lg(mMutex);
+        for (auto it = mLost.begin(); it != mLost.end();)
+        {
+            if (it->second > timestamp) ++it;
+            else
+            {
+                auto track = mTracks.find(it->first);
+                if (track != mTracks.end())
+                {
+                    write(track->first, track->second);
+                    mTracks.erase(track);
+                }
+                it = mLost.erase(it);
+            }
+        }
+    }
+
+    void onFaceLost(const float timestamp, const FaceId faceId) override
+    {
+        std::lock_guard<std::mutex> lg(mMutex);
+        mLost[faceId] = timestamp;
+    }
+
+    void finish() override
+    {
+        for (const auto &track : mTracks) write(track.first, track.second);
+        mTracks.clear();
+        std::lock_guard<std::mutex> lg(mMutex);
+        mLost.clear();
+        mOut.flush();
+        LOG(LogLevel::Info) << "Summary written for " << mFacesWritten << " face(s)";
+    }
+
+private:
+
+    struct Track
+    {
+        Track(const double timestamp, const size_t numMetrics, const float threshold)
+            : firstSeen(timestamp), lastSeen(timestamp), metrics(numMetrics, MetricStatistics(threshold))
+        {
+        }
+        double firstSeen;
+        double lastSeen;
+        std::vector<MetricStatistics> metrics;
+    };
+
+    void write(const FaceId faceId, const Track &track)
+    {
+        for (size_t i = 0; i < track.metrics.size(); i++)
+        {
+            const MetricStatistics &s = track.metrics[i];
+            mOut << faceId << "," << mMetricNames[i] << "," << track.firstSeen << "," << track.lastSeen << ","
+                << s.count() << "," << s.mean() << "," << s.stddev() << "," << s.min() << "," << s.max() << ","
+                << s.quantile(0.1) << "," << s.quantile(0.5) << "," << s.quantile(0.9) << ","
+                << s.secondsAbove() << "\n";
+        }
+        mFacesWritten++;
+    }
+
+    std::ostream &mOut;
+    const float mThreshold;
+    std::vector<std::string> mMetricNames;
+    std::map<FaceId, Track> mTracks;
+    std::map<FaceId, double> mLost;     // Faces reported lost, by the timestamp of the loss
+    std::mutex mMutex;                  // Guards mLost
+    size_t mFacesWritten;
+};
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Face.h"
+
+#include "MetricBatch.hpp"
+
+using namespace affdex;
+
+/** @brief Recent history of one tracked face
+ * The last samples are kept in a ring buffer with one array per metric (struct of arrays), so reading the
+ * history of one metric, for a sparkline or a smoothing filter, walks contiguous memory.  Sample i = 0 is
+ * the oldest, size() - 1 the newest, and any sample is reached in constant time.
+ */
+class FaceTrack
+{
+public:
+
+    FaceTrack(const FaceId id, const size_t capacity, const size_t numMetrics, const double firstSeen)
+        : mId(id), mCapacity(std::max<size_t>(1, capacity)), mNumMetrics(numMetrics), mHead(0), mSize(0),
+          mFirstSeen(firstSeen), mLastSeen(firstSeen), mLostAt(-1), mTimestamps(mCapacity),
+          mValues(mCapacity * numMetrics)
+    {
+    }
+
+    FaceId id() const { return mId; }
+    size_t size() const { return mSize; }
+    size_t capacity() const { return mCapacity; }
+    size_t numMetrics() const { return mNumMetrics; }
+
+    /** @brief Time the face was first found */
+    double firstSeen() const { return mFirstSeen; }
+
+    /** @brief Time of the newest results of the face */
+    double lastSeen() const { return mLastSeen; }
+
+    /** @brief Whether the detector reported the face lost */
+    bool lost() const { return mLostAt >= 0; }
+
+    /** @brief Timestamp of a sample, 0 being the oldest */
+    double timestamp(const size_t i) const { return mTimestamps[slot(i)]; }
+
+    /** @brief Value of a metric at a sample, 0 being the oldest
+     * @param metric -- Index in FaceTrackStore::metricNames()
+     * @param i      -- The sample
+     */
+    float value(const size_t metric, const size_t i) const { return mValues[metric * mCapacity + slot(i)]; }
+
+    /** @brief Newest value of a metric, call only when size() > 0 */
+    float latest(const size_t metric) const { return value(metric, mSize - 1); }
+
+    /** @brief Series copies the history of a metric, oldest first
+     * @param metric -- Index in FaceTrackStore::metricNames()
+     * @param out    -- Receives the values
+     */
+    void series(const size_t metric, std::vector<float> &out) const
+    {
+        // At most two contiguous runs: from the oldest to the end of the array, then from its start
+        const float *values = &mValues[metric * mCapacity];
+        const size_t first = std::min(mSize, mCapacity - mHead);
+        out.assign(values + mHead, values + mHead + first);
+        out.insert(out.end(), values, values + (mSize - first));
+    }
+
+private:
+    friend class FaceTrackStore;
+
+    size_t slot(const size_t i) const
+    {
+        const size_t s = mHead + i;
+        return s >= mCapacity ? s - mCapacity : s;
+    }
+
+    void push(const double timestamp, const std::vector<float> &values)
+    {
+        if (mSize == mCapacity)
+        {
+            mHead = slot(1);
+            mSize--;
+        }
+        const size_t s = slot(mSize);
+        mTimestamps[s] = timestamp;
+        for (size_t m = 0; m < mNumMetrics; m++) mValues[m * mCapacity + s] = values[m];
+        mSize++;
+        mLastSeen = timestamp;
+        mLostAt = -1;
+    }
+
+    void dropBefore(const double timestamp)
+    {
+        while (mSize > 0 && mTimestamps[mHead] < timestamp)
+        {
+            mHead = slot(1);
+            mSize--;
+        }
+    }
+
+    const FaceId mId;
+    const size_t mCapacity;
+    const size_t mNumMetrics;
+    size_t mHead;                   // Slot of the oldest sample
+    size_t mSize;
+    double mFirstSeen;
+    double mLastSeen;
+    double mLostAt;
+    std::vector<double> mTimestamps;
+    std::vector<float> mValues;     // mCapacity values of metric 0, then of metric 1 ..
+};
+
+/** @brief Keeps the last seconds of the metrics of every tracked face
+ * Fed with every frame's results (PlottingImageListener::setTrackStore) and with the detector's face found
+ * and lost notifications (AFaceListener), from the SDK's threads, while the display or the sinks read it:
+ * hold lock() while using the tracks returned by find().  The metrics are the head angles, emotions,
+ * expressions and emojis, in the order of metricNames().  A track is dropped once it has had no results
+ * for the length of the history.
+ */
+class FaceTrackStore
+{
+public:
+
+    /** @brief FaceTrackStore
+     * @param historySeconds -- How far back to keep the metrics
+     * @param maxFrameRate   -- Highest rate results come in, to size the ring buffers
+     */
+    FaceTrackStore(const double historySeconds, const double maxFrameRate = 30)
+        : mHistory(historySeconds), mCapacity((size_t)std::ceil(historySeconds * maxFrameRate) + 1)
+    {
+        mValues.resize(MetricBatch::NUM_METRICS);
+    }
+
+    /** @brief Names of the metrics kept, a metric is referred to by its index in this list (the batch's) */
+    const std::vector<std::string> & metricNames() const { return MetricBatch::metricNames(); }
+
+    /** @brief MetricIndex finds a metric by name, -1 if there is no such metric */
+    int metricIndex(const std::string &name) const { return MetricBatch::metricIndex(name); }
+
+    /** @brief Lock the store, for as long as tracks returned by find() are used */
+    std::unique_lock<std::mutex> lock() const { return std::unique_lock<std::mutex>(mMutex); }
+
+    /** @brief Find returns the track of a face, or nullptr; hold lock() */
+    const FaceTrack * find(const FaceId faceId) const
+    {
+        const auto it = mTracks.find(faceId);
+        return it == mTracks.end() ? nullptr : &it->second;
+    }
+
+    /** @brief Add records the results of a frame
+     * @param timestamp -- The frame's timestamp
+     * @param faces     -- The faces found in it
+     */
+    void add(const double timestamp, const std::map<FaceId, Face> &faces)
+    {
+        std::lock_guard<std::mutex> lg(mMutex);
+        mRows.clear();
+        mRows.append(timestamp, faces);
+        addRows(mRows);
+    }
+
+    /** @brief Add records the results of a frame, already converted to a batch
+     */
+    void add(const MetricBatch &rows)
+    {
+        std::lock_guard<std::mutex> lg(mMutex);
+        addRows(rows);
+    }
+
+    /** @brief OnFaceFound starts the track of a face, from FaceListener::onFaceFound */
+    void onFaceFound(const float timestamp, const FaceId faceId)
+    {
+        std::lock_guard<std::mutex> lg(mMutex);
+        get(faceId, timestamp);
+    }
+
+    /** @brief OnFaceLost marks a track lost, from FaceListener::onFaceLost
+     * Its history stays available until it is older than the history length.
+     */
+    void onFaceLost(const float timestamp, const FaceId faceId)
+    {
+        std::lock_guard<std::mutex> lg(mMutex);
+        const auto it = mTracks.find(faceId);
+        if (it != mTracks.end()) it->second.mLostAt = timestamp;
+    }
+
+private:
+
+    FaceTrack & get(const FaceId faceId, const double timestamp)
+    {
+        auto it = mTracks.find(faceId);
+        if (it == mTracks.end())
+        {
+            it = mTracks.insert(std::make_pair(faceId, FaceTrack(faceId, mCapacity, MetricBatch::NUM_METRICS, timestamp))).first;
+        }
+        return it->second;
+    }
+
+    void addRows(const MetricBatch &rows)
+    {
+        if (rows.rows() == 0) return;
+        for (size_t row = 0; row < rows.rows(); row++)
+        {
+            if (!rows.hasFace(row)) continue;
+            const double timestamp = rows.timestamp(row);
+            for (size_t m = 0; m < MetricBatch::NUM_METRICS; m++) mValues[m] = rows.value(m, row);
+            FaceTrack &track = get(rows.faceId(row), timestamp);
+            if (timestamp < track.lastSeen()) track.dropBefore(INFINITY);  // A looped video starts over
+            track.push(timestamp, mValues);
+        }
+
+        const double oldest = rows.timestamp(rows.rows() - 1) - mHistory;
+        for (auto it = mTracks.begin(); it != mTracks.end();)
+        {
+            it->second.dropBefore(oldest);
+            if (it->second.lastSeen() < oldest) it = mTracks.erase(it);
+            else ++it;
+        }
+    }
+
+    const double mHistory;
+    const size_t mCapacity;
+    std::vector<float> mValues;     // Scratch row for add()
+    MetricBatch mRows;              // Scratch batch for add() of a map of faces
+    mutable std::mutex mMutex;
+    std::map<FaceId, FaceTrack> mTracks;
+};
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+/** @brief Fixed set of frame buffers allocated on one NUMA node, handed out round robin
+ * Decoding into a buffer the thread already owns avoids an allocation per frame, and lets the buffers be
+ * placed: on Linux they are bound to the requested node with mbind (through the raw syscall, so there is
+ * no libnuma dependency) and in any case first touched by the thread that creates them, which puts their
+ * pages on that thread's node.  A buffer is handed out again after count more frames, so count must cover
+ * every frame that can still be in use downstream (queued or being read) when it comes around.
+ */
+class FramePool
+{
+public:
+
+    /** @brief FramePool
+     * @param count -- Number of buffers
+     * @param node  -- NUMA node to bind them to, -1 for wherever the allocating thread runs
+     */
+    FramePool(const size_t count, const int node = -1) : mBuffers(std::max<size_t>(1, count)), mNext(0), mNode(node)
+    {
+    }
+
+    ~FramePool()
+    {
+        for (Buffer &buffer : mBuffers) release(buffer);
+    }
+
+    /** @brief Next returns the next buffer as an image of the given size, allocating it on first use
+     * Reading a frame of that size into the image (cv::VideoCapture::read/retrieve) fills the buffer in place.
+     */
+    cv::Mat next(const int rows, const int cols)
+    {
+        Buffer &buffer = mBuffers[mNext];
+        mNext = (mNext + 1) % mBuffers.size();
+        const size_t size = (size_t)rows * cols * 3;
+        if (buffer.size != size)
+        {
+            release(buffer);
+            allocate(buffer, size);
+        }
+        return cv::Mat(rows, cols, CV_8UC3, buffer.data);
+    }
+
+private:
+
+    struct Buffer
+    {
+        Buffer() : data(nullptr), size(0) {}
+        unsigned char *data;
+        size_t size;
+    };
+
+    FramePool(const FramePool&);
+    FramePool& operator=(const FramePool&);
+
+    void allocate(Buffer &buffer, const size_t size)
+    {
+#ifdef _WIN32
+        buffer.data = new unsigned char[size];
+#else
+        const long page = sysconf(_SC_PAGESIZE);
+        void *data = nullptr;
+        if (posix_memalign(&data, page > 0 ? page : 4096, size) != 0) throw std::bad_alloc();
+        buffer.data = (unsigned char *)data;
+#ifdef SYS_mbind
+        if (mNode >= 0 && mNode < 64)
+        {
+            const unsigned long nodemask = 1UL << mNode;
+            const int MPOL_PREFERRED_MODE = 1;  // MPOL_PREFERRED from numaif.h: fall back to other nodes when full
+            syscall(SYS_mbind, data, size, MPOL_PREFERRED_MODE, &nodemask, 8 * sizeof(nodemask) + 1, 0);
+        }
+#endif
+#endif
+        std::memset(buffer.data, 0, size);  // First touch, from the thread that will use the buffer
+        buffer.size = size;
+    }
+
+    static void release(Buffer &buffer)
+    {
+#ifdef _WIN32
+        delete[] buffer.data;
+#else
+        free(buffer.data);
+#endif
+        buffer.data = nullptr;
+        buffer.size = 0;
+    }
+
+    std::vector<Buffer> mBuffers;
+    size_t mNext;
+    const int mNode;
+};
@@ -0,0 +1,151 @@
+#include "Logger.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+    const char * levelName(LogLevel level)
+    {
+        switch (level)
+        {
+            case LogLevel::Debug: return "DEBUG";
+            case LogLevel::Info: return "INFO ";
+            case LogLevel::Warning: return "WARN ";
+            case LogLevel::Error: return "ERROR";
+        }
+        return "";
+    }
+
+    const int FLUSH_INTERVAL_MS = 50;
+}
+
+Logger& Logger::instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger()
+    : mLevel((int)LogLevel::Info), mPrecision(6), mSeq(0),
+      mStart(std::chrono::steady_clock::now()), mStop(false)
+{
+    mThread = std::thread(&Logger::run, this);
+}
+
+Logger::~Logger()
+{
+    {
+        std::lock_guard<std::mutex> lg(mWakeMutex);
+        mStop = true;
+    }
+    mWake.notify_one();
+    if (mThread.joinable()) mThread.join();
+    drain();
+}
+
+bool Logger::parseLevel(const std::string &name, LogLevel &level)
+{
+    if (name == "debug") level = LogLevel::Debug;
+    else if (name == "info") level = LogLevel::Info;
+    else if (name == "warning") level = LogLevel::Warning;
+    else if (name == "error") level = LogLevel::Error;
+    else return false;
+    return true;
+}
+
+Logger::Buffer& Logger::threadBuffer()
+{
+    // The registry keeps the buffer alive after the thread exits so nothing it logged is lost
+    static LOGGER_THREAD_LOCAL Buffer *tBuffer = nullptr;
+    if (!tBuffer)
+    {
+        std::shared_ptr<Buffer> buffer = std::make_shared<Buffer>();
+        std::lock_guard<std::mutex> lg(mBuffersMutex);
+        mBuffers.push_back(buffer);
+        tBuffer = buffer.get();
+    }
+    return *tBuffer;
+}
+
+void Logger::write(LogLevel level, std::string &&msg)
+{
+    Buffer &buffer = threadBuffer();
+    const size_t tail = buffer.tail.load(std::memory_order_relaxed);
+    if (tail - buffer.head.load(std::memory_order_acquire) >= Buffer::CAPACITY)
+    {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Entry &entry = buffer.slots[tail % Buffer::CAPACITY];
+    entry.seq = mSeq.fetch_add(1, std::memory_order_relaxed);
+    entry.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+    entry.level = level;
+    entry.text = std::move(msg);
+    buffer.tail.store(tail + 1, std::memory_order_release);
+
+    if (level >= LogLevel::Warning) mWake.notify_one();
+}
+
+void Logger::flush()
+{
+    drain();
+}
+
+void Logger::run()
+{
+    std::unique_lock<std::mutex> lock(mWakeMutex);
+    while (!mStop)
+    {
+        mWake.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MS));
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+}
+
+void Logger::drain()
+{
+    std::lock_guard<std::mutex> flushLock(mFlushMutex);
+
+    std::vector<std::shared_ptr<Buffer>> buffers;
+    {
+        std::lock_guard<std::mutex> lg(mBuffersMutex);
+        buffers = mBuffers;
+    }
+
+    std::vector<Entry> entries;
+    uint64_t dropped = 0;
+    for (auto &buffer : buffers)
+    {
+        const size_t tail = buffer->tail.load(std::memory_order_acquire);
+        size_t head = buffer->head.load(std::memory_order_relaxed);
+        for (; head != tail; head++)
+        {
+            entries.push_back(std::move(buffer->slots[head % Buffer::CAPACITY]));
+        }
+        buffer->head.store(head, std::memory_order_release);
+        dropped += buffer->dropped.exchange(0, std::memory_order_relaxed);
+    }
+    if (entries.empty() && dropped == 0) return;
+
+    // Interleave the per-thread buffers back into the order the messages were logged
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.seq < b.seq; });
+
+    std::string out;
+    char prefix[32];
+    for (const Entry &entry : entries)
+    {
+        std::snprintf(prefix, sizeof(prefix), "[%10.3f] %s ", entry.time, levelName(entry.level));
+        out += prefix;
+        out += entry.text;
+        out += '\n';
+    }
+    if (dropped > 0)
+    {
+        out += "[logger] " + std::to_string(dropped) + " messages dropped, log buffer full\n";
+    }
+    std::fwrite(out.data(), 1, out.size(), stderr);
+    std::fflush(stderr);
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define LOGGER_THREAD_LOCAL __declspec(thread)
+#else
+#define LOGGER_THREAD_LOCAL thread_local
+#endif
+
+enum class LogLevel { Debug = 0, Info = 1, Warning = 2, Error = 3 };
+
+/** @brief Buffered, leveled logging for the sample apps
+ * Every thread appends to its own lock-free ring of messages; a background thread drains all the rings
+ * every few milliseconds and writes them to stderr in one call.  The producing thread never flushes or
+ * waits on the console.  Warnings and errors wake the flusher immediately.
+ * Use the LOG / LOG_EVERY_MS macros rather than calling write() directly.
+ */
+class Logger
+{
+public:
+
+    static Logger& instance();
+
+    ~Logger();
+
+    /** @brief SetLevel drops messages below the given level
+     */
+    void setLevel(LogLevel level) { mLevel.store((int)level, std::memory_order_relaxed); }
+
+    bool enabled(LogLevel level) const { return (int)level >= mLevel.load(std::memory_order_relaxed); }
+
+    /** @brief SetPrecision sets the floating point precision used when formatting messages
+     */
+    void setPrecision(int precision) { mPrecision = precision; }
+
+    int getPrecision() const { return mPrecision; }
+
+    /** @brief Write queues a formatted message on the calling thread's buffer
+     * @param level -- Severity
+     * @param msg   -- Message text (moved into the buffer)
+     */
+    void write(LogLevel level, std::string &&msg);
+
+    /** @brief Flush synchronously writes everything buffered so far
+     */
+    void flush();
+
+    /** @brief Parse "debug", "info", "warning" or "error"
+     * @return false if the name is not recognized
+     */
+    static bool parseLevel(const std::string &name, LogLevel &level);
+
+private:
+
+    struct Entry
+    {
+        uint64_t seq;
+        double time;
+        LogLevel level;
+        std::string text;
+    };
+
+    /** Single producer (the owning thread), single consumer (the flusher) ring of entries */
+    struct Buffer
+    {
+        static const size_t CAPACITY = 4096;
+        Buffer() : head(0), tail(0), dropped(0), slots(CAPACITY) {}
+        std::atomic<size_t> head;       // Next slot to read, written by the flusher
+        std::atomic<size_t> tail;       // Next slot to write, written by the owning thread
+        std::atomic<uint64_t> dropped;  // Messages lost because the ring was full
+        std::vector<Entry> slots;
+    };
+
+    Logger();
+    Logger(const Logger&);
+    Logger& operator=(const Logger&);
+
+    Buffer& threadBuffer();
+    void run();
+    void drain();
+
+    std::atomic<int> mLevel;
+    int mPrecision;
+    std::atomic<uint64_t> mSeq;
+    const std::chrono::steady_clock::time_point mStart;
+
+    std::mutex mBuffersMutex;                       // Guards registration, only taken once per thread
+    std::vector<std::shared_ptr<Buffer>> mBuffers;
+
+    std::mutex mFlushMutex;                         // Serializes drains (flusher thread vs flush())
+    std::mutex mWakeMutex;
+    std::condition_variable mWake;
+    bool mStop;
+    std::thread mThread;
+};
+
+/** @brief Per call-site rate limiter used by LOG_EVERY_MS
+ * Lets one message through per interval and counts the ones it holds back.
+ */
+class LogRateLimiter
+{
+public:
+
+    explicit LogRateLimiter(int interval_ms) : mIntervalNs((int64_t)interval_ms * 1000000), mNext(0), mSuppressed(0) {}
+
+    bool allow()
+    {
+        const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t next = mNext.load(std::memory_order_relaxed);
+        if (now >= next && mNext.compare_exchange_strong(next, now + mIntervalNs, std::memory_order_relaxed))
+        {
+            return true;
+        }
+        mSuppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    /** @brief Number of messages suppressed since the last one that got through (resets the count)
+     */
+    uint32_t takeSuppressed() { return mSuppressed.exchange(0, std::memory_order_relaxed); }
+
+private:
+    const int64_t mIntervalNs;
+    std::atomic<int64_t> mNext;
+    std::atomic<uint32_t> mSuppressed;
+};
+
+/** @brief Collects one message and hands it to the Logger when it goes out of scope
+ */
+class LogMessage
+{
+public:
+
+    LogMessage(LogLevel level, uint32_t suppressed = 0) : mLevel(level), mSuppressed(suppressed)
+    {
+        mStream.precision(Logger::instance().getPrecision());
+    }
+
+    ~LogMessage()
+    {
+        if (mSuppressed > 0) mStream << " (" << mSuppressed << " similar messages suppressed)";
+        Logger::instance().write(mLevel, mStream.str());
+    }
+
+    std::ostream& stream() { return mStream; }
+
+private:
+    const LogLevel mLevel;
+    const uint32_t mSuppressed;
+    std::ostringstream mStream;
+};
+
+/** @brief Turns the message expression of LOG into void, so LOG can be a single conditional expression that
+ * is safe in an unbraced if/else
+ */
+class LogMessageVoidify
+{
+public:
+
+    void operator&(std::ostream&) {}
+};
+
+#define LOG(level) \
+    !Logger::instance().enabled(level) ? (void)0 : LogMessageVoidify() & LogMessage(level).stream()
+
+/** Log at most once every `ms` milliseconds from this call site, noting how many messages were skipped */
+#define LOG_EVERY_MS(level, ms) \
+    for (LogRateLimiter *logLimiter_ = &([]() -> LogRateLimiter& { static LogRateLimiter l(ms); return l; }()); \
+         logLimiter_ && Logger::instance().enabled(level) && logLimiter_->allow(); logLimiter_ = nullptr) \
+        LogMessage(level, logLimiter_->takeSuppressed()).stream()
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+/** @brief Bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's design)
+ * Every cell carries a sequence number that tells producers and consumers whether it is free for the
+ * current lap around the ring, so a push or pop is one compare-and-swap on the position plus one release
+ * store on the cell; nobody ever waits on a lock.  tryPush/tryPop fail instead of blocking, callers decide
+ * how to wait (see BackoffWait).  The capacity is rounded up to a power of two.
+ */
+template<class T>
+class MPMCQueue
+{
+public:
+
+    explicit MPMCQueue(size_t capacity)
+        : mMask(roundUp(capacity) - 1), mCells(new Cell[mMask + 1]), mEnqueuePos(0), mDequeuePos(0)
+    {
+        for (size_t i = 0; i <= mMask; i++) mCells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    /** @brief TryPush appends an item unless the queue is full
+     */
+    bool tryPush(T &&item)
+    {
+        size_t pos = mEnqueuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell &cell = mCells[pos & mMask];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0)
+            {
+                if (mEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    cell.data = std::move(item);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;   // The cell still holds last lap's item, full
+            }
+            else
+            {
+                pos = mEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPush(const T &item)
+    {
+        T copy(item);
+        return tryPush(std::move(copy));
+    }
+
+    /** @brief TryPop removes the oldest item unless the queue is empty
+     */
+    bool tryPop(T &item)
+    {
+        size_t pos = mDequeuePos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            Cell &cell = mCells[pos & mMask];
+            const size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0)
+            {
+                if (mDequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    item = std::move(cell.data);
+                    cell.data = T();
+                    cell.sequence.store(pos + mMask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;   // Nothing written to this cell yet, empty
+            }
+            else
+            {
+                pos = mDequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /** @brief Approximate number of items, exact only when no other thread is pushing or popping
+     */
+    size_t size() const
+    {
+        const size_t enqueued = mEnqueuePos.load(std::memory_order_relaxed);
+        const size_t dequeued = mDequeuePos.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    size_t capacity() const { return mMask + 1; }
+
+private:
+
+    static const size_t CACHE_LINE = 64;
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    static size_t roundUp(size_t n)
+    {
+        size_t p = 2;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+    MPMCQueue(const MPMCQueue&);
+    MPMCQueue& operator=(const MPMCQueue&);
+
+    const size_t mMask;
+    const std::unique_ptr<Cell[]> mCells;
+    // Producers and consumers each hammer their own position, keep them on separate cache lines
+    char mPad0[CACHE_LINE];
+    std::atomic<size_t> mEnqueuePos;
+    char mPad1[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> mDequeuePos;
+    char mPad2[CACHE_LINE - sizeof(std::atomic<size_t>)];
+};
+
+/** @brief Spin, then yield, then sleep while waiting on a lock-free queue
+ * Keeps hand-offs fast when the other side is keeping up without burning a core when it isn't.
+ */
+class BackoffWait
+{
+public:
+
+    BackoffWait() : mCount(0) {}
+
+    void wait()
+    {
+        if (mCount < 64) { }
+        else if (mCount < 128) std::this_thread::yield();
+        else std::this_thread::sleep_for(std::chrono::microseconds(200));
+        if (mCount < 128) mCount++;
+    }
+
+    void reset() { mCount = 0; }
+
+private:
+    unsigned int mCount;
+};
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Face.h"
+
+#include "BoundingBox.hpp"
+
+/** @brief A float metric of one of the SDK's metric structs, found by its member rather than by its offset
+ */
+template <class Group>
+struct MetricField
+{
+    const char *name;
+    float Group::*member;
+};
+
+// The metric columns, in the order of the csv columns
+static const MetricField<affdex::Orientation> ANGLE_FIELDS[] = {
+    { "pitch", &affdex::Orientation::pitch }, { "yaw", &affdex::Orientation::yaw }, { "roll", &affdex::Orientation::roll }
+};
+
+static const MetricField<affdex::Emotions> EMOTION_FIELDS[] = {
+    { "joy", &affdex::Emotions::joy }, { "fear", &affdex::Emotions::fear }, { "disgust", &affdex::Emotions::disgust },
+    { "sadness", &affdex::Emotions::sadness }, { "anger", &affdex::Emotions::anger },
+    { "surprise", &affdex::Emotions::surprise }, { "contempt", &affdex::Emotions::contempt },
+    { "valence", &affdex::Emotions::valence }, { "engagement", &affdex::Emotions::engagement }
+};
+
+static const MetricField<affdex::Expressions> EXPRESSION_FIELDS[] = {
+    { "smile", &affdex::Expressions::smile }, { "innerBrowRaise", &affdex::Expressions::innerBrowRaise },
+    { "browRaise", &affdex::Expressions::browRaise }, { "browFurrow", &affdex::Expressions::browFurrow },
+    { "noseWrinkle", &affdex::Expressions::noseWrinkle }, { "upperLipRaise", &affdex::Expressions::upperLipRaise },
+    { "lipCornerDepressor", &affdex::Expressions::lipCornerDepressor }, { "chinRaise", &affdex::Expressions::chinRaise },
+    { "lipPucker", &affdex::Expressions::lipPucker }, { "lipPress", &affdex::Expressions::lipPress },
+    { "lipSuck", &affdex::Expressions::lipSuck }, { "mouthOpen", &affdex::Expressions::mouthOpen },
+    { "smirk", &affdex::Expressions::smirk }, { "eyeClosure", &affdex::Expressions::eyeClosure },
+    { "attention", &affdex::Expressions::attention }, { "eyeWiden", &affdex::Expressions::eyeWiden },
+    { "cheekRaise", &affdex::Expressions::cheekRaise }, { "lidTighten", &affdex::Expressions::lidTighten },
+    { "dimpler", &affdex::Expressions::dimpler }, { "lipStretch", &affdex::Expressions::lipStretch },
+    { "jawDrop", &affdex::Expressions::jawDrop }
+};
+
+static const MetricField<affdex::Emojis> EMOJI_FIELDS[] = {
+    { "relaxed", &affdex::Emojis::relaxed }, { "smiley", &affdex::Emojis::smiley },
+    { "laughing", &affdex::Emojis::laughing }, { "kissing", &affdex::Emojis::kissing },
+    { "disappointed", &affdex::Emojis::disappointed }, { "rage", &affdex::Emojis::rage },
+    { "smirk", &affdex::Emojis::smirk }, { "wink", &affdex::Emojis::wink },
+    { "stuckOutTongueWinkingEye", &affdex::Emojis::stuckOutTongueWinkingEye },
+    { "stuckOutTongue", &affdex::Emojis::stuckOutTongue }, { "flushed", &affdex::Emojis::flushed },
+    { "scream", &affdex::Emojis::scream }
+};
+
+/** @brief The results of one or more frames in columns: one contiguous array per metric, a row per face
+ * Results are converted once, as they come in, from the per-face SDK structs into the columns, reading each
+ * metric by its member (the tables above) rather than by walking the struct with a float pointer.  The
+ * static asserts below fail to compile if the SDK structs get a field the tables don't know about.  The
+ * sinks then read the columns: a metric of every face in the batch is one array, and a frame without any
+ * face is a single row for which hasFace() is false.  Rows are in the order they were appended.
+ */
+class MetricBatch
+{
+public:
+
+    enum : size_t
+    {
+        NUM_ANGLES = sizeof(ANGLE_FIELDS) / sizeof(ANGLE_FIELDS[0]),
+        NUM_EMOTIONS = sizeof(EMOTION_FIELDS) / sizeof(EMOTION_FIELDS[0]),
+        NUM_EXPRESSIONS = sizeof(EXPRESSION_FIELDS) / sizeof(EXPRESSION_FIELDS[0]),
+        NUM_EMOJIS = sizeof(EMOJI_FIELDS) / sizeof(EMOJI_FIELDS[0]),
+
+        // Metric indexes: the head angles, then the emotions, expressions and emojis
+        FIRST_ANGLE = 0,
+        FIRST_EMOTION = FIRST_ANGLE + NUM_ANGLES,
+        FIRST_EXPRESSION = FIRST_EMOTION + NUM_EMOTIONS,
+        FIRST_EMOJI = FIRST_EXPRESSION + NUM_EXPRESSIONS,
+        NUM_METRICS = FIRST_EMOJI + NUM_EMOJIS
+    };
+
+    static const affdex::FaceId NO_FACE = -1;
+
+    /** @brief Names of all the metrics, by metric index */
+    static const std::vector<std::string> & metricNames()
+    {
+        static const std::vector<std::string> names = allNames();
+        return names;
+    }
+
+    /** @brief Names of the metrics from first to first + count, e.g. (FIRST_EMOTION, NUM_EMOTIONS) */
+    static std::vector<std::string> metricNames(const size_t first, const size_t count)
+    {
+        return std::vector<std::string>(metricNames().begin() + first, metricNames().begin() + first + count);
+    }
+
+    /** @brief MetricIndex finds a metric by name, -1 if there is no such metric */
+    static int metricIndex(const std::string &name)
+    {
+        const auto it = std::find(metricNames().begin(), metricNames().end(), name);
+        return it == metricNames().end() ? -1 : (int)(it - metricNames().begin());
+    }
+
+    MetricBatch() : mColumns(NUM_METRICS) {}
+
+    /** @brief Clear empties the batch, keeping its memory for the next results */
+    void clear()
+    {
+        mTimestamps.clear();
+        mFaceIds.clear();
+        mInterocular.clear();
+        mAppearance.clear();
+        mDominantEmoji.clear();
+        mBoxes.clear();
+        for (std::vector<float> &column : mColumns) column.clear();
+    }
+
+    /** @brief Append adds the results of a frame, a row per face (one row without a face if there are none)
+     * @param timestamp -- The frame's timestamp
+     * @param faces     -- The faces found in it
+     */
+    void append(const double timestamp, const std::map<affdex::FaceId, affdex::Face> &faces)
+    {
+        if (faces.empty())
+        {
+            static const affdex::Face none = emptyFace();
+            appendRow(timestamp, NO_FACE, none);
+        }
+        for (const auto &face_id_pair : faces) appendRow(timestamp, face_id_pair.second.id, face_id_pair.second);
+    }
+
+    size_t rows() const { return mTimestamps.size(); }
+
+    double timestamp(const size_t row) const { return mTimestamps[row]; }
+    affdex::FaceId faceId(const size_t row) const { return mFaceIds[row]; }
+    bool hasFace(const size_t row) const { return mFaceIds[row] != NO_FACE; }
+
+    /** @brief Contains tells whether a face has a row in the batch */
+    bool contains(const affdex::FaceId faceId) const
+    {
+        return faceId != NO_FACE && std::find(mFaceIds.begin(), mFaceIds.end(), faceId) != mFaceIds.end();
+    }
+
+    /** @brief Column returns the values of a metric for every row, rows() of them */
+    const float * column(const size_t metric) const { return mColumns[metric].data(); }
+    float * column(const size_t metric) { return mColumns[metric].data(); }
+    float value(const size_t metric, const size_t row) const { return mColumns[metric][row]; }
+
+    float interocularDistance(const size_t row) const { return mInterocular[row]; }
+    const affdex::Appearance & appearance(const size_t row) const { return mAppearance[row]; }
+    affdex::Emoji dominantEmoji(const size_t row) const { return mDominantEmoji[row]; }
+    const BoundingBox & boundingBox(const size_t row) const { return mBoxes[row]; }
+
+    affdex::Orientation orientation(const size_t row) const
+    {
+        affdex::Orientation o;
+        for (size_t i = 0; i < NUM_ANGLES; i++) o.*ANGLE_FIELDS[i].member = mColumns[FIRST_ANGLE + i][row];
+        return o;
+    }
+
+private:
+
+    static std::vector<std::string> allNames()
+    {
+        std::vector<std::string> names;
+        for (const auto &field : ANGLE_FIELDS) names.push_back(field.name);
+        for (const auto &field : EMOTION_FIELDS) names.push_back(field.name);
+        for (const auto &field : EXPRESSION_FIELDS) names.push_back(field.name);
+        for (const auto &field : EMOJI_FIELDS) names.push_back(field.name);
+        return names;
+    }
+
+    static affdex::Face emptyFace()
+    {
+        const float nan = std::numeric_limits<float>::quiet_NaN();
+        affdex::Face face;
+        face.id = NO_FACE;
+        for (const auto &field : ANGLE_FIELDS) face.measurements.orientation.*field.member = nan;
+        for (const auto &field : EMOTION_FIELDS) face.emotions.*field.member = nan;
+        for (const auto &field : EXPRESSION_FIELDS) face.expressions.*field.member = nan;
+        for (const auto &field : EMOJI_FIELDS) face.emojis.*field.member = nan;
+        face.emojis.dominantEmoji = affdex::Emoji::Unknown;
+        face.measurements.interocularDistance = nan;
+        face.appearance.gender = affdex::Gender::Unknown;
+        face.appearance.glasses = affdex::Glasses::No;
+        face.appearance.age = affdex::Age::AGE_UNKNOWN;
+        face.appearance.ethnicity = affdex::Ethnicity::UNKNOWN;
+        return face;
+    }
+
+    void appendRow(const double timestamp, const affdex::FaceId faceId, const affdex::Face &f)
+    {
+        mTimestamps.push_back(timestamp);
+        mFaceIds.push_back(faceId);
+        mInterocular.push_back(f.measurements.interocularDistance);
+        mAppearance.push_back(f.appearance);
+        mDominantEmoji.push_back(f.emojis.dominantEmoji);
+        mBoxes.push_back(computeBoundingBox(f.featurePoints));
+
+        std::vector<float> *column = &mColumns[0];
+        for (const auto &field : ANGLE_FIELDS) (column++)->push_back(f.measurements.orientation.*field.member);
+        for (const auto &field : EMOTION_FIELDS) (column++)->push_back(f.emotions.*field.member);
+        for (const auto &field : EXPRESSION_FIELDS) (column++)->push_back(f.expressions.*field.member);
+        for (const auto &field : EMOJI_FIELDS) (column++)->push_back(f.emojis.*field.member);
+    }
+
+    std::vector<double> mTimestamps;
+    std::vector<affdex::FaceId> mFaceIds;
+    std::vector<float> mInterocular;
+    std::vector<affdex::Appearance> mAppearance;
+    std::vector<affdex::Emoji> mDominantEmoji;
+    std::vector<BoundingBox> mBoxes;
+    std::vector<std::vector<float> > mColumns;  // One per metric
+};
+
+// Every float of the SDK's metric structs must have a column, a new field breaks the build here
+static_assert(sizeof(affdex::Orientation) == MetricBatch::NUM_ANGLES * sizeof(float),
+              "affdex::Orientation has a field missing from ANGLE_FIELDS");
+static_assert(sizeof(affdex::Emotions) == MetricBatch::NUM_EMOTIONS * sizeof(float),
+              "affdex::Emotions has a field missing from EMOTION_FIELDS");
+static_assert(sizeof(affdex::Expressions) == MetricBatch::NUM_EXPRESSIONS * sizeof(float),
+              "affdex::Expressions has a field missing from EXPRESSION_FIELDS");
+static_assert(sizeof(affdex::Emojis) == MetricBatch::NUM_EMOJIS * sizeof(float) + sizeof(affdex::Emoji),
+              "affdex::Emojis has a field missing from EMOJI_FIELDS");
+static_assert(sizeof(affdex::Measurements) == sizeof(affdex::Orientation) + sizeof(float),
+              "affdex::Measurements has a field the batch doesn't keep");
@@ -0,0 +1,349 @@
+#pragma once
+
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define AFFDEX_SMOOTHING_SSE
+#include <xmmintrin.h>
+#endif
+
+#include "MetricBatch.hpp"
+
+/** @brief How one metric is smoothed, the filter in use picks the fields it needs
+ */
+struct SmoothingParams
+{
+    SmoothingParams() : alpha(0.5f), minCutoff(1.f), beta(0.02f), dCutoff(1.f) {}
+    float alpha;        // EMA: weight of the new value, 1 leaves the metric as it is
+    float minCutoff;    // One euro: cutoff frequency in Hz while the metric is still
+    float beta;         // One euro: cutoff added per unit per second the metric moves
+    float dCutoff;      // One euro: cutoff frequency in Hz of the speed estimate
+};
+
+/** @brief Smooths the metrics of every face over time, in place in the MetricBatch before it reaches the sinks
+ * Each face keeps the last smoothed value of all its metrics in one padded vector, and a result runs the
+ * filter over the whole vector four metrics per SSE instruction (a scalar loop without SSE).  The
+ * exponential moving average blends each value with the previous one at a fixed weight; the one euro filter
+ * (Casiez et al., CHI 2012) is an EMA whose cutoff frequency rises with the speed of the metric, so still
+ * metrics are smoothed hard while quick changes come through with little lag.  Parameters are per metric.
+ * A face's first value, and a NaN, go through unchanged.  The state of a face is dropped once the detector
+ * reports it lost (onFaceLost, from the SDK's thread) and the results have caught up with the loss.
+ */
+class MetricSmoother
+{
+public:
+
+    enum class Filter { Ema, OneEuro };
+
+    /** @brief ParseFilter reads a filter name, "ema" or "oneeuro"
+     * @return false if the name is not a filter
+     */
+    static bool parseFilter(const std::string &name, Filter &filter)
+    {
+        if (name == "ema") filter = Filter::Ema;
+        else if (name == "oneeuro") filter = Filter::OneEuro;
+        else return false;
+        return true;
+    }
+
+    /** @brief MetricSmoother
+     * @param filter   -- The filter
+     * @param defaults -- Parameters of every metric until setParams
+     */
+    explicit MetricSmoother(const Filter filter, const SmoothingParams &defaults = SmoothingParams())
+        : mFilter(filter), mAlpha(PADDED, 1.f), mMinCutoff(PADDED, 1.f), mBeta(PADDED, 0.f), mDCutoff(PADDED, 1.f),
+          mIn(PADDED, 0.f), mOut(PADDED, 0.f)
+    {
+        for (size_t m = 0; m < MetricBatch::NUM_METRICS; m++) setParams(m, defaults);
+    }
+
+    Filter filter() const { return mFilter; }
+
+    /** @brief SetParams changes how a metric is smoothed, call before apply()
+     * @param metric -- Index in MetricBatch::metricNames()
+     * @param params -- The metric's parameters
+     */
+    void setParams(const size_t metric, const SmoothingParams &params)
+    {
+        mAlpha[metric] = params.alpha;
+        mMinCutoff[metric] = params.minCutoff;
+        mBeta[metric] = params.beta;
+        mDCutoff[metric] = params.dCutoff;
+    }
+
+    SmoothingParams params(const size_t metric) const
+    {
+        SmoothingParams params;
+        params.alpha = mAlpha[metric];
+        params.minCutoff = mMinCutoff[metric];
+        params.beta = mBeta[metric];
+        params.dCutoff = mDCutoff[metric];
+        return params;
+    }
+
+    /** @brief Apply replaces the metrics of every face in a batch by their smoothed values
+     * @param rows -- Results in timestamp order, a face's timestamp going back (a looped video) restarts its filter
+     */
+    void apply(MetricBatch &rows)
+    {
+        std::lock_guard<std::mutex> lg(mMutex);
+        for (size_t row = 0; row < rows.rows(); row++)
+        {
+            if (!rows.hasFace(row)) continue;
+            const double timestamp = rows.timestamp(row);
+            for (size_t m = 0; m < MetricBatch::NUM_METRICS; m++) mIn[m] = rows.column(m)[row];
+
+            auto it = mFaces.find(rows.faceId(row));
+            if (it == mFaces.end() || timestamp <= it->second.timestamp)
+            {
+                if (it == mFaces.end()) it = mFaces.insert(std::make_pair(rows.faceId(row), State())).first;
+                it->second.timestamp = timestamp;
+                it->second.x = mIn;
+                it->second.dx.assign(PADDED, 0.f);
+                continue;
+            }
+
+            State &state = it->second;
+            const float dt = (float)(timestamp - state.timestamp);
+            state.timestamp = timestamp;
+            if (mFilter == Filter::Ema) ema(state);
+            else oneEuro(state, dt);
+            for (size_t m = 0; m < MetricBatch::NUM_METRICS; m++) rows.column(m)[row] = mOut[m];
+        }
+
+        // Results queued before the loss may still come in, so a face is dropped once they are past it
+        if (rows.rows() == 0) return;
+        const double latest = rows.timestamp(rows.rows() - 1);
+        for (auto it = mLost.begin(); it != mLost.end();)
+        {
+            if (it->second > latest) ++it;
+            else
+            {
+                mFaces.erase(it->first);
+                it = mLost.erase(it);
+            }
+        }
+    }
+
+    /** @brief OnFaceLost drops the state of a face, from FaceListener::onFaceLost
+     */
+    void onFaceLost(const float timestamp, const affdex::FaceId faceId)
+    {
+        std::lock_guard<std::mutex> lg(mMutex);
+        mLost[faceId] = timestamp;
+    }
+
+    /** @brief Number of faces with a filter state */
+    size_t faces() const
+    {
+        std::lock_guard<std::mutex> lg(mMutex);
+        return mFaces.size();
+    }
+
+private:
+
+    // The metric vectors are padded to whole SSE registers, the padding is smoothed along and never read
+    static const size_t PADDED = (MetricBatch::NUM_METRICS + 3) / 4 * 4;
+
+    struct State
+    {
+        double timestamp;
+        std::vector<float> x;   // Last smoothed values, PADDED of them
+        std::vector<float> dx;  // One euro: last smoothed speed of each metric
+    };
+
+    void ema(State &state)
+    {
+        float *x = state.x.data();
+        const float *in = mIn.data();
+        float *out = mOut.data();
+        const float *alpha = mAlpha.data();
+#ifdef AFFDEX_SMOOTHING_SSE
+        for (size_t m = 0; m < PADDED; m += 4)
+        {
+            const __m128 raw = _mm_loadu_ps(in + m);
+            const __m128 prev = _mm_loadu_ps(x + m);
+            __m128 y = _mm_add_ps(prev, _mm_mul_ps(_mm_loadu_ps(alpha + m), _mm_sub_ps(raw, prev)));
+            y = select(_mm_cmpunord_ps(prev, prev), raw, y);
+            const __m128 rawNan = _mm_cmpunord_ps(raw, raw);
+            _mm_storeu_ps(x + m, select(rawNan, prev, y));
+            _mm_storeu_ps(out + m, select(rawNan, raw, y));
+        }
+#else // AFFDEX_SMOOTHING_SSE
+        for (size_t m = 0; m < PADDED; m++)
+        {
+            if (std::isnan(in[m])) out[m] = in[m];
+            else out[m] = x[m] = std::isnan(x[m]) ? in[m] : x[m] + alpha[m] * (in[m] - x[m]);
+        }
+#endif // AFFDEX_SMOOTHING_SSE
+    }
+
+    void oneEuro(State &state, const float dt)
+    {
+        float *x = state.x.data();
+        float *dx = state.dx.data();
+        const float *in = mIn.data();
+        float *out = mOut.data();
+        const float *minCutoff = mMinCutoff.data();
+        const float *beta = mBeta.data();
+        const float *dCutoff = mDCutoff.data();
+        const float twoPiDt = 6.2831853f * dt;
+#ifdef AFFDEX_SMOOTHING_SSE
+        const __m128 w = _mm_set1_ps(twoPiDt);
+        const __m128 invDt = _mm_set1_ps(1 / dt);
+        const __m128 one = _mm_set1_ps(1.f);
+        const __m128 signBit = _mm_set1_ps(-0.f);
+        for (size_t m = 0; m < PADDED; m += 4)
+        {
+            const __m128 raw = _mm_loadu_ps(in + m);
+            const __m128 prev = _mm_loadu_ps(x + m);
+            const __m128 prevDx = _mm_loadu_ps(dx + m);
+
+            // Smoothed speed, with alpha = r / (r + 1) for r = 2 pi cutoff dt
+            __m128 r = _mm_mul_ps(w, _mm_loadu_ps(dCutoff + m));
+            const __m128 rawDx = _mm_mul_ps(_mm_sub_ps(raw, prev), invDt);
+            const __m128 newDx = _mm_add_ps(prevDx, _mm_mul_ps(_mm_div_ps(r, _mm_add_ps(r, one)), _mm_sub_ps(rawDx, prevDx)));
+
+            // Smoothed value, at a cutoff that rises with the speed
+            const __m128 cutoff = _mm_add_ps(_mm_loadu_ps(minCutoff + m), _mm_mul_ps(_mm_loadu_ps(beta + m), _mm_andnot_ps(signBit, newDx)));
+            r = _mm_mul_ps(w, cutoff);
+            __m128 y = _mm_add_ps(prev, _mm_mul_ps(_mm_div_ps(r, _mm_add_ps(r, one)), _mm_sub_ps(raw, prev)));
+
+            const __m128 prevNan = _mm_cmpunord_ps(prev, prev);
+            const __m128 rawNan = _mm_cmpunord_ps(raw, raw);
+            y = select(prevNan, raw, y);
+            _mm_storeu_ps(x + m, select(rawNan, prev, y));
+            _mm_storeu_ps(dx + m, select(_mm_or_ps(prevNan, rawNan), prevDx, newDx));
+            _mm_storeu_ps(out + m, select(rawNan, raw, y));
+        }
+#else // AFFDEX_SMOOTHING_SSE
+        for (size_t m = 0; m < PADDED; m++)
+        {
+            if (std::isnan(in[m]))
+            {
+                out[m] = in[m];
+                continue;
+            }
+            if (std::isnan(x[m]))
+            {
+                out[m] = x[m] = in[m];
+                continue;
+            }
+            float r = twoPiDt * dCutoff[m];
+            dx[m] += r / (r + 1) * ((in[m] - x[m]) / dt - dx[m]);
+            r = twoPiDt * (minCutoff[m] + beta[m] * std::fabs(dx[m]));
+            out[m] = x[m] += r / (r + 1) * (in[m] - x[m]);
+        }
+#endif // AFFDEX_SMOOTHING_SSE
+    }
+
+#ifdef AFFDEX_SMOOTHING_SSE
+    /** a where the mask is set, b elsewhere */
+    static __m128 select(const __m128 mask, const __m128 a, const __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+#endif // AFFDEX_SMOOTHING_SSE
+
+    const Filter mFilter;
+    std::vector<float> mAlpha;      // Parameters by metric, PADDED of each
+    std::vector<float> mMinCutoff;
+    std::vector<float> mBeta;
+    std::vector<float> mDCutoff;
+    std::vector<float> mIn;         // Scratch vectors of one face's metrics
+    std::vector<float> mOut;
+    mutable std::mutex mMutex;
+    std::map<affdex::FaceId, State> mFaces;
+    std::map<affdex::FaceId, double> mLost; // Faces reported lost, and when
+};
+
+/** @brief ReadSmoothingParams reads per-metric smoothing parameters from a file, '#' starts a comment
+ *     <metric or group> <name>=<value> ...
+ * for instance "angles minCutoff=0.5 beta=0.1" or "joy alpha=0.3".  A group is all, angles, emotions,
+ * expressions or emojis; the names are those of SmoothingParams, and later lines override earlier ones.
+ * @param path     -- The parameters file
+ * @param smoother -- Receives the parameters
+ * @param error    -- Receives what is wrong with the file when it can't be used
+ * @return false if the file can't be read or a line is not valid
+ */
+inline bool readSmoothingParams(const boost::filesystem::path &path, MetricSmoother &smoother, std::string &error)
+{
+    std::ifstream in(path.c_str());
+    if (!in.is_open())
+    {
+        error = "unable to read " + path.string();
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(in, line))
+    {
+        lineNumber++;
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        std::string target;
+        if (!(fields >> target)) continue;
+        const std::string where = path.string() + ":" + std::to_string(lineNumber) + ": ";
+
+        size_t first = 0, count = 1;
+        if (target == "all") count = MetricBatch::NUM_METRICS;
+        else if (target == "angles") first = MetricBatch::FIRST_ANGLE, count = MetricBatch::NUM_ANGLES;
+        else if (target == "emotions") first = MetricBatch::FIRST_EMOTION, count = MetricBatch::NUM_EMOTIONS;
+        else if (target == "expressions") first = MetricBatch::FIRST_EXPRESSION, count = MetricBatch::NUM_EXPRESSIONS;
+        else if (target == "emojis") first = MetricBatch::FIRST_EMOJI, count = MetricBatch::NUM_EMOJIS;
+        else if (MetricBatch::metricIndex(target) >= 0) first = MetricBatch::metricIndex(target);
+        else
+        {
+            error = where + "unknown metric " + target;
+            return false;
+        }
+
+        std::vector<std::pair<std::string, float> > values;
+        std::string field;
+        while (fields >> field)
+        {
+            const size_t equals = field.find('=');
+            std::istringstream number(equals == std::string::npos ? "" : field.substr(equals + 1));
+            float value;
+            if (!(number >> value) || !number.eof())
+            {
+                error = where + "expected <name>=<value>, got " + field;
+                return false;
+            }
+            const std::string name = field.substr(0, equals);
+            const bool valid = name == "alpha" ? value > 0 && value <= 1 : value >= 0;
+            if ((name != "alpha" && name != "minCutoff" && name != "beta" && name != "dCutoff") || !valid)
+            {
+                error = where + "invalid parameter " + field;
+                return false;
+            }
+            values.push_back(std::make_pair(name, value));
+        }
+        if (values.empty())
+        {
+            error = where + "expected <metric or group> <name>=<value> ...";
+            return false;
+        }
+
+        for (size_t m = first; m < first + count; m++)
+        {
+            SmoothingParams params = smoother.params(m);
+            for (const auto &value : values)
+            {
+                if (value.first == "alpha") params.alpha = value.second;
+                else if (value.first == "minCutoff") params.minCutoff = value.second;
+                else if (value.first == "beta") params.beta = value.second;
+                else params.dCutoff = value.second;
+            }
+            smoother.setParams(m, params);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,183 @@
+#include "MetricsServer.h"
+
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#endif
+
+MetricsServer::MetricsServer(const PipelineMetrics &metrics, const std::string &endpoint)
+    : mMetrics(metrics), mEndpoint(endpoint), mSocket(-1), mRunning(false)
+{
+}
+
+MetricsServer::~MetricsServer()
+{
+    stop();
+}
+
+#ifdef _WIN32
+
+bool MetricsServer::start()
+{
+    mError = "The metrics endpoint is not supported on Windows";
+    return false;
+}
+
+void MetricsServer::stop()
+{
+}
+
+void MetricsServer::serve()
+{
+}
+
+void MetricsServer::handle(int client)
+{
+}
+
+#else // _WIN32
+
+bool MetricsServer::start()
+{
+    const std::string unix_prefix = "unix:";
+    if (mEndpoint.compare(0, unix_prefix.size(), unix_prefix) == 0)
+    {
+        mUnixPath = mEndpoint.substr(unix_prefix.size());
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (mUnixPath.empty() || mUnixPath.size() >= sizeof(addr.sun_path))
+        {
+            mError = "Invalid unix socket path: " + mUnixPath;
+            return false;
+        }
+        std::strncpy(addr.sun_path, mUnixPath.c_str(), sizeof(addr.sun_path) - 1);
+        ::unlink(mUnixPath.c_str());
+        mSocket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (mSocket < 0 || ::bind(mSocket, (sockaddr *)&addr, sizeof(addr)) != 0)
+        {
+            mError = "Unable to bind " + mEndpoint + ": " + std::strerror(errno);
+            stop();
+            return false;
+        }
+    }
+    else
+    {
+        std::string host = "127.0.0.1";
+        std::string port = mEndpoint;
+        const size_t colon = mEndpoint.rfind(':');
+        if (colon != std::string::npos)
+        {
+            host = mEndpoint.substr(0, colon);
+            port = mEndpoint.substr(colon + 1);
+        }
+        sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)std::atoi(port.c_str()));
+        if (host == "localhost") host = "127.0.0.1";
+        if (::inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 || addr.sin_port == 0)
+        {
+            mError = "Invalid metrics endpoint: " + mEndpoint;
+            return false;
+        }
+        // The endpoint is for local scrapers only, it has no authentication
+        if ((ntohl(addr.sin_addr.s_addr) >> 24) != 127)
+        {
+            mError = "The metrics endpoint must be on a loopback address (127.x.x.x or localhost): " + mEndpoint;
+            return false;
+        }
+        mSocket = ::socket(AF_INET, SOCK_STREAM, 0);
+        const int reuse = 1;
+        if (mSocket >= 0) ::setsockopt(mSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (mSocket < 0 || ::bind(mSocket, (sockaddr *)&addr, sizeof(addr)) != 0)
+        {
+            mError = "Unable to bind " + mEndpoint + ": " + std::strerror(errno);
+            stop();
+            return false;
+        }
+    }
+
+    if (::listen(mSocket, 8) != 0)
+    {
+        mError = "Unable to listen on " + mEndpoint + ": " + std::strerror(errno);
+        stop();
+        return false;
+    }
+
+    mRunning = true;
+    mThread = std::thread(&MetricsServer::serve, this);
+    return true;
+}
+
+void MetricsServer::stop()
+{
+    mRunning = false;
+    if (mThread.joinable()) mThread.join();
+    if (mSocket >= 0)
+    {
+        ::close(mSocket);
+        mSocket = -1;
+        if (!mUnixPath.empty()) ::unlink(mUnixPath.c_str());
+    }
+}
+
+void MetricsServer::serve()
+{
+    while (mRunning)
+    {
+        // Wake up periodically so stop() doesn't have to wait for a client
+        pollfd pfd = { mSocket, POLLIN, 0 };
+        if (::poll(&pfd, 1, 250) <= 0) continue;
+
+        const int client = ::accept(mSocket, nullptr, nullptr);
+        if (client < 0) continue;
+        handle(client);
+        ::close(client);
+    }
+}
+
+void MetricsServer::handle(int client)
+{
+    // Only the request line matters, anything that isn't a GET for / or /metrics is a 404
+    char request[1024];
+    pollfd pfd = { client, POLLIN, 0 };
+    if (::poll(&pfd, 1, 1000) <= 0) return;
+    const ssize_t n = ::recv(client, request, sizeof(request) - 1, 0);
+    if (n <= 0) return;
+    request[n] = '\0';
+
+    std::string status = "200 OK";
+    std::string body;
+    if (std::strncmp(request, "GET /metrics", 12) == 0 || std::strncmp(request, "GET / ", 6) == 0)
+    {
+        body = mMetrics.render();
+    }
+    else
+    {
+        status = "404 Not Found";
+        body = "Not found\n";
+    }
+
+    const std::string response = "HTTP/1.0 " + status + "\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " + std::to_string(body.size()) + "\r\n"
+        "Connection: close\r\n\r\n" + body;
+
+    size_t sent = 0;
+    while (sent < response.size())
+    {
+        const ssize_t w = ::send(client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (w <= 0) break;
+        sent += w;
+    }
+}
+
+#endif // _WIN32
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include "PipelineMetrics.hpp"
+
+/** @brief Minimal HTTP endpoint serving PipelineMetrics in the Prometheus text format
+ * Binds to a loopback TCP port ("9100", "127.0.0.1:9100") or a UNIX domain socket ("unix:/tmp/affdex.sock").
+ * Requests are answered on a single background thread; the metrics themselves are read with relaxed atomic
+ * loads so the pipeline never waits on a scrape.  Not available on Windows (start() returns false).
+ */
+class MetricsServer
+{
+public:
+
+    /** @brief MetricsServer
+     * @param metrics  -- The metrics to serve, must outlive the server
+     * @param endpoint -- [host:]port with a loopback host, or unix:/path/to/socket
+     */
+    MetricsServer(const PipelineMetrics &metrics, const std::string &endpoint);
+
+    ~MetricsServer();
+
+    /** @brief Bind the endpoint and start serving
+     * @return false if the endpoint could not be bound, see getError()
+     */
+    bool start();
+
+    /** @brief Stop serving and release the socket
+     */
+    void stop();
+
+    const std::string& getError() const { return mError; }
+
+private:
+
+    void serve();
+    void handle(int client);
+
+    const PipelineMetrics &mMetrics;
+    const std::string mEndpoint;
+    std::string mError;
+    std::string mUnixPath;
+    int mSocket;
+    std::atomic<bool> mRunning;
+    std::thread mThread;
+};
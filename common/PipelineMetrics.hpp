@@ -0,0 +1,166 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <sstream>
+#include <string>
+
+/** @brief Monotonically increasing counter, safe to bump from any thread without locking
+ */
+class MetricCounter
+{
+public:
+
+    MetricCounter() : mValue(0) {}
+
+    void inc(const uint64_t n = 1) { mValue.fetch_add(n, std::memory_order_relaxed); }
+
+    uint64_t value() const { return mValue.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> mValue;
+};
+
+/** @brief Point-in-time value (queue depth, faces in view ..), safe to set from any thread
+ */
+class MetricGauge
+{
+public:
+
+    MetricGauge() : mValue(0) {}
+
+    void set(const int64_t v) { mValue.store(v, std::memory_order_relaxed); }
+
+    int64_t value() const { return mValue.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> mValue;
+};
+
+/** @brief Latency histogram over fixed buckets (in seconds)
+ * Each observation is a handful of relaxed atomic increments, the buckets are only made
+ * cumulative when rendered.
+ */
+class MetricHistogram
+{
+public:
+
+    static const int NUM_BUCKETS = 12;
+
+    MetricHistogram() : mCount(0), mSumMicros(0)
+    {
+        for (int i = 0; i <= NUM_BUCKETS; i++) mBuckets[i].store(0);
+    }
+
+    /** @brief Record a duration
+     * @param seconds -- The observed duration
+     */
+    void observe(const double seconds)
+    {
+        int i = 0;
+        while (i < NUM_BUCKETS && seconds > bounds()[i]) i++;
+        mBuckets[i].fetch_add(1, std::memory_order_relaxed);
+        mCount.fetch_add(1, std::memory_order_relaxed);
+        mSumMicros.fetch_add(seconds > 0 ? (uint64_t)(seconds * 1e6) : 0, std::memory_order_relaxed);
+    }
+
+    /** @brief Write the histogram in the Prometheus text exposition format
+     * @param os     -- Output stream
+     * @param name   -- Metric family name
+     * @param labels -- Label set for this series, e.g. stage="draw" (may be empty)
+     */
+    void render(std::ostream &os, const std::string &name, const std::string &labels) const
+    {
+        const std::string sep = labels.empty() ? "" : ",";
+        uint64_t cumulative = 0;
+        for (int i = 0; i < NUM_BUCKETS; i++)
+        {
+            cumulative += mBuckets[i].load(std::memory_order_relaxed);
+            os << name << "_bucket{" << labels << sep << "le=\"" << bounds()[i] << "\"} " << cumulative << "\n";
+        }
+        cumulative += mBuckets[NUM_BUCKETS].load(std::memory_order_relaxed);
+        os << name << "_bucket{" << labels << sep << "le=\"+Inf\"} " << cumulative << "\n";
+        os << name << "_sum{" << labels << "} " << mSumMicros.load(std::memory_order_relaxed) / 1e6 << "\n";
+        os << name << "_count{" << labels << "} " << mCount.load(std::memory_order_relaxed) << "\n";
+    }
+
+private:
+
+    static const double * bounds()
+    {
+        static const double b[NUM_BUCKETS] = { 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025,
+                                               0.05, 0.1, 0.25, 0.5, 1.0, 2.5 };
+        return b;
+    }
+
+    std::atomic<uint64_t> mBuckets[NUM_BUCKETS + 1];
+    std::atomic<uint64_t> mCount;
+    std::atomic<uint64_t> mSumMicros;
+};
+
+/** @brief Counters and histograms describing the sample pipelines
+ * The listener and the demo loops update these from the hot path; MetricsServer renders them.
+ */
+class PipelineMetrics
+{
+public:
+
+    MetricCounter framesCaptured;    // onImageCapture callbacks
+    MetricCounter framesProcessed;   // onImageResults callbacks
+    MetricCounter framesDropped;     // Captured frames that never produced results
+    MetricCounter facesFound;        // Total number of faces reported across all results
+    MetricGauge facesTracked;        // Faces in the most recent result
+    MetricGauge queueDepth;          // Results waiting in the listener queue
+    MetricCounter csvBytesWritten;
+    MetricGauge decodeQueueDepth;    // Decoded frames waiting for the detector (--pipeline)
+    MetricGauge sinkQueueDepth;      // Results waiting for the busiest sink thread (--pipeline)
+    MetricCounter sinkDropped;       // Results a lossy sink (the display) skipped to keep up
+    MetricGauge submitFrameRate;     // Frames per second the webcam rate controller lets through
+
+    MetricHistogram queueLatency;    // Time a result spent in the listener queue
+    MetricHistogram resultLatency;   // Capture to result, only when frame timestamps are wall-clock
+    MetricHistogram drawLatency;
+    MetricHistogram csvLatency;
+
+    /** @brief Render all metrics in the Prometheus text exposition format (version 0.0.4)
+     */
+    std::string render() const
+    {
+        std::ostringstream os;
+        counter(os, "affdex_frames_captured_total", "Frames handed to the detector.", framesCaptured);
+        counter(os, "affdex_frames_processed_total", "Frames the detector returned results for.", framesProcessed);
+        counter(os, "affdex_frames_dropped_total", "Captured frames that were skipped by the detector.", framesDropped);
+        counter(os, "affdex_faces_found_total", "Faces reported across all processed frames.", facesFound);
+        gauge(os, "affdex_faces_tracked", "Faces in the most recent processed frame.", facesTracked);
+        gauge(os, "affdex_result_queue_depth", "Results waiting to be consumed from the listener.", queueDepth);
+        counter(os, "affdex_csv_bytes_written_total", "Bytes written to the csv output.", csvBytesWritten);
+        os << "# HELP affdex_pipeline_queue_depth Items waiting between the stages of --pipeline.\n";
+        os << "# TYPE affdex_pipeline_queue_depth gauge\n";
+        os << "affdex_pipeline_queue_depth{queue=\"decode\"} " << decodeQueueDepth.value() << "\n";
+        os << "affdex_pipeline_queue_depth{queue=\"sink\"} " << sinkQueueDepth.value() << "\n";
+        counter(os, "affdex_sink_dropped_total", "Results skipped by lossy sinks that fell behind.", sinkDropped);
+        gauge(os, "affdex_submit_frame_rate", "Frames per second submitted to the detector by the rate controller.", submitFrameRate);
+
+        os << "# HELP affdex_stage_latency_seconds Per-stage latency of the sample pipeline.\n";
+        os << "# TYPE affdex_stage_latency_seconds histogram\n";
+        queueLatency.render(os, "affdex_stage_latency_seconds", "stage=\"queue\"");
+        resultLatency.render(os, "affdex_stage_latency_seconds", "stage=\"detect\"");
+        drawLatency.render(os, "affdex_stage_latency_seconds", "stage=\"draw\"");
+        csvLatency.render(os, "affdex_stage_latency_seconds", "stage=\"csv\"");
+        return os.str();
+    }
+
+private:
+
+    static void counter(std::ostream &os, const char *name, const char *help, const MetricCounter &c)
+    {
+        os << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n"
+           << name << " " << c.value() << "\n";
+    }
+
+    static void gauge(std::ostream &os, const char *name, const char *help, const MetricGauge &g)
+    {
+        os << "# HELP " << name << " " << help << "\n# TYPE " << name << " gauge\n"
+           << name << " " << g.value() << "\n";
+    }
+};
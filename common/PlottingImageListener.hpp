@@ -6,12 +6,18 @@
 #include <chrono>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <boost/filesystem.hpp>
 #include <boost/timer/timer.hpp>
 
 #include "Visualizer.h"
 #include "ImageListener.h"
+#include "PipelineMetrics.hpp"
+#include "CsvRowBuffer.hpp"
+#include "FaceTrackStore.hpp"
+#include "MetricBatch.hpp"
 
 using namespace affdex;
 
@@ -19,13 +25,21 @@ class PlottingImageListener : public ImageListener
 {
 
     std::mutex mMutex;
+    std::condition_variable mDataCV;
     std::deque<std::pair<Frame, std::map<FaceId, Face> > > mDataArray;
+    std::deque<std::chrono::steady_clock::time_point> mEnqueueTimes;
+    std::deque<float> mPendingCaptures;
+    PipelineMetrics *mMetrics;
+    FaceTrackStore *mTracks;
+    int mSparklineMetric;
 
     double mCaptureLastTS;
     double mCaptureFPS;
     double mProcessLastTS;
     double mProcessFPS;
-    std::ofstream &fStream;
+    std::ostream *fStream;
+    CsvRowBuffer mRowBuffer;    // The rows of an outputToFile call, written to fStream in one go
+    std::ostream mRows;
     std::chrono::time_point<std::chrono::system_clock> mStartT;
     const bool mDrawDisplay;
     const int spacing = 20;
@@ -37,45 +51,82 @@ public:
 
 
     PlottingImageListener(std::ofstream &csv, const bool draw_display)
-        : fStream(csv), mDrawDisplay(draw_display), mStartT(std::chrono::system_clock::now()),
+        : fStream(&csv), mDrawDisplay(draw_display), mStartT(std::chrono::system_clock::now()),
         mCaptureLastTS(-1.0f), mCaptureFPS(-1.0f),
-        mProcessLastTS(-1.0f), mProcessFPS(-1.0f)
+        mProcessLastTS(-1.0f), mProcessFPS(-1.0f), mMetrics(nullptr), mTracks(nullptr), mSparklineMetric(-1),
+        mRows(&mRowBuffer)
     {
+        mRows.precision(4);
+        mRows << std::fixed;
+        writeHeader();
+    }
 
-        fStream << "TimeStamp,faceId,interocularDistance,glasses,age,ethnicity,gender,dominantEmoji,";
-        for (std::string angle : viz.HEAD_ANGLES) fStream << angle << ",";
-        for (std::string emotion : viz.EMOTIONS) fStream << emotion << ",";
-        for (std::string expression : viz.EXPRESSIONS) fStream << expression << ",";
-        for (std::string emoji : viz.EMOJIS) fStream << emoji << ",";
-        fStream << std::endl;
-        fStream.precision(4);
-        fStream << std::fixed;
+    /** @brief PlottingImageListener without an output file yet, call setOutputStream before outputToFile
+    */
+    explicit PlottingImageListener(const bool draw_display)
+        : fStream(nullptr), mDrawDisplay(draw_display), mStartT(std::chrono::system_clock::now()),
+        mCaptureLastTS(-1.0f), mCaptureFPS(-1.0f),
+        mProcessLastTS(-1.0f), mProcessFPS(-1.0f), mMetrics(nullptr), mTracks(nullptr), mSparklineMetric(-1),
+        mRows(&mRowBuffer)
+    {
+        mRows.precision(4);
+        mRows << std::fixed;
     }
 
-    cv::Point2f minPoint(VecFeaturePoint points)
+    /** @brief SetOutputStream redirects outputToFile to another csv (writing its header) and resets
+    * the listener so it can be reused for the next input
+    * @param csv  -- The new output stream, must outlive its use by the listener
+    */
+    void setOutputStream(std::ostream &csv)
     {
-        VecFeaturePoint::iterator it = points.begin();
-        FeaturePoint ret = *it;
-        for (; it != points.end(); it++)
-        {
-            if (it->x < ret.x) ret.x = it->x;
-            if (it->y < ret.y) ret.y = it->y;
-        }
-        return cv::Point2f(ret.x, ret.y);
-    };
+        reset();
+        fStream = &csv;
+        writeHeader();
+    }
 
-    cv::Point2f maxPoint(VecFeaturePoint points)
+    /** @brief Reset drops queued results and the frame rate estimates
+    */
+    void reset()
     {
-        VecFeaturePoint::iterator it = points.begin();
-        FeaturePoint ret = *it;
-        for (; it != points.end(); it++)
-        {
-            if (it->x > ret.x) ret.x = it->x;
-            if (it->y > ret.y) ret.y = it->y;
-        }
-        return cv::Point2f(ret.x, ret.y);
-    };
+        std::lock_guard<std::mutex> lg(mMutex);
+        mDataArray.clear();
+        mEnqueueTimes.clear();
+        mPendingCaptures.clear();
+        mCaptureLastTS = mCaptureFPS = mProcessLastTS = mProcessFPS = -1.0f;
+        mStartT = std::chrono::system_clock::now();
+        if (mMetrics) mMetrics->queueDepth.set(0);
+    }
+
+    /** @brief WaitForData blocks until a result is queued or the timeout expires
+    * @param timeout  -- Longest time to wait
+    * @return true if results are waiting
+    */
+    bool waitForData(const std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        return mDataCV.wait_for(lock, timeout, [this]() { return !mDataArray.empty(); });
+    }
 
+    /** @brief SetMetrics enables pipeline instrumentation
+    * @param metrics  -- Counters to update, or nullptr to disable (must outlive the listener)
+    */
+    void setMetrics(PipelineMetrics *metrics)
+    {
+        std::lock_guard<std::mutex> lg(mMutex);
+        mMetrics = metrics;
+    }
+
+    /** @brief SetTrackStore sets the FaceTrackStore draw() reads the sparklines from
+    * The caller adds the results to the store, once they are smoothed.
+    * @param tracks           -- The store, or nullptr to disable (must outlive the listener)
+    * @param sparklineMetric  -- Metric whose history draw() plots under each face, -1 for none
+    */
+    void setTrackStore(FaceTrackStore *tracks, const int sparklineMetric = -1)
+    {
+        std::lock_guard<std::mutex> lg(mMutex);
+        mTracks = tracks;
+        mSparklineMetric = tracks ? sparklineMetric : -1;
+    }
 
     double getProcessingFrameRate()
     {
@@ -89,6 +140,13 @@ public:
         return mCaptureFPS;
     }
 
+    /** @brief Timestamp of the last frame the detector took, -1 before any */
+    double getLastCaptureTimestamp()
+    {
+        std::lock_guard<std::mutex> lg(mMutex);
+        return mCaptureLastTS;
+    }
+
     int getDataSize()
     {
         std::lock_guard<std::mutex> lg(mMutex);
@@ -101,6 +159,13 @@ public:
         std::lock_guard<std::mutex> lg(mMutex);
         std::pair<Frame, std::map<FaceId, Face>> dpoint = mDataArray.front();
         mDataArray.pop_front();
+        if (mMetrics)
+        {
+            mMetrics->queueLatency.observe(std::chrono::duration<double>(
+                std::chrono::steady_clock::now() - mEnqueueTimes.front()).count());
+            mMetrics->queueDepth.set(mDataArray.size());
+        }
+        mEnqueueTimes.pop_front();
         return dpoint;
     }
 
@@ -113,6 +178,25 @@ public:
         double seconds = milliseconds.count() / 1000.f;
         mProcessFPS = 1.0f / (seconds - mProcessLastTS);
         mProcessLastTS = seconds;
+        mEnqueueTimes.push_back(std::chrono::steady_clock::now());
+
+        if (mMetrics)
+        {
+            // Frames come back in capture order, anything captured before this one that is still pending was skipped
+            const float timestamp = image.getTimestamp();
+            while (!mPendingCaptures.empty() && mPendingCaptures.front() < timestamp)
+            {
+                mPendingCaptures.pop_front();
+                mMetrics->framesDropped.inc();
+            }
+            if (!mPendingCaptures.empty() && mPendingCaptures.front() == timestamp) mPendingCaptures.pop_front();
+
+            mMetrics->framesProcessed.inc();
+            mMetrics->facesFound.inc(faces.size());
+            mMetrics->facesTracked.set(faces.size());
+            mMetrics->queueDepth.set(mDataArray.size());
+        }
+        mDataCV.notify_one();
     };
 
     void onImageCapture(Frame image) override
@@ -120,115 +204,158 @@ public:
         std::lock_guard<std::mutex> lg(mMutex);
         mCaptureFPS = 1.0f / (image.getTimestamp() - mCaptureLastTS);
         mCaptureLastTS = image.getTimestamp();
-    };
-
-    void outputToFile(const std::map<FaceId, Face> faces, const double timeStamp)
-    {
-        if (faces.empty())
+        if (mMetrics)
         {
-            fStream << timeStamp << ",nan,nan,no,unknown,unknown,unknown,unknown,";
-            for (std::string angle : viz.HEAD_ANGLES) fStream << "nan,";
-            for (std::string emotion : viz.EMOTIONS) fStream << "nan,";
-            for (std::string expression : viz.EXPRESSIONS) fStream << "nan,";
-            for (std::string emoji : viz.EMOJIS) fStream << "nan,";
-            fStream << std::endl;
+            mMetrics->framesCaptured.inc();
+            mPendingCaptures.push_back(image.getTimestamp());
         }
-        for (auto & face_id_pair : faces)
-        {
-            Face f = face_id_pair.second;
-
-            fStream << timeStamp << ","
-                << f.id << ","
-                << f.measurements.interocularDistance << ","
-                << viz.GLASSES_MAP[f.appearance.glasses] << ","
-                << viz.AGE_MAP[f.appearance.age] << ","
-                << viz.ETHNICITY_MAP[f.appearance.ethnicity] << ","
-                << viz.GENDER_MAP[f.appearance.gender] << ","
-                << affdex::EmojiToString(f.emojis.dominantEmoji) << ",";
-
-            float *values = (float *)&f.measurements.orientation;
-            for (std::string angle : viz.HEAD_ANGLES)
-            {
-                fStream << (*values) << ",";
-                values++;
-            }
+    };
 
-            values = (float *)&f.emotions;
-            for (std::string emotion : viz.EMOTIONS)
-            {
-                fStream << (*values) << ",";
-                values++;
-            }
+    void writeHeader()
+    {
+        *fStream << "TimeStamp,faceId,interocularDistance,glasses,age,ethnicity,gender,dominantEmoji,";
+        for (std::string angle : viz.HEAD_ANGLES) *fStream << angle << ",";
+        for (std::string emotion : viz.EMOTIONS) *fStream << emotion << ",";
+        for (std::string expression : viz.EXPRESSIONS) *fStream << expression << ",";
+        for (std::string emoji : viz.EMOJIS) *fStream << emoji << ",";
+        *fStream << std::endl;
+        fStream->precision(4);
+        *fStream << std::fixed;
+    }
 
-            values = (float *)&f.expressions;
-            for (std::string expression : viz.EXPRESSIONS)
-            {
-                fStream << (*values) << ",";
-                values++;
-            }
+    /** @brief OutputToFile writes the results of a frame, converting them to a MetricBatch first
+    */
+    void outputToFile(const std::map<FaceId, Face> faces, const double timeStamp)
+    {
+        mCsvRows.clear();
+        mCsvRows.append(timeStamp, faces);
+        outputToFile(mCsvRows);
+    }
 
-            values = (float *)&f.emojis;
-            for (std::string emoji : viz.EMOJIS)
-            {
-                fStream << (*values) << ",";
-                values++;
-            }
+    /** @brief OutputToFile writes every row of a batch to the csv
+    * @param rows  -- The results, a row without a face gives a row of nan
+    */
+    void outputToFile(const MetricBatch &rows)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        for (size_t row = 0; row < rows.rows(); row++) outputRow(rows, row);
+        const size_t bytes = mRowBuffer.writeTo(*fStream);
+        fStream->flush();
 
-            fStream << std::endl;
+        std::lock_guard<std::mutex> lg(mMutex);
+        if (mMetrics)
+        {
+            mMetrics->csvBytesWritten.inc(bytes);
+            mMetrics->csvLatency.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
         }
     }
 
-    std::vector<cv::Point2f> CalculateBoundingBox(VecFeaturePoint points)
+    /** @brief CalculateBoundingBox finds the box around a face's landmarks (see computeBoundingBox)
+     */
+    BoundingBox CalculateBoundingBox(const VecFeaturePoint &points) const
     {
+        return computeBoundingBox(points);
+    }
 
-        std::vector<cv::Point2f> ret;
+    void draw(const std::map<FaceId, Face> faces, Frame image)
+    {
+        mDrawRows.clear();
+        mDrawRows.append(image.getTimestamp(), faces);
+        draw(mDrawRows, image);
+    }
 
-        //Top Left
-        ret.push_back(minPoint(points));
+    /** @brief Draw shows the frame with the face metrics of a batch holding its results
+    */
+    void draw(const MetricBatch &rows, Frame image)
+    {
 
-        //Bottom Right
-        ret.push_back(maxPoint(points));
+        const auto start = std::chrono::steady_clock::now();
 
-        //Top Right
-        ret.push_back(cv::Point2f(ret[1].x,
-                                  ret[0].y));
-        //Bottom Left
-        ret.push_back(cv::Point2f(ret[0].x,
-                                  ret[1].y));
+        std::shared_ptr<unsigned char> imgdata = image.getBGRByteArray();
+        cv::Mat img = cv::Mat(image.getHeight(), image.getWidth(), CV_8UC3, imgdata.get());
+        annotate(rows, img);
 
-        return ret;
+        viz.showImage();
+        std::lock_guard<std::mutex> lg(mMutex);
+        if (mMetrics)
+        {
+            mMetrics->drawLatency.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        }
     }
 
-    void draw(const std::map<FaceId, Face> faces, Frame image)
+    /** @brief Render draws the face metrics like draw, on a copy of the frame instead of on screen
+     * @param faces -- The faces to draw
+     * @param image -- The frame they were found in
+     * @return the annotated copy
+     */
+    cv::Mat render(const std::map<FaceId, Face> &faces, Frame image)
     {
+        mDrawRows.clear();
+        mDrawRows.append(image.getTimestamp(), faces);
+        std::shared_ptr<unsigned char> imgdata = image.getBGRByteArray();
+        cv::Mat img = cv::Mat(image.getHeight(), image.getWidth(), CV_8UC3, imgdata.get()).clone();
+        annotate(mDrawRows, img);
+        return img;
+    }
 
-        const int left_margin = 30;
+private:
 
-        cv::Scalar clr = cv::Scalar(0, 0, 255);
-        cv::Scalar header_clr = cv::Scalar(255, 0, 0);
+    /** @brief OutputRow formats one row of a batch into the row buffer
+    */
+    void outputRow(const MetricBatch &rows, const size_t row)
+    {
+        if (!rows.hasFace(row))
+        {
+            mRows << rows.timestamp(row) << ",nan,nan,no,unknown,unknown,unknown,unknown,";
+            for (size_t m = 0; m < MetricBatch::NUM_METRICS; m++) mRows << "nan,";
+            mRows << "\n";
+            return;
+        }
 
-        std::shared_ptr<unsigned char> imgdata = image.getBGRByteArray();
-        cv::Mat img = cv::Mat(image.getHeight(), image.getWidth(), CV_8UC3, imgdata.get());
+        const Appearance &appearance = rows.appearance(row);
+        mRows << rows.timestamp(row) << ","
+            << rows.faceId(row) << ","
+            << rows.interocularDistance(row) << ","
+            << viz.GLASSES_MAP[appearance.glasses] << ","
+            << viz.AGE_MAP[appearance.age] << ","
+            << viz.ETHNICITY_MAP[appearance.ethnicity] << ","
+            << viz.GENDER_MAP[appearance.gender] << ","
+            << affdex::EmojiToString(rows.dominantEmoji(row)) << ",";
+
+        // The head angles, emotions, expressions and emojis, in the order of the header
+        for (size_t m = 0; m < MetricBatch::NUM_METRICS; m++) mRows << rows.value(m, row) << ",";
+        mRows << "\n";
+    }
+
+    void annotate(const MetricBatch &rows, cv::Mat img)
+    {
         viz.updateImage(img);
 
-        for (auto & face_id_pair : faces)
+        for (size_t row = 0; row < rows.rows(); row++)
         {
-            Face f = face_id_pair.second;
-            VecFeaturePoint points = f.featurePoints;
-            std::vector<cv::Point2f> bounding_box = CalculateBoundingBox(points);
-
-            // Draw Facial Landmarks Points
-            //viz.drawPoints(points);
+            if (!rows.hasFace(row)) continue;
+            const BoundingBox &bounding_box = rows.boundingBox(row);
 
             // Draw bounding box
-            viz.drawBoundingBox(bounding_box[0], bounding_box[1], f.emotions.valence);
+            viz.drawBoundingBox(bounding_box, rows.value(VALENCE, row));
 
             // Draw a face on screen
-            viz.drawFaceMetrics(f, bounding_box);
-        }
+            viz.drawFaceMetrics(rows, row, bounding_box);
 
-        viz.showImage();
-        std::lock_guard<std::mutex> lg(mMutex);
+            // Draw the recent history of a metric under the face
+            if (mSparklineMetric >= 0)
+            {
+                const auto lock = mTracks->lock();
+                const FaceTrack *track = mTracks->find(rows.faceId(row));
+                const cv::Rect area((int)bounding_box.left, (int)bounding_box.bottom + 10,
+                                    std::max(60, (int)bounding_box.width()), 40);
+                if (track) viz.drawSparkline(*track, mSparklineMetric, mTracks->metricNames()[mSparklineMetric], area);
+            }
+        }
     }
 
+    const size_t VALENCE = MetricBatch::metricIndex("valence");
+    MetricBatch mCsvRows;       // Scratch batches for the calls taking a map of faces
+    MetricBatch mDrawRows;
+
 };
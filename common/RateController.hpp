@@ -0,0 +1,150 @@
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <string>
+
+#include "PipelineMetrics.hpp"
+#include "Logger.h"
+
+/** @brief Adjusts the rate frames are submitted to a FrameDetector to hold a target result latency
+ * The capture loop asks shouldSubmit() for every captured frame and reports the frames it submits and the
+ * results it gets back, all stamped with the same clock as the frame timestamps.  Every UPDATE_PERIOD the
+ * controller looks at the smoothed latency (submission to result) and at the frames still in flight:
+ * above the target, or with more frames in flight than the rate covers in the target latency, it backs off
+ * multiplicatively; comfortably below the target it creeps back up one frame per second at a time.  The
+ * rate always stays within [minRate, maxRate].  Results arrive in timestamp order, so a result also accounts
+ * for every older submission the detector dropped instead of processing.
+ */
+class RateController
+{
+public:
+
+    /** @brief RateController
+     * @param targetLatency -- Latency to hold, in seconds
+     * @param minRate       -- Lowest submission rate, in frames per second
+     * @param maxRate       -- Highest submission rate, and the starting rate
+     * @param metrics       -- Gauge to publish the rate to, or nullptr (must outlive the controller)
+     * @param name          -- What the rate is for in the log, when there are several controllers
+     */
+    RateController(const double targetLatency, const double minRate, const double maxRate,
+                   PipelineMetrics *metrics = nullptr, const std::string &name = "")
+        : mTargetLatency(targetLatency), mMinRate(std::max(0.1, std::min(minRate, maxRate))),
+          mMaxRate(std::max(mMinRate, maxRate)), mRate(mMaxRate), mLatency(-1), mLastSubmit(-1),
+          mLastUpdate(-1), mMetrics(metrics), mName(name)
+    {
+        publish();
+    }
+
+    /** @brief ShouldSubmit tells whether a frame captured at this time should go to the detector
+     * @param timestamp -- Capture time in seconds
+     */
+    bool shouldSubmit(const double timestamp) const
+    {
+        // Allow a little jitter so that a camera running at exactly the rate isn't halved
+        return mLastSubmit < 0 || timestamp - mLastSubmit >= JITTER / mRate;
+    }
+
+    /** @brief DetectorFrameRate is the processing framerate for the FrameDetector the controller submits to
+     * Submissions may come a little closer than 1 / maxRate, the detector must not skip them.
+     * @param maxRate -- Highest submission rate, as given to the controller
+     */
+    static float detectorFrameRate(const double maxRate)
+    {
+        return (float)(maxRate / JITTER);
+    }
+
+    /** @brief OnSubmit records a frame handed to the detector
+     * @param timestamp -- The frame's timestamp
+     */
+    void onSubmit(const double timestamp)
+    {
+        mLastSubmit = timestamp;
+        mInFlight.push_back(timestamp);
+        update(timestamp);
+    }
+
+    /** @brief OnResult records the results of a frame
+     * @param timestamp -- The frame's timestamp
+     * @param now       -- Time the results were received
+     */
+    void onResult(const double timestamp, const double now)
+    {
+        while (!mInFlight.empty() && mInFlight.front() <= timestamp) mInFlight.pop_front();
+        const double latency = now - timestamp;
+        mLatency = mLatency < 0 ? latency : mLatency + SMOOTHING * (latency - mLatency);
+        update(now);
+    }
+
+    /** @brief Current submission rate in frames per second */
+    double rate() const { return mRate; }
+
+    /** @brief Smoothed latency in seconds, negative until the first result */
+    double latency() const { return mLatency; }
+
+    /** @brief Frames submitted that have no results yet */
+    size_t inFlight() const { return mInFlight.size(); }
+
+private:
+
+    static constexpr double JITTER = 0.9;   // Fraction of the interval a submission may come early
+
+    const double UPDATE_PERIOD = 0.5;   // Seconds between rate decisions
+    const double SMOOTHING = 0.2;       // Weight of the newest latency sample
+    const double DECREASE = 0.75;       // Multiplier when backing off
+    const double INCREASE = 1.0;        // Frames per second added when there is headroom
+    const double HEADROOM = 0.8;        // Fraction of the target under which the rate goes up
+
+    void update(const double now)
+    {
+        if (mLastUpdate < 0) mLastUpdate = now;
+        if (now - mLastUpdate < UPDATE_PERIOD || mLatency < 0) return;
+        mLastUpdate = now;
+
+        // A frame still waiting after the target latency is already late even if its result isn't in yet
+        const double oldest = mInFlight.empty() ? 0 : now - mInFlight.front();
+        const double latency = std::max(mLatency, oldest);
+        const size_t backlog = (size_t)(mRate * mTargetLatency) + 1;
+
+        double rate = mRate;
+        const char *reason = nullptr;
+        if (latency > mTargetLatency)
+        {
+            rate = std::max(mMinRate, mRate * DECREASE);
+            reason = "latency above target";
+        }
+        else if (mInFlight.size() > backlog)
+        {
+            rate = std::max(mMinRate, mRate * DECREASE);
+            reason = "detector falling behind";
+        }
+        else if (latency < mTargetLatency * HEADROOM)
+        {
+            rate = std::min(mMaxRate, mRate + INCREASE);
+            reason = "latency below target";
+        }
+        if (rate == mRate) return;
+
+        LOG(LogLevel::Info) << "Rate controller" << (mName.empty() ? "" : " for " + mName) << ": " << reason
+            << " (" << latency * 1000 << " ms, target " << mTargetLatency * 1000 << " ms, " << mInFlight.size()
+            << " in flight), pfps " << mRate << " -> " << rate;
+        mRate = rate;
+        publish();
+    }
+
+    void publish()
+    {
+        if (mMetrics) mMetrics->submitFrameRate.set((int64_t)(mRate + 0.5));
+    }
+
+    const double mTargetLatency;
+    const double mMinRate;
+    const double mMaxRate;
+    double mRate;
+    double mLatency;
+    double mLastSubmit;
+    double mLastUpdate;
+    std::deque<double> mInFlight;
+    PipelineMetrics *mMetrics;
+    const std::string mName;
+};
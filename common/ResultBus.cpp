@@ -0,0 +1,238 @@
+#include "ResultBus.h"
+
+#include <chrono>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// The slots start on a cache line of their own, after the header
+static const size_t SLOTS_OFFSET = (sizeof(ResultBusHeader) + 63) / 64 * 64;
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "The result bus needs lock-free 64 bit atomics to share them between processes");
+
+ResultBusWriter::ResultBusWriter(const std::string &name, const size_t capacity)
+    : mName(name), mCapacity(capacity), mMemory(nullptr), mSize(0), mHeader(nullptr), mSlots(nullptr), mHead(0)
+{
+}
+
+ResultBusWriter::~ResultBusWriter()
+{
+    close();
+#ifndef _WIN32
+    if (mMemory)
+    {
+        ::munmap(mMemory, mSize);
+        ::shm_unlink(mName.c_str());
+    }
+#endif
+}
+
+void ResultBusWriter::publish(const MetricBatch &rows)
+{
+    if (!mHeader) return;
+    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    const uint64_t mask = mHeader->capacity - 1;
+    for (size_t row = 0; row < rows.rows(); row++)
+    {
+        ResultBusSlot &slot = mSlots[mHead & mask];
+        slot.sequence.store(2 * mHead + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        ResultBusRecord &record = slot.record;
+        const BoundingBox &box = rows.boundingBox(row);
+        record.timestamp = rows.timestamp(row);
+        record.publishedNs = now;
+        record.faceId = rows.faceId(row);
+        record.interocularDistance = rows.interocularDistance(row);
+        record.left = box.left;
+        record.top = box.top;
+        record.right = box.right;
+        record.bottom = box.bottom;
+        for (size_t metric = 0; metric < MetricBatch::NUM_METRICS; metric++)
+        {
+            record.metrics[metric] = rows.value(metric, row);
+        }
+
+        slot.sequence.store(2 * mHead + 2, std::memory_order_release);
+        mHead++;
+    }
+    mHeader->head.store(mHead, std::memory_order_release);
+}
+
+void ResultBusWriter::close()
+{
+    if (mHeader) mHeader->state.store(ResultBusHeader::CLOSED, std::memory_order_release);
+}
+
+ResultBusReader::ResultBusReader(const std::string &name)
+    : mName(name), mMemory(nullptr), mSize(0), mHeader(nullptr), mSlots(nullptr), mMask(0), mNext(0), mDropped(0)
+{
+}
+
+ResultBusReader::~ResultBusReader()
+{
+    unmap();
+}
+
+bool ResultBusReader::read(ResultBusRecord &record)
+{
+    if (!mHeader) return false;
+    for (;;)
+    {
+        const uint64_t head = mHeader->head.load(std::memory_order_acquire);
+        if (mNext >= head) return false;
+        if (head - mNext > mMask + 1)
+        {
+            mDropped += head - (mMask + 1) - mNext;
+            mNext = head - (mMask + 1);
+        }
+
+        // The copy is only good if the slot still holds the same record after it: the writer may have
+        // started on the record capacity later while it was being read
+        const ResultBusSlot &slot = mSlots[mNext & mMask];
+        const uint64_t sequence = 2 * mNext + 2;
+        mNext++;
+        if (slot.sequence.load(std::memory_order_acquire) == sequence)
+        {
+            std::memcpy(&record, &slot.record, sizeof(record));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) == sequence) return true;
+        }
+        mDropped++;
+    }
+}
+
+bool ResultBusReader::closed() const
+{
+    return mHeader && mHeader->state.load(std::memory_order_acquire) == ResultBusHeader::CLOSED;
+}
+
+#ifdef _WIN32
+
+bool ResultBusWriter::open()
+{
+    mError = "The result bus is not supported on Windows";
+    return false;
+}
+
+bool ResultBusReader::open()
+{
+    mError = "The result bus is not supported on Windows";
+    return false;
+}
+
+void ResultBusReader::unmap()
+{
+}
+
+#else // _WIN32
+
+bool ResultBusWriter::open()
+{
+    uint32_t capacity = 1;
+    while (capacity < mCapacity) capacity <<= 1;
+    mSize = SLOTS_OFFSET + capacity * sizeof(ResultBusSlot);
+
+    // A new object rather than the one a crashed run may have left, which readers could still have mapped
+    ::shm_unlink(mName.c_str());
+    const int fd = ::shm_open(mName.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        mError = "Unable to create " + mName + ": " + std::strerror(errno);
+        return false;
+    }
+    void *memory = MAP_FAILED;
+    if (::ftruncate(fd, mSize) == 0) memory = ::mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED)
+    {
+        mError = "Unable to map " + mName + ": " + std::strerror(errno);
+        ::close(fd);
+        ::shm_unlink(mName.c_str());
+        return false;
+    }
+    ::close(fd);
+    mMemory = memory;
+
+    // The memory comes zeroed: every sequence is 0, which no record has
+    mHeader = (ResultBusHeader *)mMemory;
+    mSlots = (ResultBusSlot *)((char *)mMemory + SLOTS_OFFSET);
+    mHeader->magic = ResultBusHeader::MAGIC;
+    mHeader->version = ResultBusHeader::VERSION;
+    mHeader->capacity = capacity;
+    mHeader->recordSize = sizeof(ResultBusRecord);
+    mHeader->numMetrics = MetricBatch::NUM_METRICS;
+    for (size_t metric = 0; metric < MetricBatch::NUM_METRICS; metric++)
+    {
+        std::strncpy(mHeader->metricNames[metric], MetricBatch::metricNames()[metric].c_str(), ResultBusHeader::NAME_SIZE - 1);
+    }
+    mHeader->head.store(0, std::memory_order_relaxed);
+    mHeader->state.store(ResultBusHeader::OPEN, std::memory_order_release);
+    return true;
+}
+
+bool ResultBusReader::open()
+{
+    unmap();
+    const int fd = ::shm_open(mName.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        mError = "Unable to open " + mName + ": " + std::strerror(errno);
+        return false;
+    }
+    struct stat st;
+    void *memory = MAP_FAILED;
+    if (::fstat(fd, &st) == 0 && (size_t)st.st_size >= SLOTS_OFFSET)
+    {
+        mSize = (size_t)st.st_size;
+        memory = ::mmap(nullptr, mSize, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (memory == MAP_FAILED)
+    {
+        mError = mName + " is still being created";
+        return false;
+    }
+    mMemory = memory;
+
+    const ResultBusHeader *header = (const ResultBusHeader *)mMemory;
+    if (header->state.load(std::memory_order_acquire) == ResultBusHeader::STARTING)
+    {
+        mError = mName + " is still being created";
+    }
+    else if (header->magic != ResultBusHeader::MAGIC || header->version != ResultBusHeader::VERSION
+             || header->recordSize != sizeof(ResultBusRecord) || header->numMetrics != MetricBatch::NUM_METRICS
+             || mSize < SLOTS_OFFSET + (size_t)header->capacity * sizeof(ResultBusSlot))
+    {
+        mError = mName + " is not a result bus of this version";
+    }
+    else
+    {
+        mHeader = header;
+        mSlots = (const ResultBusSlot *)((const char *)mMemory + SLOTS_OFFSET);
+        mMask = header->capacity - 1;
+        mMetricNames.assign(header->metricNames, header->metricNames + header->numMetrics);
+        const uint64_t head = header->head.load(std::memory_order_acquire);
+        mNext = head > header->capacity ? head - header->capacity : 0;
+        mDropped = 0;
+        return true;
+    }
+    unmap();
+    return false;
+}
+
+void ResultBusReader::unmap()
+{
+    if (mMemory) ::munmap((void *)mMemory, mSize);
+    mMemory = nullptr;
+    mHeader = nullptr;
+    mSlots = nullptr;
+}
+
+#endif // _WIN32
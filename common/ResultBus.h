@@ -0,0 +1,150 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MetricBatch.hpp"
+
+/** @brief One face of one frame on the result bus, the same layout in every process on the host
+ * A frame without faces is one record with faceId MetricBatch::NO_FACE and NaN metrics.
+ */
+struct ResultBusRecord
+{
+    double timestamp;                           // Frame timestamp, in seconds
+    int64_t publishedNs;                        // When it was published, steady clock (CLOCK_MONOTONIC) nanoseconds
+    int32_t faceId;
+    float interocularDistance;
+    float left, top, right, bottom;             // The landmarks' bounding box in the frame
+    float metrics[MetricBatch::NUM_METRICS];    // By metric index, see MetricBatch::metricNames()
+};
+
+/** @brief Layout of the shared memory: this header, then capacity slots
+ * The writer bumps a slot's sequence to odd before it overwrites the record and to even after, so a
+ * record n is complete exactly when its slot's sequence is 2n + 2 (a sequence lock per slot).
+ */
+struct ResultBusHeader
+{
+    enum : uint32_t { MAGIC = 0x53554258, VERSION = 1, NAME_SIZE = 32 };
+    enum : uint32_t { STARTING = 0, OPEN = 1, CLOSED = 2 };
+
+    std::atomic<uint32_t> state;                // STARTING until the header is filled in, CLOSED after the last record
+    uint32_t magic;
+    uint32_t version;
+    uint32_t capacity;                          // Number of slots, a power of two
+    uint32_t recordSize;                        // sizeof(ResultBusRecord)
+    uint32_t numMetrics;
+    char metricNames[MetricBatch::NUM_METRICS][NAME_SIZE];
+    std::atomic<uint64_t> head;                 // Number of records published so far
+};
+
+struct ResultBusSlot
+{
+    std::atomic<uint64_t> sequence;
+    ResultBusRecord record;
+};
+
+/** @brief Publishes results into a POSIX shared memory ring that other processes on the host read in place
+ * Readers map the same memory and follow the writer on their own, so any number of them can read without
+ * the writer knowing or waiting: a reader that falls more than capacity records behind loses the oldest
+ * ones.  Publishing and reading are plain loads and stores, there is no system call after open().
+ * Not available on Windows (open() returns false).
+ */
+class ResultBusWriter
+{
+public:
+
+    /** @brief ResultBusWriter
+     * @param name     -- Name of the shared memory object, e.g. "/affdex-results"
+     * @param capacity -- Records kept in the ring, rounded up to a power of two
+     */
+    ResultBusWriter(const std::string &name, const size_t capacity = 4096);
+
+    /** @brief Closes the bus and removes the name, readers that have it open keep their mapping
+     */
+    ~ResultBusWriter();
+
+    /** @brief Create the shared memory, replacing any left over from an earlier run
+     * @return false if it could not be created, see getError()
+     */
+    bool open();
+
+    /** @brief Publish a record per row of the batch
+     */
+    void publish(const MetricBatch &rows);
+
+    /** @brief Tell the readers there will be no more records
+     */
+    void close();
+
+    uint64_t published() const { return mHead; }
+    const std::string& getError() const { return mError; }
+
+private:
+
+    ResultBusWriter(const ResultBusWriter&);
+    ResultBusWriter& operator=(const ResultBusWriter&);
+
+    const std::string mName;
+    const size_t mCapacity;
+    std::string mError;
+    void *mMemory;
+    size_t mSize;
+    ResultBusHeader *mHeader;
+    ResultBusSlot *mSlots;
+    uint64_t mHead;
+};
+
+/** @brief Reads the records of a ResultBusWriter, in order, from another process or thread
+ * Each reader has its own position and never writes to the shared memory.  read() doesn't block: callers
+ * poll it, and decide how to wait (spin, yield or sleep) when there is nothing new.
+ */
+class ResultBusReader
+{
+public:
+
+    explicit ResultBusReader(const std::string &name);
+
+    ~ResultBusReader();
+
+    /** @brief Map the bus, starting at its oldest record still in the ring
+     * @return false if it doesn't exist (yet), is still starting or has another layout, see getError()
+     */
+    bool open();
+
+    /** @brief Read the next record
+     * @return false if there is no new record
+     */
+    bool read(ResultBusRecord &record);
+
+    /** @brief Closed tells whether the writer is done, read() may still return the last records
+     */
+    bool closed() const;
+
+    /** @brief Records overwritten before this reader got to them */
+    uint64_t dropped() const { return mDropped; }
+
+    /** @brief Names of the metrics, by index of ResultBusRecord::metrics */
+    const std::vector<std::string>& metricNames() const { return mMetricNames; }
+
+    const std::string& getError() const { return mError; }
+
+private:
+
+    ResultBusReader(const ResultBusReader&);
+    ResultBusReader& operator=(const ResultBusReader&);
+
+    void unmap();
+
+    const std::string mName;
+    std::string mError;
+    const void *mMemory;
+    size_t mSize;
+    const ResultBusHeader *mHeader;
+    const ResultBusSlot *mSlots;
+    uint64_t mMask;
+    uint64_t mNext;
+    uint64_t mDropped;
+    std::vector<std::string> mMetricNames;
+};
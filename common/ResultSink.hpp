@@ -0,0 +1,120 @@
+#pragma once
+
+#include <map>
+#include <ostream>
+
+#include "Frame.h"
+#include "Face.h"
+
+#include "PlottingImageListener.hpp"
+#include "MetricBatch.hpp"
+#include "ResultBus.h"
+
+using namespace affdex;
+
+/** @brief Consumer of detector results at the end of a pipeline
+ * A sink is only ever called from one thread at a time, with the results in timestamp order.  The results
+ * come as a MetricBatch, converted once from the SDK's faces for all the sinks.
+ */
+class ResultSink
+{
+public:
+
+    virtual ~ResultSink() {}
+
+    /** @brief Name used in logs and reports
+     */
+    virtual const char * name() const = 0;
+
+    /** @brief Consume the results of one processed frame
+     * @param frame -- The processed frame
+     * @param rows  -- Its results, a row per face or a single row without a face
+     */
+    virtual void consume(Frame &frame, const MetricBatch &rows) = 0;
+
+    /** @brief OnFaceLost is called when the detector stops tracking a face, from FaceListener::onFaceLost
+     * It comes on the SDK's thread, while the sink may be consuming, and ahead of results queued before the
+     * loss.
+     */
+    virtual void onFaceLost(const float timestamp, const FaceId faceId) {}
+
+    /** @brief Finish is called once after the last result
+     */
+    virtual void finish() {}
+};
+
+/** @brief Writes the results to a csv, in the format of PlottingImageListener::outputToFile
+ */
+class CsvSink : public ResultSink
+{
+public:
+
+    /** @brief CsvSink
+     * @param csv     -- Output stream, must outlive the sink
+     * @param metrics -- Counters to update, or nullptr (must outlive the sink)
+     */
+    CsvSink(std::ostream &csv, PipelineMetrics *metrics = nullptr) : mFormatter(false)
+    {
+        mFormatter.setMetrics(metrics);
+        mFormatter.setOutputStream(csv);
+    }
+
+    const char * name() const override { return "csv"; }
+
+    void consume(Frame &frame, const MetricBatch &rows) override
+    {
+        mFormatter.outputToFile(rows);
+    }
+
+private:
+    PlottingImageListener mFormatter;
+};
+
+/** @brief Draws the frames and their face metrics on screen
+ */
+class DisplaySink : public ResultSink
+{
+public:
+
+    explicit DisplaySink(PipelineMetrics *metrics = nullptr) : mPlotter(true)
+    {
+        mPlotter.setMetrics(metrics);
+    }
+
+    const char * name() const override { return "display"; }
+
+    void consume(Frame &frame, const MetricBatch &rows) override
+    {
+        mPlotter.draw(rows, frame);
+    }
+
+private:
+    PlottingImageListener mPlotter;
+};
+
+/** @brief Publishes the results on a shared memory result bus, for other processes on the host
+ */
+class ResultBusSink : public ResultSink
+{
+public:
+
+    /** @brief ResultBusSink
+     * @param bus -- An open bus, must outlive the sink
+     */
+    explicit ResultBusSink(ResultBusWriter &bus) : mBus(bus) {}
+
+    const char * name() const override { return "bus"; }
+
+    void consume(Frame &frame, const MetricBatch &rows) override
+    {
+        mBus.publish(rows);
+    }
+
+    void finish() override
+    {
+        mBus.close();
+    }
+
+private:
+    ResultBusWriter &mBus;
+};
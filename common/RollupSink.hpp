@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ResultSink.hpp"
+#include "MetricBatch.hpp"
+#include "Logger.h"
+
+/** @brief Aggregates the results into fixed time buckets, per face and metric, at several resolutions at once
+ * Every result updates a count, sum, minimum and maximum per face and metric (the head angles, emotions,
+ * expressions and emojis) for each interval.  Buckets are aligned on multiples of their interval in
+ * Frame::getTimestamp() time, and since results arrive in timestamp order a bucket is written as soon as a
+ * result past its end comes in, so only the open bucket of each interval is kept.  All the intervals go to
+ * one csv with a row per interval, bucket, face and metric; a face has no row in a bucket it wasn't seen in.
+ */
+class RollupSink : public ResultSink
+{
+public:
+
+    /** @brief RollupSink
+     * @param out       -- Output stream for the buckets, must outlive the sink
+     * @param intervals -- Bucket lengths in seconds
+     */
+    RollupSink(std::ostream &out, const std::vector<double> &intervals) : mOut(out), mRows(0)
+    {
+        for (double interval : intervals) mRollups.push_back(Rollup(interval));
+
+        mOut << "interval,bucketStart,faceId,metric,count,mean,min,max" << std::endl;
+        mOut.precision(4);
+        mOut << std::fixed;
+    }
+
+    const char * name() const override { return "rollup"; }
+
+    void consume(Frame &frame, const MetricBatch &rows) override
+    {
+        const double timestamp = frame.getTimestamp();
+        for (Rollup &rollup : mRollups)
+        {
+            // Timestamps go back when a video is looped, which closes the bucket as well
+            const double bucketStart = std::floor(timestamp / rollup.interval) * rollup.interval;
+            if (bucketStart != rollup.bucketStart)
+            {
+                write(rollup);
+                rollup.bucketStart = bucketStart;
+            }
+
+            for (size_t row = 0; row < rows.rows(); row++)
+            {
+                if (!rows.hasFace(row)) continue;
+                std::vector<Accumulator> &acc = rollup.faces[rows.faceId(row)];
+                if (acc.empty()) acc.resize(MetricBatch::NUM_METRICS);
+                for (size_t m = 0; m < MetricBatch::NUM_METRICS; m++) add(acc[m], rows.value(m, row));
+            }
+        }
+    }
+
+    void finish() override
+    {
+        for (Rollup &rollup : mRollups) write(rollup);
+        mOut.flush();
+        LOG(LogLevel::Info) << "Rollup: " << mRows << " rows over " << mRollups.size() << " interval(s)";
+    }
+
+private:
+
+    struct Accumulator
+    {
+        Accumulator() : count(0), sum(0), min(0), max(0) {}
+        uint32_t count;
+        double sum;
+        float min;
+        float max;
+    };
+
+    struct Rollup
+    {
+        explicit Rollup(const double i) : interval(i), bucketStart(NAN) {}
+        double interval;
+        double bucketStart;
+        std::map<FaceId, std::vector<Accumulator> > faces;
+    };
+
+    static void add(Accumulator &a, const float value)
+    {
+        if (std::isnan(value)) return;
+        a.min = a.count == 0 ? value : std::min(a.min, value);
+        a.max = a.count == 0 ? value : std::max(a.max, value);
+        a.sum += value;
+        a.count++;
+    }
+
+    void write(Rollup &rollup)
+    {
+        for (const auto &face : rollup.faces)
+        {
+            for (size_t i = 0; i < face.second.size(); i++)
+            {
+                const Accumulator &a = face.second[i];
+                if (a.count == 0) continue;
+                mOut << rollup.interval << "," << rollup.bucketStart << "," << face.first << "," << MetricBatch::metricNames()[i]
+                    << "," << a.count << "," << a.sum / a.count << "," << a.min << "," << a.max << "\n";
+                mRows++;
+            }
+        }
+        rollup.faces.clear();
+    }
+
+    std::ostream &mOut;
+    std::vector<Rollup> mRollups;
+    uint64_t mRows;
+};
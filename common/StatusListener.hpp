@@ -14,6 +14,7 @@
 #include <boost/algorithm/string.hpp>
 
 #include "ProcessStatusListener.h"
+#include "Logger.h"
 
 using namespace affdex;
 
@@ -21,19 +22,20 @@ class StatusListener : public ProcessStatusListener
 {
 public:
     
-    StatusListener():mIsRunning(true) {};
+    StatusListener():mIsRunning(true), mFailed(false) {};
     
     void onProcessingException(AffdexException ex)
     {
-        std::cerr << "Encountered an exception while processing: " << ex.what() << std::endl;
+        LOG(LogLevel::Error) << "Encountered an exception while processing: " << ex.what();
         m.lock();
         mIsRunning = false;
+        mFailed = true;
         m.unlock();
     };
     
     void onProcessingFinished()
     {
-        std::cerr << "Processing finished successfully" << std::endl;
+        LOG(LogLevel::Info) << "Processing finished successfully";
         m.lock();
         mIsRunning = false;
         m.unlock();
@@ -48,9 +50,18 @@ public:
         m.unlock();
         return ret;
     };
+
+    /** @brief Failed tells whether processing stopped on an exception rather than finishing
+     */
+    bool failed()
+    {
+        std::lock_guard<std::mutex> lg(m);
+        return mFailed;
+    };
     
 private:
     std::mutex m;
     bool mIsRunning;
+    bool mFailed;
     
 };
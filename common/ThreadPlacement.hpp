@@ -0,0 +1,344 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+
+#include "Logger.h"
+
+/** @brief How ThreadPlacement spreads pinned threads over the cpus
+ */
+enum class AffinityPolicy
+{
+    None,       // Leave every thread to the OS scheduler
+    Compact,    // Fill one NUMA node, core by core (hyperthreads next to each other), before the next
+    Scatter,    // Round robin over the NUMA nodes, then over the cores of each, hyperthreads last
+    List        // The given cpus, in the given order
+};
+
+/** @brief Pins the pipeline threads to cpus according to an AffinityPolicy
+ * The cpus the process may run on are put in policy order once, and every thread that asks for a slot
+ * gets the next one (wrapping around), so with --affinity compact a decode thread, its detect thread and
+ * its sink thread land on neighbouring cores of one node, and with scatter consecutive workers alternate
+ * sockets.  A thread is pinned by calling bind() from the thread itself.  Threads inherit the affinity of
+ * the thread that creates them, which is how the SDK's own worker threads can be placed: start() the
+ * detector while the calling thread is bound to the whole node of its slot, then narrow it to its cpu.
+ * The NUMA topology comes from /sys on Linux; elsewhere every cpu is taken to be on node 0.
+ */
+class ThreadPlacement
+{
+public:
+
+    struct Slot
+    {
+        Slot() : cpu(-1), node(-1) {}
+        int cpu;    // -1 when threads are not pinned
+        int node;
+    };
+
+    /** @brief ParsePolicy reads an --affinity value: none, compact, scatter or a cpu list such as 0,2,8-11
+     * @param spec   -- The value
+     * @param policy -- Receives the policy
+     * @param cpus   -- Receives the cpus for AffinityPolicy::List
+     * @return false if the value is not valid
+     */
+    static bool parsePolicy(const std::string &spec, AffinityPolicy &policy, std::vector<int> &cpus)
+    {
+        cpus.clear();
+        if (spec == "none" || spec.empty()) policy = AffinityPolicy::None;
+        else if (spec == "compact") policy = AffinityPolicy::Compact;
+        else if (spec == "scatter") policy = AffinityPolicy::Scatter;
+        else
+        {
+            policy = AffinityPolicy::List;
+            return parseCpuList(spec, cpus) && !cpus.empty();
+        }
+        return true;
+    }
+
+    /** @brief ThreadPlacement
+     * @param policy -- How to spread the threads
+     * @param cpus   -- The cpus to use, in order, for AffinityPolicy::List
+     */
+    ThreadPlacement(const AffinityPolicy policy, const std::vector<int> &cpus = std::vector<int>())
+        : mPolicy(policy), mNext(0)
+    {
+        discoverTopology();
+        switch (mPolicy)
+        {
+        case AffinityPolicy::Compact: mOrder = compactOrder(); break;
+        case AffinityPolicy::Scatter: mOrder = scatterOrder(); break;
+        case AffinityPolicy::List:
+            for (int cpu : cpus)
+            {
+                if (mNodeOf.count(cpu)) mOrder.push_back(cpu);
+                else LOG(LogLevel::Warning) << "Ignoring cpu " << cpu << ", not available to this process";
+            }
+            break;
+        default: break;
+        }
+    }
+
+    /** @brief Enabled tells whether threads are being pinned at all */
+    bool enabled() const { return !mOrder.empty(); }
+
+    /** @brief Next takes the next slot in policy order, an unpinned slot when the policy is none */
+    Slot next()
+    {
+        Slot slot;
+        if (mOrder.empty()) return slot;
+        slot.cpu = mOrder[mNext.fetch_add(1) % mOrder.size()];
+        slot.node = mNodeOf.at(slot.cpu);
+        return slot;
+    }
+
+    /** @brief Bind pins the calling thread to a slot
+     * @param slot      -- Where to pin it, from next()
+     * @param role      -- What the thread does, for the log
+     * @param wholeNode -- Allow every cpu of the slot's node rather than just its cpu
+     */
+    void bind(const Slot &slot, const std::string &role, const bool wholeNode = false)
+    {
+        if (slot.cpu < 0) return;
+        const std::vector<int> single(1, slot.cpu);
+        const std::vector<int> &cpus = wholeNode ? mNodeCpus.at(slot.node) : single;
+        if (!setAffinity(cpus))
+        {
+            LOG(LogLevel::Warning) << "Unable to pin " << role << " to cpu " << slot.cpu;
+            return;
+        }
+        if (wholeNode) return;
+        LOG(LogLevel::Info) << "Pinned " << role << " to cpu " << slot.cpu << " on node " << slot.node;
+    }
+
+    /** @brief Pin takes the next slot and pins the calling thread to it
+     * @param role -- What the thread does, for the log
+     */
+    Slot pin(const std::string &role)
+    {
+        const Slot slot = next();
+        bind(slot, role);
+        return slot;
+    }
+
+    /** @brief Report logs the topology and the order threads will be placed in, call once at startup
+     * Each thread then logs the cpu it was pinned to as it starts.
+     */
+    void report() const
+    {
+        LOG(LogLevel::Info) << "Thread placement: " << policyName() << ", " << mNodeOf.size() << " cpus on "
+            << mNodeCpus.size() << " NUMA node(s)";
+        for (const auto &node : mNodeCpus)
+        {
+            LOG(LogLevel::Info) << "  node " << node.first << ": cpus " << formatCpus(node.second);
+        }
+        if (!mOrder.empty()) LOG(LogLevel::Info) << "  threads are placed on cpus " << formatCpus(mOrder);
+    }
+
+private:
+
+    struct Cpu
+    {
+        int id;
+        int node;
+        int package;
+        int core;
+    };
+
+    static bool parseCpuList(const std::string &spec, std::vector<int> &cpus)
+    {
+        std::stringstream ss(spec);
+        std::string range;
+        while (std::getline(ss, range, ','))
+        {
+            if (range.empty()) continue;
+            const size_t dash = range.find('-');
+            try
+            {
+                const int first = std::stoi(range.substr(0, dash));
+                const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                if (first < 0 || last < first) return false;
+                for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+            }
+            catch (std::exception&)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static std::string formatCpus(const std::vector<int> &cpus)
+    {
+        std::string out;
+        for (int cpu : cpus) out += (out.empty() ? "" : ",") + std::to_string(cpu);
+        return out;
+    }
+
+    static int readInt(const boost::filesystem::path &path, const int fallback)
+    {
+        std::ifstream in(path.string());
+        int value;
+        return (in >> value) ? value : fallback;
+    }
+
+    const char * policyName() const
+    {
+        switch (mPolicy)
+        {
+        case AffinityPolicy::Compact: return "compact";
+        case AffinityPolicy::Scatter: return "scatter";
+        case AffinityPolicy::List: return "cpu list";
+        default: return "none";
+        }
+    }
+
+    void discoverTopology()
+    {
+        std::vector<int> allowed;
+#ifdef _WIN32
+        DWORD_PTR processMask, systemMask;
+        if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+        {
+            for (int cpu = 0; cpu < (int)(8 * sizeof(DWORD_PTR)); cpu++)
+            {
+                if (processMask & ((DWORD_PTR)1 << cpu)) allowed.push_back(cpu);
+            }
+        }
+#else
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(0, sizeof(set), &set) == 0)
+        {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+            {
+                if (CPU_ISSET(cpu, &set)) allowed.push_back(cpu);
+            }
+        }
+#endif
+        if (allowed.empty())
+        {
+            for (int cpu = 0; cpu < (int)std::max(1u, std::thread::hardware_concurrency()); cpu++) allowed.push_back(cpu);
+        }
+
+        // Nodes list their cpus, cpus know their package and core
+        std::map<int, int> nodeOf;
+        const boost::filesystem::path nodes("/sys/devices/system/node");
+        boost::system::error_code ec;
+        for (boost::filesystem::directory_iterator it(nodes, ec), end; !ec && it != end; it.increment(ec))
+        {
+            const std::string name = it->path().filename().string();
+            if (name.compare(0, 4, "node") != 0 || name.size() == 4 || !isdigit(name[4])) continue;
+            std::ifstream in((it->path() / "cpulist").string());
+            std::string list;
+            std::vector<int> cpus;
+            if (!std::getline(in, list) || !parseCpuList(list, cpus)) continue;
+            for (int cpu : cpus) nodeOf[cpu] = std::atoi(name.c_str() + 4);
+        }
+
+        for (int id : allowed)
+        {
+            const boost::filesystem::path topology = boost::filesystem::path("/sys/devices/system/cpu")
+                / ("cpu" + std::to_string(id)) / "topology";
+            Cpu cpu;
+            cpu.id = id;
+            cpu.node = nodeOf.count(id) ? nodeOf[id] : 0;
+            cpu.package = readInt(topology / "physical_package_id", cpu.node);
+            cpu.core = readInt(topology / "core_id", id);
+            mCpus.push_back(cpu);
+            mNodeOf[id] = cpu.node;
+            mNodeCpus[cpu.node].push_back(id);
+        }
+    }
+
+    /** Node by node, core by core, the hyperthreads of a core next to each other */
+    std::vector<int> compactOrder() const
+    {
+        std::vector<Cpu> cpus = mCpus;
+        std::sort(cpus.begin(), cpus.end(), [](const Cpu &a, const Cpu &b)
+        {
+            if (a.node != b.node) return a.node < b.node;
+            if (a.package != b.package) return a.package < b.package;
+            if (a.core != b.core) return a.core < b.core;
+            return a.id < b.id;
+        });
+        std::vector<int> order;
+        for (const Cpu &cpu : cpus) order.push_back(cpu.id);
+        return order;
+    }
+
+    /** One cpu of every node in turn, first one hyperthread of every core, then their siblings */
+    std::vector<int> scatterOrder() const
+    {
+        // Rank the cpus within their core (hyperthread 0, 1 ..) and the cores within their node
+        std::map<std::pair<int, int>, std::vector<int> > cores;     // (package, core) -> cpus
+        std::map<int, std::vector<std::pair<int, int> > > nodeCores; // node -> cores
+        for (const Cpu &cpu : compactOrderCpus())
+        {
+            const std::pair<int, int> key(cpu.package, cpu.core);
+            if (cores[key].empty()) nodeCores[cpu.node].push_back(key);
+            cores[key].push_back(cpu.id);
+        }
+
+        std::vector<int> order;
+        size_t maxThreads = 0, maxCores = 0;
+        for (const auto &core : cores) maxThreads = std::max(maxThreads, core.second.size());
+        for (const auto &node : nodeCores) maxCores = std::max(maxCores, node.second.size());
+        for (size_t thread = 0; thread < maxThreads; thread++)
+        {
+            for (size_t core = 0; core < maxCores; core++)
+            {
+                for (const auto &node : nodeCores)
+                {
+                    if (core >= node.second.size()) continue;
+                    const std::vector<int> &siblings = cores.at(node.second[core]);
+                    if (thread < siblings.size()) order.push_back(siblings[thread]);
+                }
+            }
+        }
+        return order;
+    }
+
+    std::vector<Cpu> compactOrderCpus() const
+    {
+        std::vector<Cpu> cpus;
+        for (int id : compactOrder())
+        {
+            for (const Cpu &cpu : mCpus) if (cpu.id == id) cpus.push_back(cpu);
+        }
+        return cpus;
+    }
+
+    static bool setAffinity(const std::vector<int> &cpus)
+    {
+#ifdef _WIN32
+        DWORD_PTR mask = 0;
+        for (int cpu : cpus) if (cpu < (int)(8 * sizeof(DWORD_PTR))) mask |= (DWORD_PTR)1 << cpu;
+        return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#else
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) if (cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+        return sched_setaffinity(0, sizeof(set), &set) == 0;    // 0 is the calling thread
+#endif
+    }
+
+    const AffinityPolicy mPolicy;
+    std::vector<Cpu> mCpus;
+    std::map<int, int> mNodeOf;
+    std::map<int, std::vector<int> > mNodeCpus;
+    std::vector<int> mOrder;
+    std::atomic<size_t> mNext;
+};
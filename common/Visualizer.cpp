@@ -1,6 +1,8 @@
 #include "Visualizer.h"
 #include <boost/format.hpp>
 #include "affdex_small_logo.h"
+#include "FaceTrackStore.hpp"
+#include "MetricBatch.hpp"
 #include <algorithm>
 
 Visualizer::Visualizer():
@@ -14,28 +16,11 @@ Visualizer::Visualizer():
     logo_resized = false;
     logo = cv::imdecode(cv::InputArray(small_logo), CV_LOAD_IMAGE_UNCHANGED);
 
-    EXPRESSIONS = {
-        "smile", "innerBrowRaise", "browRaise", "browFurrow", "noseWrinkle",
-        "upperLipRaise", "lipCornerDepressor", "chinRaise", "lipPucker", "lipPress",
-        "lipSuck", "mouthOpen", "smirk", "eyeClosure", "attention", "eyeWiden", "cheekRaise",
-        "lidTighten", "dimpler", "lipStretch", "jawDrop"
-    };
-
-    EMOTIONS = {
-        "joy", "fear", "disgust", "sadness", "anger",
-        "surprise", "contempt", "valence", "engagement"
-    };
-
-    HEAD_ANGLES = { "pitch", "yaw", "roll" };
-
-
-    EMOJIS = std::vector<std::string> {
-        "relaxed", "smiley", "laughing",
-            "kissing", "disappointed",
-            "rage", "smirk", "wink",
-            "stuckOutTongueWinkingEye", "stuckOutTongue",
-            "flushed", "scream"
-    };
+    // The metric names come from the batch, so the display and the csv columns can't disagree
+    EXPRESSIONS = MetricBatch::metricNames(MetricBatch::FIRST_EXPRESSION, MetricBatch::NUM_EXPRESSIONS);
+    EMOTIONS = MetricBatch::metricNames(MetricBatch::FIRST_EMOTION, MetricBatch::NUM_EMOTIONS);
+    HEAD_ANGLES = MetricBatch::metricNames(MetricBatch::FIRST_ANGLE, MetricBatch::NUM_ANGLES);
+    EMOJIS = MetricBatch::metricNames(MetricBatch::FIRST_EMOJI, MetricBatch::NUM_EMOJIS);
 
     GENDER_MAP = std::map<affdex::Gender, std::string> {
         { affdex::Gender::Male, "male" },
@@ -70,36 +55,66 @@ Visualizer::Visualizer():
     };
 }
 
-void Visualizer::drawFaceMetrics(affdex::Face face, std::vector<cv::Point2f> bounding_box)
+void Visualizer::drawFaceMetrics(const MetricBatch &rows, const size_t row, const BoundingBox &bounding_box)
 {
     cv::Scalar white_color = cv::Scalar(255, 255, 255);
 
     //Draw Right side metrics
-    int padding = bounding_box[0].y; //Top left Y
-    drawValues((float *)&face.expressions, EXPRESSIONS,
-               bounding_box[2].x + spacing, padding, white_color, false);
+    int padding = bounding_box.top;
+    drawValues(rows, row, MetricBatch::FIRST_EXPRESSION, EXPRESSIONS,
+               bounding_box.right + spacing, padding, white_color, false);
 
-    padding = bounding_box[2].y;  //Top left Y
+    padding = bounding_box.top;
     //Draw Head Angles
-    drawHeadOrientation(face.measurements.orientation,
-                        bounding_box[0].x - spacing, padding);
+    drawHeadOrientation(rows.orientation(row),
+                        bounding_box.left - spacing, padding);
 
     //Draw Appearance
-    drawAppearance(face.appearance, bounding_box[0].x - spacing, padding);
+    drawAppearance(rows.appearance(row), bounding_box.left - spacing, padding);
 
     //Draw Left side metrics
-    drawValues((float *)&face.emotions, EMOTIONS,
-               bounding_box[0].x - spacing, padding, white_color, true);
+    drawValues(rows, row, MetricBatch::FIRST_EMOTION, EMOTIONS,
+               bounding_box.left - spacing, padding, white_color, true);
+
+}
+
+void Visualizer::drawSparkline(const FaceTrack &track, const size_t metric, const std::string &name, const cv::Rect &area)
+{
+    static const ColorgenRedGreen valence_color_generator( -100, 100 );
+    if (track.size() == 0 || area.width < 2 || area.height < 2) return;
+
+    // Valence spans [-100, 100], the other metrics [0, 100]; the buffer's capacity spans the width so it scrolls
+    const float low = name == "valence" ? -100.f : 0.f;
+    const float high = 100.f;
+    const float x_step = (float)(area.width - 1) / std::max<size_t>(1, track.capacity() - 1);
+    const float x0 = area.x + area.width - 1 - x_step * (track.size() - 1);
+    std::vector<cv::Point> points;
+    points.reserve(track.size());
+    for (size_t i = 0; i < track.size(); i++)
+    {
+        const float value = track.value(metric, i);
+        if (std::isnan(value)) continue;
+        const float y = (std::min(high, std::max(low, value)) - low) / (high - low);
+        points.push_back(cv::Point(x0 + x_step * i, area.y + (area.height - 1) * (1 - y)));
+    }
+
+    cv::Scalar color = cv::Scalar(255, 255, 255);
+    if (name == "valence") color = valence_color_generator(track.latest(metric));
+    else if (RED_COLOR_CLASSIFIERS.count(name)) color = cv::Scalar(0, 0, 255);
+    else if (GREEN_COLOR_CLASSIFIERS.count(name)) color = cv::Scalar(0, 255, 0);
 
+    cv::rectangle(img, area, cv::Scalar(128, 128, 128), 1);
+    for (size_t i = 1; i < points.size(); i++) cv::line(img, points[i - 1], points[i], color, 1);
+    cv::putText(img, name, cv::Point(area.x + 2, area.y + 12), cv::FONT_HERSHEY_SIMPLEX, 0.4f, color, 1);
 }
 
-void Visualizer::drawValues(const float * first, const std::vector<std::string> names,
+void Visualizer::drawValues(const MetricBatch &rows, const size_t row, size_t first, const std::vector<std::string> names,
                             const int x, int &padding, const cv::Scalar clr, const bool align_right)
 {
 
     for (std::string name : names)
     {
-        drawClassifierOutput(name, (*first), cv::Point(x, padding += spacing), align_right);
+        drawClassifierOutput(name, rows.value(first, row), cv::Point(x, padding += spacing), align_right);
         first++;
     }
 }
@@ -127,11 +142,11 @@ void Visualizer::drawPoints(affdex::VecFeaturePoint points)
     }
 }
 
-void Visualizer::drawBoundingBox(cv::Point2f top_left, cv::Point2f bottom_right, float valence)
+void Visualizer::drawBoundingBox(const BoundingBox &bounding_box, float valence)
 {
     //Draw bounding box
     const ColorgenRedGreen valence_color_generator( -100, 100 );
-    cv::rectangle( img, top_left, bottom_right,
+    cv::rectangle( img, bounding_box.topLeft(), bounding_box.bottomRight(),
                    valence_color_generator(valence), 3);
 
 }
@@ -1,9 +1,16 @@
+#pragma once
+
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <Frame.h>
 #include <Face.h>
 #include <set>
 
+#include "BoundingBox.hpp"
+
+class FaceTrack;
+class MetricBatch;
+
 /** @brief Plot the face metrics using opencv highgui
  */
 class Visualizer
@@ -23,11 +30,10 @@ public:
   void drawPoints(affdex::VecFeaturePoint points);
 
   /** @brief DrawBoundingBox displays the bounding box
-  * @param top_left      -- The top left point
-  * @param bottom_right  -- The bottom right point
+  * @param bounding_box  -- The box around the face
   * @param valence       -- The valence value
   */
-  void drawBoundingBox(cv::Point2f top_left, cv::Point2f bottom_right, float valence);
+  void drawBoundingBox(const BoundingBox &bounding_box, float valence);
 
   /** @brief DrawHeadOrientation Displays head orientation and associated value
   * @param name        -- Name of the classifier
@@ -53,10 +59,19 @@ public:
 
 
   /** @brief DrawFaceMetrics Displays all facial metrics and associated value
-  * @param face         -- The affdex::Face object to display
-  * @param bounding_box -- The bounding box coordinates
+  * @param rows         -- The results holding the face
+  * @param row          -- The face's row
+  * @param bounding_box -- The box around the face
   */
-  void drawFaceMetrics(affdex::Face face, std::vector<cv::Point2f> bounding_box);
+  void drawFaceMetrics(const MetricBatch &rows, const size_t row, const BoundingBox &bounding_box);
+
+  /** @brief DrawSparkline plots the recent history of a metric as a line, newest on the right
+  * @param track  -- The face's history
+  * @param metric -- Index of the metric in the track (see FaceTrackStore::metricNames)
+  * @param name   -- Name of the metric, for the label and colors
+  * @param area   -- Where to draw it
+  */
+  void drawSparkline(const FaceTrack &track, const size_t metric, const std::string &name, const cv::Rect &area);
 
   /** @brief ShowImage displays image on screen
   */
@@ -94,13 +109,15 @@ private:
   void drawClassifierOutput(const std::string& classifier, const float value,
                             const cv::Point2f& loc, bool align_right=false );
   /** @brief DrawValues displays a list of classifiers and associated values
+  * @param rows        -- The results holding the face
+  * @param row         -- The face's row
+  * @param first       -- Metric index of the first classifier, the others follow it
   * @param names       -- Names of the classifiers to show
-  * @param value       -- Value we are trying to display
   * @param x           -- The x value of the location
   * @param padding     -- The padding value
   * @param align_right -- Whether to right or left justify the text
   */
-  void drawValues(const float * first, const std::vector<std::string> names,
+  void drawValues(const MetricBatch &rows, const size_t row, size_t first, const std::vector<std::string> names,
                   const int x, int &padding, const cv::Scalar clr, const bool align_right);
 
 
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+namespace affdex
+{
+    class AffdexException : public std::runtime_error
+    {
+    public:
+        explicit AffdexException(const std::string &msg) : std::runtime_error(msg) {}
+    };
+}
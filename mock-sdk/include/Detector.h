@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "typedefs.h"
+#include "ImageListener.h"
+#include "FaceListener.h"
+#include "ProcessStatusListener.h"
+#include "MockConfig.h"
+
+namespace affdex
+{
+    namespace mock
+    {
+        class SyntheticFaces;
+    }
+
+    /** @brief Base class of the mock detectors
+     * Mirrors the configuration and listener surface of the SDK Detector.  Classifier selection and the
+     * classifier path are accepted and ignored; every metric is always generated.
+     */
+    class Detector
+    {
+    public:
+
+        virtual ~Detector();
+
+        void setClassifierPath(const path &classifierPath);
+        void setDetectAllEmotions(bool detect);
+        void setDetectAllExpressions(bool detect);
+        void setDetectAllEmojis(bool detect);
+        void setDetectAllAppearances(bool detect);
+
+        void setImageListener(ImageListener *listener);
+        void setFaceListener(FaceListener *listener);
+        void setProcessStatusListener(ProcessStatusListener *listener);
+
+        virtual void start();
+        virtual void stop();
+        virtual void reset();
+        bool isRunning();
+
+        unsigned int getMaxNumberFaces();
+        FaceDetectorMode getFaceDetectorMode();
+
+    protected:
+
+        Detector(unsigned int maxNumFaces, FaceDetectorMode faceDetectorMode);
+
+        /** @brief Analyze generates face results for the frame and notifies the listeners
+         * @param frame -- The frame to "process"
+         * @param seed  -- Reseed the face generator first (0 keeps the current sequence)
+         */
+        void analyze(Frame frame, uint32_t seed = 0);
+
+        void notifyCapture(Frame frame);
+        void notifyFinished();
+        void notifyException(const AffdexException &ex);
+        void checkRunning();
+
+        /** @brief Burn the configured per-frame processing time
+         */
+        void simulateProcessing();
+
+        const unsigned int mMaxNumFaces;
+        const FaceDetectorMode mFaceDetectorMode;
+        mock::MockConfig mConfig;
+        std::atomic<bool> mRunning;
+
+    private:
+
+        std::mutex mListenerMutex;
+        ImageListener *mImageListener;
+        FaceListener *mFaceListener;
+        ProcessStatusListener *mStatusListener;
+        std::mutex mFacesMutex;     // reset() and analyze() come from different threads
+        std::unique_ptr<mock::SyntheticFaces> mFaces;
+    };
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "typedefs.h"
+
+namespace affdex
+{
+    enum class Glasses { No = 0, Yes = 1 };
+
+    enum class Gender { Unknown = 0, Male = 1, Female = 2 };
+
+    enum class Age
+    {
+        AGE_UNKNOWN, AGE_UNDER_18, AGE_18_24, AGE_25_34, AGE_35_44, AGE_45_54, AGE_55_64, AGE_65_PLUS
+    };
+
+    enum class Ethnicity
+    {
+        UNKNOWN, CAUCASIAN, BLACK_AFRICAN, SOUTH_ASIAN, EAST_ASIAN, HISPANIC
+    };
+
+    enum class Emoji
+    {
+        Relaxed, Smiley, Laughing, Kissing, Disappointed, Rage, Smirk, Wink,
+        StuckOutTongueWinkingEye, StuckOutTongue, Flushed, Scream, Unknown
+    };
+
+    std::string EmojiToString(const Emoji emoji);
+
+    struct Orientation
+    {
+        float pitch;
+        float yaw;
+        float roll;
+    };
+
+    struct Measurements
+    {
+        Orientation orientation;
+        float interocularDistance;
+    };
+
+    struct FeaturePoint
+    {
+        int id;
+        float x;
+        float y;
+    };
+
+    typedef std::vector<FeaturePoint> VecFeaturePoint;
+
+    struct Emotions
+    {
+        float joy;
+        float fear;
+        float disgust;
+        float sadness;
+        float anger;
+        float surprise;
+        float contempt;
+        float valence;
+        float engagement;
+    };
+
+    struct Expressions
+    {
+        float smile;
+        float innerBrowRaise;
+        float browRaise;
+        float browFurrow;
+        float noseWrinkle;
+        float upperLipRaise;
+        float lipCornerDepressor;
+        float chinRaise;
+        float lipPucker;
+        float lipPress;
+        float lipSuck;
+        float mouthOpen;
+        float smirk;
+        float eyeClosure;
+        float attention;
+        float eyeWiden;
+        float cheekRaise;
+        float lidTighten;
+        float dimpler;
+        float lipStretch;
+        float jawDrop;
+    };
+
+    struct Emojis
+    {
+        float relaxed;
+        float smiley;
+        float laughing;
+        float kissing;
+        float disappointed;
+        float rage;
+        float smirk;
+        float wink;
+        float stuckOutTongueWinkingEye;
+        float stuckOutTongue;
+        float flushed;
+        float scream;
+        Emoji dominantEmoji;
+    };
+
+    struct Appearance
+    {
+        Gender gender;
+        Glasses glasses;
+        Age age;
+        Ethnicity ethnicity;
+    };
+
+    struct Face
+    {
+        FaceId id;
+        Emojis emojis;
+        Expressions expressions;
+        Emotions emotions;
+        Measurements measurements;
+        Appearance appearance;
+        VecFeaturePoint featurePoints;
+    };
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "typedefs.h"
+
+namespace affdex
+{
+    /** @brief Notified when a tracked face appears or disappears
+     */
+    class FaceListener
+    {
+    public:
+        virtual ~FaceListener() {}
+        virtual void onFaceFound(float timestamp, FaceId faceId) = 0;
+        virtual void onFaceLost(float timestamp, FaceId faceId) = 0;
+    };
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include "typedefs.h"
+
+namespace affdex
+{
+    /** @brief Image plus timestamp handed to and returned by the detectors
+     * The pixels are copied on construction and shared between copies, like the SDK Frame.
+     */
+    class Frame
+    {
+    public:
+
+        enum class COLOR_FORMAT
+        {
+            RGB,
+            BGR,
+            RGBA,
+            BGRA
+        };
+
+        Frame();
+
+        /** @brief Frame
+         * @param width     -- Width in pixels
+         * @param height    -- Height in pixels
+         * @param pixels    -- Interleaved pixel data in the given format (copied)
+         * @param format    -- Color format of pixels
+         * @param timestamp -- Timestamp in seconds
+         */
+        Frame(const int width, const int height, uint8_t * pixels, const COLOR_FORMAT format, const float timestamp = 0.0f);
+
+        std::shared_ptr<unsigned char> getBGRByteArray();
+        int getBGRByteArrayLength();
+        int getWidth();
+        int getHeight();
+        float getTimestamp();
+        void setTimestamp(const float timestamp);
+        COLOR_FORMAT getColorFormat();
+
+    private:
+        int mWidth;
+        int mHeight;
+        float mTimestamp;
+        COLOR_FORMAT mFormat;
+        std::shared_ptr<unsigned char> mBGR;
+    };
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <thread>
+
+#include "Detector.h"
+
+namespace affdex
+{
+    /** @brief Mock of the SDK FrameDetector
+     * Frames passed to process() are queued (up to bufferSize, newer frames are dropped when full) and
+     * analyzed on a worker thread at no more than processFrameRate.
+     */
+    class FrameDetector : public Detector
+    {
+    public:
+
+        FrameDetector(int bufferSize, float processFrameRate = 30.0f, unsigned int maxNumFaces = 1,
+                      FaceDetectorMode faceDetectorMode = FaceDetectorMode::LARGE_FACES);
+
+        ~FrameDetector();
+
+        void start() override;
+        void stop() override;
+        void reset() override;
+
+        void process(Frame frame);
+
+    private:
+
+        void run();
+
+        const int mBufferSize;
+        const float mProcessFrameRate;
+        std::mutex mRunMutex;       // Held while a frame is processed, so reset() waits for it (taken before mQueueMutex)
+        std::mutex mQueueMutex;
+        std::condition_variable mQueueCV;
+        std::deque<Frame> mQueue;
+        float mLastProcessed;
+        bool mStop;
+        std::thread mThread;
+    };
+}
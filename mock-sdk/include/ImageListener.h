@@ -0,0 +1,19 @@
+#pragma once
+
+#include <map>
+
+#include "Face.h"
+#include "Frame.h"
+
+namespace affdex
+{
+    /** @brief Receives captured frames and the per-frame face results
+     */
+    class ImageListener
+    {
+    public:
+        virtual ~ImageListener() {}
+        virtual void onImageResults(std::map<FaceId, Face> faces, Frame image) = 0;
+        virtual void onImageCapture(Frame image) = 0;
+    };
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+namespace affdex
+{
+namespace mock
+{
+    /** @brief Knobs for the synthetic results produced by the mock detectors
+     * All randomness is drawn from generators seeded with `seed`, so two runs with the same configuration
+     * (and, for VideoDetector, the same input path) produce identical results.
+     */
+    struct MockConfig
+    {
+        MockConfig()
+            : seed(1), numFaces(1), landmarkJitter(1.5f), metricMean(20.0f), metricStdDev(15.0f),
+              metricSmoothness(0.9f), frameRate(30.0f), duration(10.0f), width(640), height(480),
+              faceLifetime(0.0f), processingTime(0.0f), realtime(false)
+        {}
+
+        uint32_t seed;
+        unsigned int numFaces;    // Faces in view (capped by the detector's maxNumFaces)
+        float landmarkJitter;     // Standard deviation of the per-frame landmark noise, in pixels
+        float metricMean;         // Mean of the emotion/expression/emoji distribution (0-100 scale)
+        float metricStdDev;       // Standard deviation of that distribution
+        float metricSmoothness;   // 0 = independent samples every frame, close to 1 = slowly drifting values
+        float frameRate;          // Frame rate of the synthetic video played by VideoDetector::process
+        float duration;           // Length in seconds of the synthetic video
+        int width;                // Synthetic frame size
+        int height;
+        float faceLifetime;       // Mean seconds before a face is lost and replaced by a new id (0 = never)
+        float processingTime;     // Simulated per-frame detection cost in seconds
+        bool realtime;            // Pace VideoDetector playback at frameRate instead of running flat out
+    };
+
+    /** @brief Configuration picked up by detectors on start() / process()
+     */
+    void setConfig(const MockConfig &config);
+
+    MockConfig getConfig();
+}
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "Detector.h"
+
+namespace affdex
+{
+    /** @brief Mock of the SDK PhotoDetector, process() analyzes the frame synchronously
+     */
+    class PhotoDetector : public Detector
+    {
+    public:
+
+        PhotoDetector(unsigned int maxNumFaces = 1, FaceDetectorMode faceDetectorMode = FaceDetectorMode::LARGE_FACES);
+
+        void process(Frame frame);
+
+    private:
+        uint32_t mCount;
+    };
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "AffdexException.h"
+
+namespace affdex
+{
+    /** @brief Notified when asynchronous processing ends
+     */
+    class ProcessStatusListener
+    {
+    public:
+        virtual ~ProcessStatusListener() {}
+        virtual void onProcessingException(AffdexException ex) = 0;
+        virtual void onProcessingFinished() = 0;
+    };
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <thread>
+
+#include "Detector.h"
+
+namespace affdex
+{
+    /** @brief Mock of the SDK VideoDetector
+     * process() plays a synthetic video (MockConfig::frameRate x MockConfig::duration frames) on a background
+     * thread instead of decoding the file; the path only seeds the generator so each input is reproducible.
+     */
+    class VideoDetector : public Detector
+    {
+    public:
+
+        VideoDetector(float processFrameRate, unsigned int maxNumFaces = 1,
+                      FaceDetectorMode faceDetectorMode = FaceDetectorMode::LARGE_FACES);
+
+        ~VideoDetector();
+
+        void stop() override;
+
+        void process(path filePath);
+
+    private:
+
+        void run(path filePath);
+
+        const float mProcessFrameRate;
+        std::atomic<bool> mCancel;
+        std::thread mThread;
+    };
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+/** @brief Subset of the Affdex SDK types used by the samples (mock build)
+ */
+namespace affdex
+{
+    typedef int FaceId;
+
+#ifdef _WIN32
+    typedef std::wstring path;
+#else // _WIN32
+    typedef std::string path;
+#endif // _WIN32
+
+    enum class FaceDetectorMode
+    {
+        LARGE_FACES = 0,
+        SMALL_FACES = 1
+    };
+}
@@ -0,0 +1,144 @@
+#include "Detector.h"
+#include "SyntheticFaces.h"
+
+#include <chrono>
+
+namespace affdex
+{
+    Detector::Detector(unsigned int maxNumFaces, FaceDetectorMode faceDetectorMode)
+        : mMaxNumFaces(maxNumFaces), mFaceDetectorMode(faceDetectorMode), mConfig(mock::getConfig()), mRunning(false),
+          mImageListener(nullptr), mFaceListener(nullptr), mStatusListener(nullptr)
+    {
+    }
+
+    Detector::~Detector()
+    {
+    }
+
+    void Detector::setClassifierPath(const path &classifierPath) {}
+    void Detector::setDetectAllEmotions(bool detect) {}
+    void Detector::setDetectAllExpressions(bool detect) {}
+    void Detector::setDetectAllEmojis(bool detect) {}
+    void Detector::setDetectAllAppearances(bool detect) {}
+
+    void Detector::setImageListener(ImageListener *listener)
+    {
+        std::lock_guard<std::mutex> lg(mListenerMutex);
+        mImageListener = listener;
+    }
+
+    void Detector::setFaceListener(FaceListener *listener)
+    {
+        std::lock_guard<std::mutex> lg(mListenerMutex);
+        mFaceListener = listener;
+    }
+
+    void Detector::setProcessStatusListener(ProcessStatusListener *listener)
+    {
+        std::lock_guard<std::mutex> lg(mListenerMutex);
+        mStatusListener = listener;
+    }
+
+    void Detector::start()
+    {
+        if (mRunning) throw AffdexException("Detector is already running");
+        mConfig = mock::getConfig();
+        mFaces.reset(new mock::SyntheticFaces(mConfig, mMaxNumFaces));
+        mRunning = true;
+    }
+
+    void Detector::stop()
+    {
+        mRunning = false;
+    }
+
+    void Detector::reset()
+    {
+        std::lock_guard<std::mutex> lg(mFacesMutex);
+        if (mFaces) mFaces->reseed(mConfig.seed);
+    }
+
+    bool Detector::isRunning()
+    {
+        return mRunning;
+    }
+
+    unsigned int Detector::getMaxNumberFaces()
+    {
+        return mMaxNumFaces;
+    }
+
+    FaceDetectorMode Detector::getFaceDetectorMode()
+    {
+        return mFaceDetectorMode;
+    }
+
+    void Detector::checkRunning()
+    {
+        if (!mRunning) throw AffdexException("Detector must be started before calling process()");
+    }
+
+    void Detector::simulateProcessing()
+    {
+        if (mConfig.processingTime <= 0.0f) return;
+        // Spin rather than sleep, the point is to load a core the way the real classifiers do
+        const auto until = std::chrono::steady_clock::now() +
+            std::chrono::microseconds((long long)(mConfig.processingTime * 1e6));
+        while (std::chrono::steady_clock::now() < until) {}
+    }
+
+    void Detector::analyze(Frame frame, uint32_t seed)
+    {
+        std::vector<FaceId> found, lost;
+        std::map<FaceId, Face> faces;
+        {
+            std::lock_guard<std::mutex> lg(mFacesMutex);
+            if (seed != 0) mFaces->reseed(seed);
+            faces = mFaces->next(frame.getTimestamp(), found, lost);
+        }
+
+        ImageListener *imageListener;
+        FaceListener *faceListener;
+        {
+            std::lock_guard<std::mutex> lg(mListenerMutex);
+            imageListener = mImageListener;
+            faceListener = mFaceListener;
+        }
+        if (faceListener)
+        {
+            for (FaceId id : lost) faceListener->onFaceLost(frame.getTimestamp(), id);
+            for (FaceId id : found) faceListener->onFaceFound(frame.getTimestamp(), id);
+        }
+        if (imageListener) imageListener->onImageResults(faces, frame);
+    }
+
+    void Detector::notifyCapture(Frame frame)
+    {
+        ImageListener *listener;
+        {
+            std::lock_guard<std::mutex> lg(mListenerMutex);
+            listener = mImageListener;
+        }
+        if (listener) listener->onImageCapture(frame);
+    }
+
+    void Detector::notifyFinished()
+    {
+        ProcessStatusListener *listener;
+        {
+            std::lock_guard<std::mutex> lg(mListenerMutex);
+            listener = mStatusListener;
+        }
+        if (listener) listener->onProcessingFinished();
+    }
+
+    void Detector::notifyException(const AffdexException &ex)
+    {
+        ProcessStatusListener *listener;
+        {
+            std::lock_guard<std::mutex> lg(mListenerMutex);
+            listener = mStatusListener;
+        }
+        if (listener) listener->onProcessingException(ex);
+    }
+}
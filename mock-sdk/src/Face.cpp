@@ -0,0 +1,24 @@
+#include "Face.h"
+
+namespace affdex
+{
+    std::string EmojiToString(const Emoji emoji)
+    {
+        switch (emoji)
+        {
+            case Emoji::Relaxed: return "relaxed";
+            case Emoji::Smiley: return "smiley";
+            case Emoji::Laughing: return "laughing";
+            case Emoji::Kissing: return "kissing";
+            case Emoji::Disappointed: return "disappointed";
+            case Emoji::Rage: return "rage";
+            case Emoji::Smirk: return "smirk";
+            case Emoji::Wink: return "wink";
+            case Emoji::StuckOutTongueWinkingEye: return "stuckOutTongueWinkingEye";
+            case Emoji::StuckOutTongue: return "stuckOutTongue";
+            case Emoji::Flushed: return "flushed";
+            case Emoji::Scream: return "scream";
+            default: return "unknown";
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#include "Frame.h"
+
+#include <cstring>
+
+namespace affdex
+{
+    namespace
+    {
+        int channels(const Frame::COLOR_FORMAT format)
+        {
+            return (format == Frame::COLOR_FORMAT::RGBA || format == Frame::COLOR_FORMAT::BGRA) ? 4 : 3;
+        }
+    }
+
+    Frame::Frame()
+        : mWidth(0), mHeight(0), mTimestamp(0.0f), mFormat(COLOR_FORMAT::BGR)
+    {
+    }
+
+    Frame::Frame(const int width, const int height, uint8_t * pixels, const COLOR_FORMAT format, const float timestamp)
+        : mWidth(width), mHeight(height), mTimestamp(timestamp), mFormat(format)
+    {
+        const int n = width * height;
+        mBGR = std::shared_ptr<unsigned char>(new unsigned char[n * 3], std::default_delete<unsigned char[]>());
+        if (!pixels || n <= 0) return;
+
+        if (format == COLOR_FORMAT::BGR)
+        {
+            std::memcpy(mBGR.get(), pixels, n * 3);
+            return;
+        }
+
+        // Convert to BGR
+        const int c = channels(format);
+        const bool swap = (format == COLOR_FORMAT::RGB || format == COLOR_FORMAT::RGBA);
+        unsigned char *dst = mBGR.get();
+        for (int i = 0; i < n; i++, pixels += c, dst += 3)
+        {
+            dst[0] = swap ? pixels[2] : pixels[0];
+            dst[1] = pixels[1];
+            dst[2] = swap ? pixels[0] : pixels[2];
+        }
+    }
+
+    std::shared_ptr<unsigned char> Frame::getBGRByteArray()
+    {
+        return mBGR;
+    }
+
+    int Frame::getBGRByteArrayLength()
+    {
+        return mWidth * mHeight * 3;
+    }
+
+    int Frame::getWidth()
+    {
+        return mWidth;
+    }
+
+    int Frame::getHeight()
+    {
+        return mHeight;
+    }
+
+    float Frame::getTimestamp()
+    {
+        return mTimestamp;
+    }
+
+    void Frame::setTimestamp(const float timestamp)
+    {
+        mTimestamp = timestamp;
+    }
+
+    Frame::COLOR_FORMAT Frame::getColorFormat()
+    {
+        return mFormat;
+    }
+}
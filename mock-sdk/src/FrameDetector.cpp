@@ -0,0 +1,90 @@
+#include "FrameDetector.h"
+
+namespace affdex
+{
+    FrameDetector::FrameDetector(int bufferSize, float processFrameRate, unsigned int maxNumFaces,
+                                 FaceDetectorMode faceDetectorMode)
+        : Detector(maxNumFaces, faceDetectorMode), mBufferSize(bufferSize > 0 ? bufferSize : 1),
+          mProcessFrameRate(processFrameRate), mLastProcessed(-1.0f), mStop(false)
+    {
+    }
+
+    FrameDetector::~FrameDetector()
+    {
+        stop();
+    }
+
+    void FrameDetector::start()
+    {
+        Detector::start();
+        mStop = false;
+        mLastProcessed = -1.0f;
+        mThread = std::thread(&FrameDetector::run, this);
+    }
+
+    void FrameDetector::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lg(mQueueMutex);
+            mStop = true;
+            mQueue.clear();
+        }
+        mQueueCV.notify_all();
+        if (mThread.joinable()) mThread.join();
+        Detector::stop();
+    }
+
+    void FrameDetector::reset()
+    {
+        // No frame is being processed past this point, and none that was queued before will be
+        std::lock_guard<std::mutex> run(mRunMutex);
+        {
+            std::lock_guard<std::mutex> lg(mQueueMutex);
+            mQueue.clear();
+        }
+        mLastProcessed = -1.0f;
+        Detector::reset();
+    }
+
+    void FrameDetector::process(Frame frame)
+    {
+        checkRunning();
+        {
+            std::lock_guard<std::mutex> lg(mQueueMutex);
+            if ((int)mQueue.size() >= mBufferSize) return;    // Buffer full, the frame is dropped
+            mQueue.push_back(frame);
+        }
+        mQueueCV.notify_one();
+    }
+
+    void FrameDetector::run()
+    {
+        const float interval = mProcessFrameRate > 0.0f ? 1.0f / mProcessFrameRate : 0.0f;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mQueueMutex);
+                mQueueCV.wait(lock, [this]() { return mStop || !mQueue.empty(); });
+                if (mStop) return;
+            }
+
+            // The frame is taken under the run mutex, a reset() in between may have emptied the queue
+            std::lock_guard<std::mutex> run(mRunMutex);
+            Frame frame;
+            {
+                std::lock_guard<std::mutex> lock(mQueueMutex);
+                if (mStop) return;
+                if (mQueue.empty()) continue;
+                frame = mQueue.front();
+                mQueue.pop_front();
+            }
+
+            notifyCapture(frame);
+            if (mLastProcessed >= 0.0f && frame.getTimestamp() - mLastProcessed < interval - 1e-4f) continue;
+            mLastProcessed = frame.getTimestamp();
+
+            simulateProcessing();
+            analyze(frame);
+        }
+    }
+}
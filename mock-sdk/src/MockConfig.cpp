@@ -0,0 +1,27 @@
+#include "MockConfig.h"
+
+#include <mutex>
+
+namespace affdex
+{
+namespace mock
+{
+    namespace
+    {
+        std::mutex gConfigMutex;
+        MockConfig gConfig;
+    }
+
+    void setConfig(const MockConfig &config)
+    {
+        std::lock_guard<std::mutex> lg(gConfigMutex);
+        gConfig = config;
+    }
+
+    MockConfig getConfig()
+    {
+        std::lock_guard<std::mutex> lg(gConfigMutex);
+        return gConfig;
+    }
+}
+}
@@ -0,0 +1,19 @@
+#include "PhotoDetector.h"
+#include "SyntheticFaces.h"
+
+namespace affdex
+{
+    PhotoDetector::PhotoDetector(unsigned int maxNumFaces, FaceDetectorMode faceDetectorMode)
+        : Detector(maxNumFaces, faceDetectorMode), mCount(0)
+    {
+    }
+
+    void PhotoDetector::process(Frame frame)
+    {
+        checkRunning();
+        notifyCapture(frame);
+        simulateProcessing();
+        // Photos are independent, every one starts a fresh (but reproducible) set of faces
+        analyze(frame, mock::hashSeed(std::to_string(mCount++), mConfig.seed));
+    }
+}
@@ -0,0 +1,182 @@
+#include "SyntheticFaces.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace affdex
+{
+namespace mock
+{
+    namespace
+    {
+        // Landmark layout in face-box units (0,0 top left, 1,1 bottom right), roughly the SDK's 34 points:
+        // jaw, brows, nose, eyes, mouth.
+        const float LANDMARK_TEMPLATE[SyntheticFaces::NUM_LANDMARKS][2] = {
+            { 0.05f, 0.40f }, { 0.30f, 0.95f }, { 0.50f, 1.00f }, { 0.70f, 0.95f }, { 0.95f, 0.40f },
+            { 0.10f, 0.25f }, { 0.25f, 0.20f }, { 0.40f, 0.25f }, { 0.60f, 0.25f }, { 0.75f, 0.20f },
+            { 0.90f, 0.25f }, { 0.50f, 0.40f }, { 0.50f, 0.55f }, { 0.40f, 0.62f }, { 0.50f, 0.65f },
+            { 0.60f, 0.62f }, { 0.20f, 0.35f }, { 0.35f, 0.35f }, { 0.65f, 0.35f }, { 0.80f, 0.35f },
+            { 0.30f, 0.78f }, { 0.50f, 0.74f }, { 0.70f, 0.78f }, { 0.50f, 0.85f }, { 0.40f, 0.79f },
+            { 0.60f, 0.79f }, { 0.27f, 0.33f }, { 0.27f, 0.37f }, { 0.73f, 0.33f }, { 0.73f, 0.37f },
+            { 0.45f, 0.50f }, { 0.55f, 0.50f }, { 0.35f, 0.45f }, { 0.65f, 0.45f }
+        };
+
+        float clamp(float v, float lo, float hi)
+        {
+            return (std::min)((std::max)(v, lo), hi);
+        }
+    }
+
+    uint32_t hashSeed(const std::string &str, uint32_t seed)
+    {
+        // FNV-1a
+        uint32_t h = 2166136261u ^ seed;
+        for (unsigned char c : str)
+        {
+            h ^= c;
+            h *= 16777619u;
+        }
+        return h != 0 ? h : 1;    // 0 means "don't reseed" to the detectors
+    }
+
+    SyntheticFaces::SyntheticFaces(const MockConfig &config, unsigned int maxNumFaces)
+        : mConfig(config), mNumFaces((std::min)(config.numFaces, maxNumFaces)),
+          mRng(config.seed), mNormal(0.0f, 1.0f), mNextId(0)
+    {
+    }
+
+    void SyntheticFaces::reseed(uint32_t seed)
+    {
+        mRng.seed(seed);
+        mNormal.reset();
+        mTracks.clear();
+        mNextId = 0;
+    }
+
+    float SyntheticFaces::sampleMetric()
+    {
+        return clamp(mConfig.metricMean + mConfig.metricStdDev * mNormal(mRng), 0.0f, 100.0f);
+    }
+
+    float SyntheticFaces::lifetime()
+    {
+        if (mConfig.faceLifetime <= 0.0f) return -1.0f;
+        std::exponential_distribution<float> dist(1.0f / mConfig.faceLifetime);
+        return dist(mRng);
+    }
+
+    SyntheticFaces::Track SyntheticFaces::spawn(float timestamp, int slot)
+    {
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+        Track track;
+        // Lay the faces out side by side so their boxes don't overlap
+        const float cell = (float)mConfig.width / (std::max)(mNumFaces, 1u);
+        track.size = (std::min)(cell, (float)mConfig.height) * (0.4f + 0.2f * unit(mRng));
+        track.cx = cell * (slot + 0.5f);
+        track.cy = mConfig.height * (0.4f + 0.2f * unit(mRng));
+        const float life = lifetime();
+        track.expires = life < 0.0f ? -1.0f : timestamp + life;
+
+        Face &f = track.face;
+        f.id = mNextId++;
+        f.appearance.gender = unit(mRng) < 0.5f ? Gender::Male : Gender::Female;
+        f.appearance.glasses = unit(mRng) < 0.3f ? Glasses::Yes : Glasses::No;
+        f.appearance.age = (Age)(1 + (int)(unit(mRng) * 7) % 7);
+        f.appearance.ethnicity = (Ethnicity)(1 + (int)(unit(mRng) * 5) % 5);
+
+        float *values = (float *)&f.emotions;
+        for (size_t i = 0; i < sizeof(Emotions) / sizeof(float); i++) values[i] = sampleMetric();
+        values = (float *)&f.expressions;
+        for (size_t i = 0; i < sizeof(Expressions) / sizeof(float); i++) values[i] = sampleMetric();
+        values = (float *)&f.emojis;
+        for (int i = 0; i < (int)Emoji::Unknown; i++) values[i] = sampleMetric();
+        f.measurements.orientation.pitch = 0.0f;
+        f.measurements.orientation.yaw = 0.0f;
+        f.measurements.orientation.roll = 0.0f;
+        f.featurePoints.resize(NUM_LANDMARKS);
+        update(track);
+        return track;
+    }
+
+    void SyntheticFaces::update(Track &track)
+    {
+        Face &f = track.face;
+        const float alpha = clamp(mConfig.metricSmoothness, 0.0f, 1.0f);
+
+        // Metrics drift towards fresh samples from the configured distribution
+        float *values = (float *)&f.emotions;
+        for (size_t i = 0; i < sizeof(Emotions) / sizeof(float); i++) values[i] = alpha * values[i] + (1.0f - alpha) * sampleMetric();
+        values = (float *)&f.expressions;
+        for (size_t i = 0; i < sizeof(Expressions) / sizeof(float); i++) values[i] = alpha * values[i] + (1.0f - alpha) * sampleMetric();
+        values = (float *)&f.emojis;
+        int dominant = (int)Emoji::Unknown;
+        for (int i = 0; i < (int)Emoji::Unknown; i++)
+        {
+            values[i] = alpha * values[i] + (1.0f - alpha) * sampleMetric();
+            if (values[i] > 50.0f && (dominant == (int)Emoji::Unknown || values[i] > values[dominant])) dominant = i;
+        }
+        f.emojis.dominantEmoji = (Emoji)dominant;
+
+        // Valence is signed, positive when joy dominates the negative emotions
+        const float negative = (std::max)((std::max)(f.emotions.anger, f.emotions.disgust),
+                                          (std::max)(f.emotions.sadness, f.emotions.fear));
+        f.emotions.valence = clamp(f.emotions.joy - negative, -100.0f, 100.0f);
+
+        Orientation &o = f.measurements.orientation;
+        o.pitch = clamp(alpha * o.pitch + (1.0f - alpha) * 10.0f * mNormal(mRng), -60.0f, 60.0f);
+        o.yaw = clamp(alpha * o.yaw + (1.0f - alpha) * 15.0f * mNormal(mRng), -60.0f, 60.0f);
+        o.roll = clamp(alpha * o.roll + (1.0f - alpha) * 8.0f * mNormal(mRng), -60.0f, 60.0f);
+
+        // Slow head motion plus per-landmark jitter
+        track.cx = clamp(track.cx + 0.5f * mNormal(mRng), track.size / 2, mConfig.width - track.size / 2);
+        track.cy = clamp(track.cy + 0.5f * mNormal(mRng), track.size / 2, mConfig.height - track.size / 2);
+        const float left = track.cx - track.size / 2;
+        const float top = track.cy - track.size / 2;
+        for (int i = 0; i < NUM_LANDMARKS; i++)
+        {
+            FeaturePoint &p = f.featurePoints[i];
+            p.id = i;
+            p.x = left + LANDMARK_TEMPLATE[i][0] * track.size + mConfig.landmarkJitter * mNormal(mRng);
+            p.y = top + LANDMARK_TEMPLATE[i][1] * track.size + mConfig.landmarkJitter * mNormal(mRng);
+        }
+        f.measurements.interocularDistance = (LANDMARK_TEMPLATE[28][0] - LANDMARK_TEMPLATE[26][0]) * track.size;
+    }
+
+    std::map<FaceId, Face> SyntheticFaces::next(float timestamp, std::vector<FaceId> &found, std::vector<FaceId> &lost)
+    {
+        found.clear();
+        lost.clear();
+
+        if (mTracks.size() < mNumFaces)
+        {
+            for (unsigned int slot = mTracks.size(); slot < mNumFaces; slot++)
+            {
+                mTracks.push_back(spawn(timestamp, slot));
+                found.push_back(mTracks.back().face.id);
+            }
+        }
+        else
+        {
+            for (size_t slot = 0; slot < mTracks.size(); slot++)
+            {
+                Track &track = mTracks[slot];
+                if (track.expires >= 0.0f && timestamp >= track.expires)
+                {
+                    lost.push_back(track.face.id);
+                    track = spawn(timestamp, slot);
+                    found.push_back(track.face.id);
+                }
+                else
+                {
+                    update(track);
+                }
+            }
+        }
+
+        std::map<FaceId, Face> faces;
+        for (const Track &track : mTracks) faces[track.face.id] = track.face;
+        return faces;
+    }
+}
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <map>
+#include <random>
+#include <vector>
+
+#include "Face.h"
+#include "MockConfig.h"
+
+namespace affdex
+{
+namespace mock
+{
+    /** @brief Seeded generator of plausible, temporally coherent face results
+     */
+    class SyntheticFaces
+    {
+    public:
+
+        static const int NUM_LANDMARKS = 34;
+
+        SyntheticFaces(const MockConfig &config, unsigned int maxNumFaces);
+
+        /** @brief Restart the sequence from the given seed (forgets all faces)
+         */
+        void reseed(uint32_t seed);
+
+        /** @brief Advance to timestamp and produce the faces in view
+         * @param timestamp -- Frame timestamp in seconds
+         * @param found     -- [out] Ids of faces that appeared in this frame
+         * @param lost      -- [out] Ids of faces that disappeared before this frame
+         */
+        std::map<FaceId, Face> next(float timestamp, std::vector<FaceId> &found, std::vector<FaceId> &lost);
+
+    private:
+
+        struct Track
+        {
+            Face face;
+            float expires;
+            float cx;       // Face center and size in pixels
+            float cy;
+            float size;
+        };
+
+        Track spawn(float timestamp, int slot);
+        void update(Track &track);
+        float sampleMetric();
+        float lifetime();
+
+        const MockConfig mConfig;
+        const unsigned int mNumFaces;
+        std::mt19937 mRng;
+        std::normal_distribution<float> mNormal;
+        std::vector<Track> mTracks;
+        FaceId mNextId;
+    };
+
+    /** @brief Stable (platform independent) hash used to derive per-input seeds
+     */
+    uint32_t hashSeed(const std::string &str, uint32_t seed);
+}
+}
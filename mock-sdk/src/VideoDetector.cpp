@@ -0,0 +1,79 @@
+#include "VideoDetector.h"
+#include "SyntheticFaces.h"
+
+#include <chrono>
+#include <vector>
+
+namespace affdex
+{
+    VideoDetector::VideoDetector(float processFrameRate, unsigned int maxNumFaces, FaceDetectorMode faceDetectorMode)
+        : Detector(maxNumFaces, faceDetectorMode), mProcessFrameRate(processFrameRate), mCancel(false)
+    {
+    }
+
+    VideoDetector::~VideoDetector()
+    {
+        stop();
+    }
+
+    void VideoDetector::stop()
+    {
+        mCancel = true;
+        if (mThread.joinable()) mThread.join();
+        Detector::stop();
+    }
+
+    void VideoDetector::process(path filePath)
+    {
+        checkRunning();
+        // Like the SDK, a new video replaces the one being processed
+        mCancel = true;
+        if (mThread.joinable()) mThread.join();
+        mCancel = false;
+        mThread = std::thread(&VideoDetector::run, this, filePath);
+    }
+
+    void VideoDetector::run(path filePath)
+    {
+        const int width = mConfig.width;
+        const int height = mConfig.height;
+        const float frameRate = mConfig.frameRate > 0.0f ? mConfig.frameRate : 30.0f;
+        const float interval = mProcessFrameRate > 0.0f ? 1.0f / mProcessFrameRate : 0.0f;
+        const int numFrames = (int)(mConfig.duration * frameRate);
+
+        // A fixed gradient stands in for decoded video, it is copied into every Frame like a real decode would
+        std::vector<uint8_t> pixels(width * height * 3);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                uint8_t *p = &pixels[(y * width + x) * 3];
+                p[0] = (uint8_t)(x * 255 / (width > 1 ? width - 1 : 1));
+                p[1] = (uint8_t)(y * 255 / (height > 1 ? height - 1 : 1));
+                p[2] = 96;
+            }
+        }
+
+        const uint32_t seed = mock::hashSeed(std::string(filePath.begin(), filePath.end()), mConfig.seed);
+        const auto start = std::chrono::steady_clock::now();
+        float lastProcessed = -1.0f;
+        for (int i = 0; i < numFrames && !mCancel; i++)
+        {
+            const float timestamp = i / frameRate;
+            if (mConfig.realtime)
+            {
+                std::this_thread::sleep_until(start + std::chrono::microseconds((long long)(timestamp * 1e6)));
+            }
+
+            Frame frame(width, height, pixels.data(), Frame::COLOR_FORMAT::BGR, timestamp);
+            notifyCapture(frame);
+            if (lastProcessed >= 0.0f && timestamp - lastProcessed < interval - 1e-4f) continue;
+
+            simulateProcessing();
+            analyze(frame, lastProcessed < 0.0f ? seed : 0);
+            lastProcessed = timestamp;
+        }
+
+        if (!mCancel) notifyFinished();
+    }
+}
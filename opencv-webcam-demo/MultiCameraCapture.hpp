@@ -0,0 +1,421 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "Frame.h"
+#include "Face.h"
+#include "FrameDetector.h"
+#include "AffdexException.h"
+
+#include "BoundedQueue.hpp"
+#include "FramePool.hpp"
+#include "PlottingImageListener.hpp"
+#include "RateController.hpp"
+#include "ResultSink.hpp"
+#include "StatusListener.hpp"
+#include "ThreadPlacement.hpp"
+#include "PipelineMetrics.hpp"
+#include "Logger.h"
+
+using namespace affdex;
+
+/** @brief Captures from several cameras at once, each with its own FrameDetector
+ * Every camera gets a capture thread that reads its frames, submits them to its own FrameDetector and
+ * forwards the results into one bounded queue shared by all cameras.  A single sink thread writes each
+ * camera's results to its own csv and keeps the latest result of every camera for the display.  The display
+ * runs on the calling thread at its own rate, compositing the cameras into one tiled window, so a slow
+ * window never holds up capture and a fast camera doesn't redraw the window more often than needed.
+ * Throughput and latency are reported per camera every REPORT_PERIOD_S and at the end.
+ */
+class MultiCameraCapture
+{
+public:
+
+    struct Config
+    {
+        std::vector<int> cameraIds;
+        std::vector<int> resolution;               // width, height of every camera
+        int cameraFrameRate;
+        int processFrameRate;
+        int bufferLength;
+        unsigned int numFaces;
+        FaceDetectorMode faceMode;
+        affdex::path classifierPath;
+        boost::filesystem::path outputDir;         // camera<id>.csv is written here for every camera
+        bool draw;
+        int displayFrameRate;
+        double targetLatency;                      // Seconds, 0 for a fixed processFrameRate (see RateController)
+        int minFrameRate;
+        int maxFrameRate;
+    };
+
+    /** @brief MultiCameraCapture
+     * @param config  -- Cameras and detector configuration
+     * @param metrics -- Pipeline counters to update, or nullptr (must outlive the capture)
+     */
+    MultiCameraCapture(const Config &config, PipelineMetrics *metrics = nullptr)
+        : mConfig(config), mMetrics(metrics), mPlacement(nullptr), mSink(SINK_QUEUE_PER_CAMERA * std::max<size_t>(1, config.cameraIds.size())),
+          mStop(false), mActive(0)
+    {
+    }
+
+    /** @brief SetPlacement pins the capture, sink and display threads to cpus, call before run()
+     * The display runs on the thread calling run(), which stays pinned afterwards.
+     * @param placement -- Thread placement, or nullptr (must outlive the capture)
+     */
+    void setPlacement(ThreadPlacement *placement) { mPlacement = placement; }
+
+    /** @brief Run captures from all the cameras until they all fail, or until ESC is hit
+     * @return false if a camera or its csv could not be opened
+     */
+    bool run()
+    {
+        mCameras.clear();
+        for (size_t i = 0; i < mConfig.cameraIds.size(); i++)
+        {
+            std::unique_ptr<Camera> camera(new Camera(mConfig.cameraIds[i]));
+            if (!openCamera(*camera)) return false;
+            mCameras.push_back(std::move(camera));
+        }
+
+        LOG(LogLevel::Info) << "Capturing from " << mCameras.size() << " cameras";
+        mStop = false;
+        mActive = mCameras.size();
+        mStart = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> captureThreads;
+        for (size_t i = 0; i < mCameras.size(); i++)
+        {
+            captureThreads.push_back(std::thread(&MultiCameraCapture::captureLoop, this, i));
+        }
+        std::thread sinkThread(&MultiCameraCapture::sinkLoop, this);
+
+        if (mConfig.draw) displayLoop();
+        else waitLoop();
+
+        mStop = true;
+        for (std::thread &t : captureThreads) t.join();
+        mSink.close();
+        sinkThread.join();
+        for (auto &camera : mCameras) camera->csv.close();
+
+        LOG(LogLevel::Info) << "Capture finished after " << elapsed() << " s";
+        report(true);
+        return true;
+    }
+
+private:
+
+    const size_t SINK_QUEUE_PER_CAMERA = 64;
+    const int REPORT_PERIOD_S = 5;
+    const char * WINDOW_NAME = "analyze video";
+
+    struct Camera
+    {
+        explicit Camera(const int id)
+            : id(id), renderer(true), seen(0), drawn(0), captured(0), submitted(0), results(0),
+              latencySumMicros(0), latencyMaxMicros(0), reportedCaptured(0), reportedResults(0), failed(false)
+        {
+        }
+
+        const int id;
+        cv::VideoCapture capture;
+        std::unique_ptr<FrameDetector> detector;
+        std::unique_ptr<PlottingImageListener> listener;
+        StatusListener status;
+        std::unique_ptr<RateController> rateController;
+        std::ofstream csv;
+        std::unique_ptr<CsvSink> csvSink;
+
+        // Latest result for the display, guarded by mDisplayMutex
+        Frame latestFrame;
+        std::map<FaceId, Face> latestFaces;
+        uint64_t seen;
+        // Display thread only
+        PlottingImageListener renderer;
+        uint64_t drawn;
+        cv::Mat tile;
+
+        std::atomic<uint64_t> captured;
+        std::atomic<uint64_t> submitted;
+        std::atomic<uint64_t> results;
+        std::atomic<uint64_t> latencySumMicros;
+        std::atomic<uint64_t> latencyMaxMicros;
+        uint64_t reportedCaptured;
+        uint64_t reportedResults;
+        std::atomic<bool> failed;
+    };
+
+    struct Result
+    {
+        Result() : camera(0), latency(0) {}
+        size_t camera;
+        Frame frame;
+        std::map<FaceId, Face> faces;
+        double latency;
+    };
+
+    bool openCamera(Camera &camera)
+    {
+        const boost::filesystem::path csvPath = mConfig.outputDir / ("camera" + std::to_string(camera.id) + ".csv");
+        camera.csv.open(csvPath.c_str());
+        if (!camera.csv.is_open())
+        {
+            LOG(LogLevel::Error) << "Unable to open csv file " << csvPath;
+            return false;
+        }
+        camera.csvSink.reset(new CsvSink(camera.csv, mMetrics));
+
+        camera.capture.open(camera.id);
+        camera.capture.set(CV_CAP_PROP_FPS, mConfig.cameraFrameRate);
+        camera.capture.set(CV_CAP_PROP_FRAME_WIDTH, mConfig.resolution[0]);
+        camera.capture.set(CV_CAP_PROP_FRAME_HEIGHT, mConfig.resolution[1]);
+        if (!camera.capture.isOpened())
+        {
+            LOG(LogLevel::Error) << "Error opening camera " << camera.id;
+            return false;
+        }
+
+        float processFrameRate = mConfig.processFrameRate;
+        if (mConfig.targetLatency > 0)
+        {
+            camera.rateController.reset(new RateController(mConfig.targetLatency, mConfig.minFrameRate,
+                                                           mConfig.maxFrameRate, nullptr,
+                                                           "camera " + std::to_string(camera.id)));
+            processFrameRate = RateController::detectorFrameRate(mConfig.maxFrameRate);
+        }
+
+        camera.listener.reset(new PlottingImageListener(false));
+        camera.listener->setMetrics(mMetrics);
+        camera.detector.reset(new FrameDetector(mConfig.bufferLength, processFrameRate, mConfig.numFaces, mConfig.faceMode));
+        camera.detector->setClassifierPath(mConfig.classifierPath);
+        camera.detector->setDetectAllEmotions(true);
+        camera.detector->setDetectAllExpressions(true);
+        camera.detector->setDetectAllEmojis(true);
+        camera.detector->setDetectAllAppearances(true);
+        camera.detector->setImageListener(camera.listener.get());
+        camera.detector->setProcessStatusListener(&camera.status);
+        LOG(LogLevel::Info) << "Camera " << camera.id << " results will be written to " << csvPath;
+        return true;
+    }
+
+    double elapsed() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+    }
+
+    void captureLoop(const size_t index)
+    {
+        Camera &camera = *mCameras[index];
+        const std::string role = "camera " + std::to_string(camera.id);
+        ThreadPlacement::Slot slot;
+        if (mPlacement)
+        {
+            // The SDK threads inherit the affinity of the thread that starts the detector, keep them on its node
+            slot = mPlacement->next();
+            mPlacement->bind(slot, role, true);
+        }
+        try
+        {
+            // Starting a detector takes a while, every camera starts its own in parallel
+            camera.detector->start();
+            if (mPlacement) mPlacement->bind(slot, role);
+
+            // The detector copies the frame, so one buffer on this thread's node is read into over and over
+            FramePool frames(1, slot.node);
+            cv::Mat img = frames.next(mConfig.resolution[1], mConfig.resolution[0]);
+            while (!mStop && camera.status.isRunning())
+            {
+                if (!camera.capture.read(img))
+                {
+                    LOG(LogLevel::Error) << "Failed to read frame from camera " << camera.id;
+                    break;
+                }
+                camera.captured++;
+
+                // All the cameras share one clock, so their timestamps and latencies are comparable
+                Frame frame(img.size().width, img.size().height, img.data, Frame::COLOR_FORMAT::BGR, (float)elapsed());
+                if (!camera.rateController || camera.rateController->shouldSubmit(frame.getTimestamp()))
+                {
+                    camera.detector->process(frame);
+                    camera.submitted++;
+                    if (camera.rateController) camera.rateController->onSubmit(frame.getTimestamp());
+                }
+                forward(index);
+            }
+            camera.detector->stop();
+            forward(index);
+        }
+        catch (AffdexException ex)
+        {
+            LOG(LogLevel::Error) << "Camera " << camera.id << " failed: " << ex.what();
+            camera.failed = true;
+        }
+        mActive--;
+    }
+
+    /** Moves the camera's results into the shared sink queue, waiting for room */
+    void forward(const size_t index)
+    {
+        Camera &camera = *mCameras[index];
+        while (camera.listener->getDataSize() > 0)
+        {
+            std::pair<Frame, std::map<FaceId, Face> > dataPoint = camera.listener->getData();
+            Result result;
+            result.camera = index;
+            result.frame = dataPoint.first;
+            result.faces = dataPoint.second;
+            result.latency = elapsed() - result.frame.getTimestamp();
+            if (mMetrics) mMetrics->resultLatency.observe(result.latency);
+            if (camera.rateController) camera.rateController->onResult(result.frame.getTimestamp(), elapsed());
+            if (!mSink.push(std::move(result))) return;
+        }
+    }
+
+    void sinkLoop()
+    {
+        if (mPlacement) mPlacement->pin("sink");
+        Result result;
+        MetricBatch rows;
+        while (mSink.pop(result))
+        {
+            Camera &camera = *mCameras[result.camera];
+            rows.clear();
+            rows.append(result.frame.getTimestamp(), result.faces);
+            camera.csvSink->consume(result.frame, rows);
+
+            const uint64_t micros = result.latency > 0 ? (uint64_t)(result.latency * 1e6) : 0;
+            camera.results++;
+            camera.latencySumMicros += micros;
+            if (micros > camera.latencyMaxMicros) camera.latencyMaxMicros = micros;
+
+            if (mConfig.draw)
+            {
+                std::lock_guard<std::mutex> lg(mDisplayMutex);
+                camera.latestFrame = result.frame;
+                camera.latestFaces.swap(result.faces);
+                camera.seen++;
+            }
+        }
+        for (auto &camera : mCameras) camera->csvSink->finish();
+    }
+
+    /** Composites the latest result of every camera into one window at the display rate */
+    void displayLoop()
+    {
+        const int columns = (int)std::ceil(std::sqrt((double)mCameras.size()));
+        const int rows = (int)((mCameras.size() + columns - 1) / columns);
+        const int tileWidth = std::max(1, mConfig.resolution[0] / columns);
+        const int tileHeight = std::max(1, mConfig.resolution[1] / columns);
+        cv::Mat canvas(rows * tileHeight, columns * tileWidth, CV_8UC3, cv::Scalar(0, 0, 0));
+        if (mPlacement) mPlacement->pin("display");
+
+        const auto period = std::chrono::microseconds(1000000 / std::max(1, mConfig.displayFrameRate));
+        auto nextTick = std::chrono::steady_clock::now();
+        int lastReport = 0;
+        while (mActive > 0)
+        {
+            for (size_t i = 0; i < mCameras.size(); i++)
+            {
+                Camera &camera = *mCameras[i];
+                Frame frame;
+                std::map<FaceId, Face> faces;
+                {
+                    std::lock_guard<std::mutex> lg(mDisplayMutex);
+                    if (camera.seen == camera.drawn) continue;
+                    frame = camera.latestFrame;
+                    faces = camera.latestFaces;
+                    camera.drawn = camera.seen;
+                }
+                camera.tile = camera.renderer.render(faces, frame);
+                cv::Mat roi = canvas(cv::Rect((int)(i % columns) * tileWidth, (int)(i / columns) * tileHeight,
+                                              tileWidth, tileHeight));
+                cv::resize(camera.tile, roi, roi.size());
+            }
+            cv::imshow(WINDOW_NAME, canvas);
+            if (cv::waitKey(1) == 27 || escapePressed()) break;
+
+            const int sinceStart = (int)elapsed();
+            if (sinceStart / REPORT_PERIOD_S > lastReport)
+            {
+                lastReport = sinceStart / REPORT_PERIOD_S;
+                report(false);
+            }
+            nextTick += period;
+            std::this_thread::sleep_until(nextTick);
+        }
+    }
+
+    void waitLoop()
+    {
+        int lastReport = 0;
+        while (mActive > 0 && !escapePressed())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            const int sinceStart = (int)elapsed();
+            if (sinceStart / REPORT_PERIOD_S > lastReport)
+            {
+                lastReport = sinceStart / REPORT_PERIOD_S;
+                report(false);
+            }
+        }
+    }
+
+    static bool escapePressed()
+    {
+#ifdef _WIN32
+        return GetAsyncKeyState(VK_ESCAPE) != 0;
+#else //  _WIN32
+        return false;
+#endif
+    }
+
+    /** Logs every camera's frame rates and result latency, since the last report or over the whole run */
+    void report(const bool final)
+    {
+        const double now = elapsed();
+        const double window = final ? now : std::min<double>(now, REPORT_PERIOD_S);
+        for (auto &c : mCameras)
+        {
+            Camera &camera = *c;
+            const uint64_t captured = camera.captured;
+            const uint64_t results = camera.results;
+            const uint64_t newCaptured = final ? captured : captured - camera.reportedCaptured;
+            const uint64_t newResults = final ? results : results - camera.reportedResults;
+            camera.reportedCaptured = captured;
+            camera.reportedResults = results;
+
+            const double meanLatency = results > 0 ? camera.latencySumMicros / 1000.0 / results : 0.0;
+            LOG(LogLevel::Info) << "Camera " << camera.id << (camera.failed ? " (failed)" : "")
+                << ": cfps " << (window > 0 ? newCaptured / window : 0.0)
+                << " pfps " << (window > 0 ? newResults / window : 0.0)
+                << ", " << camera.submitted << " submitted, " << results << " results"
+                << ", latency mean " << meanLatency << " ms max " << camera.latencyMaxMicros / 1000.0 << " ms";
+        }
+    }
+
+    const Config mConfig;
+    PipelineMetrics *mMetrics;
+    ThreadPlacement *mPlacement;
+    std::vector<std::unique_ptr<Camera> > mCameras;
+    BoundedQueue<Result> mSink;
+    std::mutex mDisplayMutex;
+    std::atomic<bool> mStop;
+    std::atomic<size_t> mActive;
+    std::chrono::steady_clock::time_point mStart;
+};
@@ -13,8 +13,16 @@
 #include "AffdexException.h"
 
 #include "AFaceListener.hpp"
+#include "EventSink.hpp"
+#include "MetricSmoother.hpp"
+#include "MultiCameraCapture.hpp"
 #include "PlottingImageListener.hpp"
+#include "RateController.hpp"
 #include "StatusListener.hpp"
+#include "ThreadPlacement.hpp"
+#include "MetricsServer.h"
+#include "ResultBus.h"
+#include "Logger.h"
 
 using namespace std;
 using namespace affdex;
@@ -26,12 +34,13 @@ int main(int argsc, char ** argsv)
 {
     namespace po = boost::program_options; // abbreviate namespace
 
-    std::cerr << "Hit ESCAPE key to exit app.." << endl;
+    LOG(LogLevel::Info) << "Hit ESCAPE key to exit app..";
     shared_ptr<FrameDetector> frameDetector;
 
     try{
 
         const std::vector<int> DEFAULT_RESOLUTION{ 	1280, 720 };
+        const std::vector<int> DEFAULT_CAMERAS{ 0 };
 
         affdex::path DATA_FOLDER;
 
@@ -39,17 +48,31 @@ int main(int argsc, char ** argsv)
         int process_framerate = 30;
         int camera_framerate = 15;
         int buffer_length = 2;
-        int camera_id = 0;
+        std::vector<int> camera_ids;
+        std::string output_dir;
+        int display_framerate = 15;
+        std::string eventRulesPath;
+        std::string sparkline;
+        double historySeconds = 10;
+        std::string smoothFilter;
+        std::string smoothParamsPath;
+        MetricSmoother::Filter filter = MetricSmoother::Filter::Ema;
+        std::string busName;
+        size_t busCapacity = 4096;
         unsigned int nFaces = 1;
         bool draw_display = true;
         int faceDetectorMode = (int)FaceDetectorMode::LARGE_FACES;
-
-        float last_timestamp = -1.0f;
-        float capture_fps = -1.0f;
+        int target_latency = 0;
+        int min_framerate = 1;
+        int max_framerate = 0;
+        std::string metrics_endpoint;
+        std::string log_level;
+        std::string affinity;
+        AffinityPolicy affinityPolicy = AffinityPolicy::None;
+        std::vector<int> affinityCpus;
 
         const int precision = 2;
-        std::cerr.precision(precision);
-        std::cout.precision(precision);
+        Logger::instance().setPrecision(precision);
 
         po::options_description description("Project for demoing the Affdex SDK CameraDetector class (grabbing and processing frames from the camera).");
         description.add_options()
@@ -63,10 +86,25 @@ int main(int argsc, char ** argsv)
             ("pfps", po::value< int >(&process_framerate)->default_value(30), "Processing framerate.")
             ("cfps", po::value< int >(&camera_framerate)->default_value(30), "Camera capture framerate.")
             ("bufferLen", po::value< int >(&buffer_length)->default_value(30), "process buffer size.")
-            ("cid", po::value< int >(&camera_id)->default_value(0), "Camera ID.")
+            ("cid", po::value< std::vector<int> >(&camera_ids)->default_value(DEFAULT_CAMERAS, "0")->multitoken(), "Camera ID, or a list of IDs to capture from several cameras at once.")
+            ("outputDir", po::value< std::string >(&output_dir)->default_value("."), "Folder for the camera<id>.csv results when capturing from several cameras.")
+            ("displayFps", po::value< int >(&display_framerate)->default_value(15), "Refresh rate of the tiled display when capturing from several cameras.")
+            ("events", po::value< std::string >(&eventRulesPath), "Detect the events described in this rules file and write them to events.csv in --outputDir (single camera).")
+            ("sparkline", po::value< std::string >(&sparkline), "With --draw, plot the recent history of this metric (e.g. valence) under each face (single camera).")
+            ("history", po::value< double >(&historySeconds)->default_value(10), "Seconds of history kept per face for --sparkline.")
+            ("smooth", po::value< std::string >(&smoothFilter)->default_value("none"), "Smooth the metrics over time before they are drawn and written: none, ema or oneeuro (single camera).")
+            ("smoothParams", po::value< std::string >(&smoothParamsPath), "With --smooth, read per-metric smoothing parameters from this file.")
+            ("bus", po::value< std::string >(&busName), "Publish every frame's results on this shared memory result bus (e.g. /affdex) for other processes (single camera).")
+            ("busCapacity", po::value< size_t >(&busCapacity)->default_value(4096), "Records kept in the --bus ring for slow readers.")
             ("faceMode", po::value< int >(&faceDetectorMode)->default_value((int)FaceDetectorMode::LARGE_FACES), "Face detector mode (large faces vs small faces).")
             ("numFaces", po::value< unsigned int >(&nFaces)->default_value(1), "Number of faces to be tracked.")
             ("draw", po::value< bool >(&draw_display)->default_value(true), "Draw metrics on screen.")
+            ("targetLatency", po::value< int >(&target_latency)->default_value(0), "Adapt the processing framerate to hold this result latency in milliseconds (0 keeps --pfps fixed).")
+            ("minPfps", po::value< int >(&min_framerate)->default_value(1), "Lowest processing framerate with --targetLatency.")
+            ("maxPfps", po::value< int >(&max_framerate)->default_value(0), "Highest processing framerate with --targetLatency (0 uses --pfps).")
+            ("affinity", po::value< std::string >(&affinity)->default_value("none"), "Pin the sample's threads: none, compact, scatter or a cpu list such as 0,2,8-11.")
+            ("metrics", po::value< std::string >(&metrics_endpoint)->default_value(""), "Serve Prometheus metrics on [host:]port or unix:/path instead of logging every frame.")
+            ("logLevel", po::value< std::string >(&log_level)->default_value("info"), "Log level (debug, info, warning, error).")
             ;
         po::variables_map args;
         try
@@ -78,39 +116,183 @@ int main(int argsc, char ** argsv)
                 return 0;
             }
             po::notify(args);
+            LogLevel level;
+            if (!Logger::parseLevel(log_level, level))
+            {
+                throw po::validation_error(po::validation_error::invalid_option_value, "logLevel", log_level);
+            }
+            Logger::instance().setLevel(level);
+            if (busCapacity == 0) throw po::validation_error(po::validation_error::invalid_option_value, "busCapacity", "0");
+            if (smoothFilter != "none" && !MetricSmoother::parseFilter(smoothFilter, filter))
+            {
+                throw po::validation_error(po::validation_error::invalid_option_value, "smooth", smoothFilter);
+            }
+            if (!ThreadPlacement::parsePolicy(affinity, affinityPolicy, affinityCpus))
+            {
+                throw po::validation_error(po::validation_error::invalid_option_value, "affinity", affinity);
+            }
         }
         catch (po::error& e)
         {
-            std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
-            std::cerr << "For help, use the -h option." << std::endl << std::endl;
+            LOG(LogLevel::Error) << e.what();
+            LOG(LogLevel::Error) << "For help, use the -h option.";
             return 1;
         }
 
         if (!boost::filesystem::exists(DATA_FOLDER))
         {
-            std::cerr << "Folder doesn't exist: " << std::string(DATA_FOLDER.begin(), DATA_FOLDER.end()) << std::endl << std::endl;;
-            std::cerr << "Try specifying the folder through the command line" << std::endl;
-            std::cerr << description << std::endl;
+            LOG(LogLevel::Error) << "Folder doesn't exist: " << std::string(DATA_FOLDER.begin(), DATA_FOLDER.end());
+            LOG(LogLevel::Error) << "Try specifying the folder through the command line";
+            LOG(LogLevel::Info) << description;
             return 1;
         }
         if (resolution.size() != 2)
         {
-            std::cerr << "Only two numbers must be specified for resolution." << std::endl;
+            LOG(LogLevel::Error) << "Only two numbers must be specified for resolution.";
             return 1;
         }
         else if (resolution[0] <= 0 || resolution[1] <= 0)
         {
-            std::cerr << "Resolutions must be positive number." << std::endl;
+            LOG(LogLevel::Error) << "Resolutions must be positive number.";
             return 1;
         }
+        if (target_latency < 0 || min_framerate <= 0 || max_framerate < 0)
+        {
+            LOG(LogLevel::Error) << "--targetLatency, --minPfps and --maxPfps can't be negative, and --minPfps must be positive.";
+            return 1;
+        }
+        if (max_framerate == 0) max_framerate = process_framerate;
+        if (camera_ids.empty() || display_framerate <= 0)
+        {
+            LOG(LogLevel::Error) << "At least one camera ID is required, and --displayFps must be positive.";
+            return 1;
+        }
+
+        std::vector<EventRule> eventRules;
+        if (!eventRulesPath.empty())
+        {
+            std::string error;
+            if (!readEventRules(eventRulesPath, eventRules, error))
+            {
+                LOG(LogLevel::Error) << "Invalid event rules: " << error;
+                return 1;
+            }
+            if (camera_ids.size() > 1) LOG(LogLevel::Warning) << "--events is only supported with a single camera";
+        }
+        std::unique_ptr<MetricSmoother> smoother;
+        if (smoothFilter != "none")
+        {
+            smoother.reset(new MetricSmoother(filter));
+            std::string error;
+            if (!smoothParamsPath.empty() && !readSmoothingParams(smoothParamsPath, *smoother, error))
+            {
+                LOG(LogLevel::Error) << "Invalid smoothing parameters: " << error;
+                return 1;
+            }
+            if (camera_ids.size() > 1) LOG(LogLevel::Warning) << "--smooth is only supported with a single camera";
+        }
+        if (!busName.empty() && camera_ids.size() > 1) LOG(LogLevel::Warning) << "--bus is only supported with a single camera";
+
+        PipelineMetrics metrics;
+        std::unique_ptr<MetricsServer> metricsServer;
+        if (!metrics_endpoint.empty())
+        {
+            metricsServer.reset(new MetricsServer(metrics, metrics_endpoint));
+            if (!metricsServer->start())
+            {
+                LOG(LogLevel::Error) << "Unable to start metrics endpoint: " << metricsServer->getError();
+                return 1;
+            }
+            LOG(LogLevel::Info) << "Serving metrics on " << metrics_endpoint;
+        }
+
+        ThreadPlacement placement(affinityPolicy, affinityCpus);
+        ThreadPlacement *placementPtr = placement.enabled() ? &placement : nullptr;
+        if (affinityPolicy != AffinityPolicy::None) placement.report();
+
+        if (camera_ids.size() > 1)
+        {
+            MultiCameraCapture::Config config;
+            config.cameraIds = camera_ids;
+            config.resolution = resolution;
+            config.cameraFrameRate = camera_framerate;
+            config.processFrameRate = process_framerate;
+            config.bufferLength = buffer_length;
+            config.numFaces = nFaces;
+            config.faceMode = (affdex::FaceDetectorMode) faceDetectorMode;
+            config.classifierPath = DATA_FOLDER;
+            config.outputDir = output_dir;
+            config.draw = draw_display;
+            config.displayFrameRate = display_framerate;
+            config.targetLatency = target_latency / 1000.0;
+            config.minFrameRate = min_framerate;
+            config.maxFrameRate = max_framerate;
+            MultiCameraCapture capture(config, metricsServer ? &metrics : nullptr);
+            capture.setPlacement(placementPtr);
+            return capture.run() ? 0 : 1;
+        }
 
         std::ofstream csvFileStream;
+        std::ofstream eventsFileStream;
+        std::unique_ptr<EventSink> eventSink;
+        if (!eventRules.empty())
+        {
+            const boost::filesystem::path eventsPath = boost::filesystem::path(output_dir) / "events.csv";
+            eventsFileStream.open(eventsPath.string().c_str());
+            if (!eventsFileStream.is_open())
+            {
+                LOG(LogLevel::Error) << "Unable to open events file " << eventsPath;
+                return 1;
+            }
+            eventSink.reset(new EventSink(eventsFileStream, eventRules));
+            LOG(LogLevel::Info) << "Writing events to " << eventsPath;
+        }
 
-        std::cerr << "Initializing Affdex FrameDetector" << endl;
-        shared_ptr<FaceListener> faceListenPtr(new AFaceListener());
+        std::unique_ptr<ResultBusWriter> bus;
+        if (!busName.empty())
+        {
+            bus.reset(new ResultBusWriter(busName, busCapacity));
+            if (!bus->open())
+            {
+                LOG(LogLevel::Error) << "Unable to open result bus: " << bus->getError();
+                return 1;
+            }
+            LOG(LogLevel::Info) << "Publishing results on " << busName;
+        }
+
+        LOG(LogLevel::Info) << "Initializing Affdex FrameDetector";
+        // The tracks keep the recent history of every face for the sparklines
+        std::unique_ptr<FaceTrackStore> trackStore;
+        int sparklineMetric = -1;
+        if (!sparkline.empty() && draw_display)
+        {
+            trackStore.reset(new FaceTrackStore(historySeconds, std::max(process_framerate, max_framerate)));
+            sparklineMetric = trackStore->metricIndex(sparkline);
+            if (sparklineMetric < 0)
+            {
+                LOG(LogLevel::Error) << "Unknown metric for --sparkline: " << sparkline;
+                return 1;
+            }
+        }
+        shared_ptr<AFaceListener> faceListenPtr(new AFaceListener(trackStore.get(), smoother.get()));
+        if (eventSink) faceListenPtr->addSink(eventSink.get());
         shared_ptr<PlottingImageListener> listenPtr(new PlottingImageListener(csvFileStream, draw_display));    // Instanciate the ImageListener class
+        if (metricsServer) listenPtr->setMetrics(&metrics);
+        if (trackStore) listenPtr->setTrackStore(trackStore.get(), sparklineMetric);
         shared_ptr<StatusListener> videoListenPtr(new StatusListener());
-        frameDetector = make_shared<FrameDetector>(buffer_length, process_framerate, nFaces, (affdex::FaceDetectorMode) faceDetectorMode);        // Init the FrameDetector Class
+
+        // With a latency target the controller decides which frames to submit, the detector must not skip any more
+        std::unique_ptr<RateController> rateController;
+        float detector_framerate = process_framerate;
+        if (target_latency > 0)
+        {
+            rateController.reset(new RateController(target_latency / 1000.0, min_framerate, max_framerate,
+                                                    metricsServer ? &metrics : nullptr));
+            detector_framerate = RateController::detectorFrameRate(max_framerate);
+            LOG(LogLevel::Info) << "Adapting the processing framerate between " << min_framerate << " and "
+                << max_framerate << " to hold a latency of " << target_latency << " ms";
+        }
+        frameDetector = make_shared<FrameDetector>(buffer_length, detector_framerate, nFaces, (affdex::FaceDetectorMode) faceDetectorMode);        // Init the FrameDetector Class
 
         //Initialize detectors
         frameDetector->setClassifierPath(DATA_FOLDER);
@@ -122,19 +304,19 @@ int main(int argsc, char ** argsv)
         frameDetector->setFaceListener(faceListenPtr.get());
         frameDetector->setProcessStatusListener(videoListenPtr.get());
 
-        cv::VideoCapture webcam(camera_id);    //Connect to the first webcam
+        cv::VideoCapture webcam(camera_ids[0]);    //Connect to the first webcam
         webcam.set(CV_CAP_PROP_FPS, camera_framerate);    //Set webcam framerate.
         webcam.set(CV_CAP_PROP_FRAME_WIDTH, resolution[0]);
         webcam.set(CV_CAP_PROP_FRAME_HEIGHT, resolution[1]);
-        std::cerr << "Setting the webcam frame rate to: " << camera_framerate << std::endl;
+        LOG(LogLevel::Info) << "Setting the webcam frame rate to: " << camera_framerate;
         auto start_time = std::chrono::system_clock::now();
         if (!webcam.isOpened())
         {
-            std::cerr << "Error opening webcam!" << std::endl;
+            LOG(LogLevel::Error) << "Error opening webcam!";
             return 1;
         }
 
-        std::cout << "Max num of faces set to: " << frameDetector->getMaxNumberFaces() << std::endl;
+        LOG(LogLevel::Info) << "Max num of faces set to: " << frameDetector->getMaxNumberFaces();
         std::string mode;
         switch (frameDetector->getFaceDetectorMode())
         {
@@ -147,28 +329,35 @@ int main(int argsc, char ** argsv)
         default:
             break;
         }
-        std::cout << "Face detector mode set to: " << mode << std::endl;
+        LOG(LogLevel::Info) << "Face detector mode set to: " << mode;
 
-        //Start the frame detector thread.
+        //Start the frame detector thread, on this thread's node when pinning (its threads inherit the affinity)
+        const ThreadPlacement::Slot slot = placement.next();
+        placement.bind(slot, "capture", true);
         frameDetector->start();
+        placement.bind(slot, "capture");
+
+        MetricBatch rows;       // The results of the current frame, smoothed, for the display and the event sink
 
         do{
             cv::Mat img;
             if (!webcam.read(img))    //Capture an image from the camera
             {
-                std::cerr << "Failed to read frame from webcam! " << std::endl;
+                LOG(LogLevel::Error) << "Failed to read frame from webcam! ";
                 break;
             }
 
-            //Calculate the Image timestamp and the capture frame rate;
+            //Calculate the Image timestamp
             const auto milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start_time);
             const double seconds = milliseconds.count() / 1000.f;
 
             // Create a frame
             Frame f(img.size().width, img.size().height, img.data, Frame::COLOR_FORMAT::BGR, seconds);
-            capture_fps = 1.0f / (seconds - last_timestamp);
-            last_timestamp = seconds;
-            frameDetector->process(f);  //Pass the frame to detector
+            if (!rateController || rateController->shouldSubmit(seconds))
+            {
+                frameDetector->process(f);  //Pass the frame to detector
+                if (rateController) rateController->onSubmit(f.getTimestamp());
+            }
 
             // For each frame processed
             if (listenPtr->getDataSize() > 0)
@@ -178,19 +367,37 @@ int main(int argsc, char ** argsv)
                 Frame frame = dataPoint.first;
                 std::map<FaceId, Face> faces = dataPoint.second;
 
+                // Frame timestamps are wall-clock seconds since start_time, so the age of the result is the detector latency
+                if (metricsServer || rateController)
+                {
+                    const auto age = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start_time);
+                    if (metricsServer) metrics.resultLatency.observe(age.count() / 1000.f - frame.getTimestamp());
+                    if (rateController) rateController->onResult(frame.getTimestamp(), age.count() / 1000.0);
+                }
+
+                rows.clear();
+                rows.append(frame.getTimestamp(), faces);
+                if (smoother) smoother->apply(rows);
+                if (trackStore) trackStore->add(rows);
+                if (bus) bus->publish(rows);
+
                 // Draw metrics to the GUI
                 if (draw_display)
                 {
-                    listenPtr->draw(faces, frame);
+                    listenPtr->draw(rows, frame);
                 }
 
-                std::cerr << "timestamp: " << frame.getTimestamp()
-                    << " cfps: " << listenPtr->getCaptureFrameRate()
-                    << " pfps: " << listenPtr->getProcessingFrameRate()
-                    << " faces: " << faces.size() << endl;
+                if (!metricsServer)
+                {
+                    LOG_EVERY_MS(LogLevel::Info, 1000) << "timestamp: " << frame.getTimestamp()
+                        << " cfps: " << listenPtr->getCaptureFrameRate()
+                        << " pfps: " << listenPtr->getProcessingFrameRate()
+                        << " faces: " << faces.size();
+                }
 
                 //Output metrics to the file
                 //listenPtr->outputToFile(faces, frame.getTimestamp());
+                if (eventSink) eventSink->consume(frame, rows);
             }
 
 
@@ -201,27 +408,29 @@ int main(int argsc, char ** argsv)
 #else //  _WIN32
         while (videoListenPtr->isRunning());//(cv::waitKey(20) != -1);
 #endif
-        std::cerr << "Stopping FrameDetector Thread" << endl;
+        LOG(LogLevel::Info) << "Stopping FrameDetector Thread";
         frameDetector->stop();    //Stop frame detector thread
+        if (eventSink) eventSink->finish();
+        if (bus) bus->close();
     }
     catch (AffdexException ex)
     {
-        std::cerr << "Encountered an AffdexException " << ex.what();
+        LOG(LogLevel::Error) << "Encountered an AffdexException " << ex.what();
         return 1;
     }
     catch (std::runtime_error err)
     {
-        std::cerr << "Encountered a runtime error " << err.what();
+        LOG(LogLevel::Error) << "Encountered a runtime error " << err.what();
         return 1;
     }
     catch (std::exception ex)
     {
-        std::cerr << "Encountered an exception " << ex.what();
+        LOG(LogLevel::Error) << "Encountered an exception " << ex.what();
         return 1;
     }
     catch (...)
     {
-        std::cerr << "Encountered an unhandled exception ";
+        LOG(LogLevel::Error) << "Encountered an unhandled exception ";
         return 1;
     }
 
@@ -0,0 +1,423 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/algorithm/string.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "VideoDetector.h"
+#include "PhotoDetector.h"
+#include "AffdexException.h"
+
+#include "DetectorPool.hpp"
+#include "ThreadPlacement.hpp"
+
+#include "PlottingImageListener.hpp"
+#include "StatusListener.hpp"
+#include "PipelineMetrics.hpp"
+#include "Logger.h"
+
+using namespace affdex;
+
+/** @brief IsVideoFile checks the extension against the containers the VideoDetector handles
+ */
+inline bool isVideoFile(const boost::filesystem::path &file)
+{
+    static const char * const VIDEO_EXTS[] = { ".avi", ".mov", ".flv", ".webm", ".wmv", ".mp4" };
+    const std::string ext = boost::algorithm::to_lower_copy(file.extension().string());
+    for (const char *videoExt : VIDEO_EXTS)
+    {
+        if (ext == videoExt) return true;
+    }
+    return false;
+}
+
+/** @brief IsPhotoFile checks the extension against the image formats handed to the PhotoDetector
+ */
+inline bool isPhotoFile(const boost::filesystem::path &file)
+{
+    static const char * const PHOTO_EXTS[] = { ".jpg", ".jpeg", ".png", ".bmp", ".tif", ".tiff" };
+    const std::string ext = boost::algorithm::to_lower_copy(file.extension().string());
+    for (const char *photoExt : PHOTO_EXTS)
+    {
+        if (ext == photoExt) return true;
+    }
+    return false;
+}
+
+/** @brief ListDirectory returns the video and photo files directly inside a folder (not recursive)
+ */
+inline std::vector<boost::filesystem::path> listDirectory(const boost::filesystem::path &dir)
+{
+    std::vector<boost::filesystem::path> files;
+    for (boost::filesystem::directory_iterator it(dir), end; it != end; ++it)
+    {
+        if (boost::filesystem::is_regular_file(it->status()) && (isVideoFile(it->path()) || isPhotoFile(it->path())))
+        {
+            files.push_back(it->path());
+        }
+    }
+    return files;
+}
+
+/** @brief ReadManifest reads one file path per line, skipping blank lines and lines starting with '#'
+ * Relative paths are resolved against the working directory.
+ * @return false if the manifest can't be opened
+ */
+inline bool readManifest(const boost::filesystem::path &manifest, std::vector<boost::filesystem::path> &files)
+{
+    std::ifstream in(manifest.c_str());
+    if (!in.is_open()) return false;
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        const size_t first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos || line[first] == '#') continue;
+        const size_t last = line.find_last_not_of(" \t\r");
+        files.push_back(boost::filesystem::path(line.substr(first, last - first + 1)));
+    }
+    return true;
+}
+
+/** @brief Runs a list of videos and photos through a fixed number of concurrent detectors
+ * Every worker thread processes either videos or photos, checking a started VideoDetector or
+ * PhotoDetector out of a DetectorPool sized to the workers for each file, so the detector start() cost
+ * is paid once per worker instead of once per file.  Workers are split between the two detector types in
+ * proportion to the bytes of each kind of input, with at least one worker per kind present.
+ *
+ * Scheduling is work stealing: files are dealt out largest first to the least loaded worker of the
+ * matching type, each worker takes its own files from the front of its deque, and a worker that runs
+ * dry steals from the back of the deque of the busiest worker of the same type.  Clip lengths that
+ * vary by orders of magnitude then still keep every worker busy until the end of the run.
+ *
+ * The results of each file are written next to it, with the extension replaced by .csv.
+ */
+class BatchProcessor
+{
+public:
+
+    /** @brief BatchProcessor
+     * @param settings  -- Detector configuration
+     * @param numWorkers -- Number of concurrent detectors
+     * @param metrics    -- Pipeline counters to update, or nullptr (must outlive the processor)
+     */
+    BatchProcessor(const DetectorSettings &settings, const unsigned int numWorkers, PipelineMetrics *metrics = nullptr)
+        : mSettings(settings), mNumWorkers(std::max(1u, numWorkers)), mMetrics(metrics),
+          mPlacement(nullptr), mTotal(0), mCompleted(0), mFailed(0)
+    {
+    }
+
+    /** @brief SetPlacement pins the worker threads to cpus, call before run()
+     * @param placement -- Thread placement, or nullptr (must outlive the processor)
+     */
+    void setPlacement(ThreadPlacement *placement) { mPlacement = placement; }
+
+    /** @brief Run processes every file and returns when all of them are done
+     * @param files  -- Videos and photos to process
+     * @return number of files that failed
+     */
+    size_t run(const std::vector<boost::filesystem::path> &files)
+    {
+        std::vector<Job> jobs;
+        size_t counts[2] = { 0, 0 };
+        uintmax_t bytes[2] = { 0, 0 };
+        for (const boost::filesystem::path &file : files)
+        {
+            Job job;
+            job.file = file;
+            if (isVideoFile(file)) job.kind = VIDEO;
+            else if (isPhotoFile(file)) job.kind = PHOTO;
+            else
+            {
+                LOG(LogLevel::Warning) << "Skipping " << file << ", not a video or photo file";
+                continue;
+            }
+            boost::system::error_code ec;
+            job.size = boost::filesystem::file_size(file, ec);
+            if (ec)
+            {
+                LOG(LogLevel::Warning) << "Skipping " << file << ": " << ec.message();
+                continue;
+            }
+            counts[job.kind]++;
+            bytes[job.kind] += job.size;
+            jobs.push_back(job);
+        }
+        std::sort(jobs.begin(), jobs.end(), [](const Job &a, const Job &b) { return a.size > b.size; });
+
+        mTotal = jobs.size();
+        mCompleted = 0;
+        mFailed = 0;
+        createWorkers(jobs, counts, bytes);
+
+        unsigned int numVideo = 0;
+        for (const std::unique_ptr<Worker> &w : mWorkers) numVideo += (w->kind == VIDEO);
+        const unsigned int numPhoto = (unsigned int)mWorkers.size() - numVideo;
+        LOG(LogLevel::Info) << "Processing " << mTotal << " files with " << numVideo << " video and "
+            << numPhoto << " photo detectors";
+
+        const auto startT = std::chrono::steady_clock::now();
+        std::vector<unsigned int> capacity(3, 0);
+        capacity[(int)DetectorType::Video] = numVideo;
+        capacity[(int)DetectorType::Photo] = numPhoto;
+        mPool.reset(new DetectorPool(mSettings, capacity, mMetrics));
+        mPool->setPlacement(mPlacement);
+        try
+        {
+            mPool->warmUp(DetectorType::Video, numVideo);
+            mPool->warmUp(DetectorType::Photo, numPhoto);
+        }
+        catch (AffdexException ex)
+        {
+            // Workers retry starting their detector on checkout and fail the files if it still doesn't work
+            LOG(LogLevel::Error) << "Unable to start the detectors: " << ex.what();
+        }
+        LOG(LogLevel::Info) << "Detectors started in "
+            << std::chrono::duration<double>(std::chrono::steady_clock::now() - startT).count() << " s";
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < mWorkers.size(); i++)
+        {
+            threads.push_back(std::thread(&BatchProcessor::worker, this, i));
+        }
+        for (std::thread &t : threads) t.join();
+        mPool.reset();
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startT).count();
+
+        LOG(LogLevel::Info) << "Batch finished: " << mCompleted << " of " << mTotal << " files processed, "
+            << mFailed << " failed, in " << elapsed << " s";
+        for (size_t i = 0; i < mWorkers.size(); i++)
+        {
+            const Worker &w = *mWorkers[i];
+            LOG(LogLevel::Info) << "  worker " << i << " (" << (w.kind == VIDEO ? "video" : "photo") << "): "
+                << w.processed << " files, " << w.stolen << " stolen, busy " << w.busy << " s, utilization "
+                << (elapsed > 0 ? 100.0 * w.busy / elapsed : 0.0) << "%";
+        }
+        return mFailed;
+    }
+
+private:
+
+    enum JobKind { VIDEO = 0, PHOTO = 1 };
+
+    struct Job
+    {
+        boost::filesystem::path file;
+        uintmax_t size;
+        JobKind kind;
+    };
+
+    struct Worker
+    {
+        explicit Worker(JobKind k) : kind(k), queuedBytes(0), processed(0), stolen(0), busy(0) {}
+        const JobKind kind;
+        std::mutex mutex;           // Guards jobs and queuedBytes
+        std::deque<Job> jobs;
+        uintmax_t queuedBytes;
+        size_t processed;           // Statistics, only touched by the owning thread
+        size_t stolen;
+        double busy;
+    };
+
+    void createWorkers(const std::vector<Job> &jobs, const size_t counts[2], const uintmax_t bytes[2])
+    {
+        // Split the workers between the detector types by the bytes each has to chew through
+        unsigned int numPhoto = 0;
+        if (counts[PHOTO] > 0)
+        {
+            const double share = (double)bytes[PHOTO] / std::max<uintmax_t>(1, bytes[VIDEO] + bytes[PHOTO]);
+            numPhoto = std::max(1u, (unsigned int)(share * mNumWorkers + 0.5));
+        }
+        unsigned int numVideo = mNumWorkers > numPhoto ? mNumWorkers - numPhoto : 0;
+        if (counts[VIDEO] > 0 && numVideo == 0)
+        {
+            if (numPhoto > 1) numPhoto--;
+            numVideo = 1;
+        }
+
+        mWorkers.clear();
+        for (unsigned int i = 0; i < numVideo; i++) mWorkers.emplace_back(new Worker(VIDEO));
+        for (unsigned int i = 0; i < numPhoto; i++) mWorkers.emplace_back(new Worker(PHOTO));
+
+        // Largest first to the least loaded worker of the matching type
+        for (const Job &job : jobs)
+        {
+            Worker *target = nullptr;
+            for (const std::unique_ptr<Worker> &w : mWorkers)
+            {
+                if (w->kind == job.kind && (!target || w->queuedBytes < target->queuedBytes)) target = w.get();
+            }
+            target->jobs.push_back(job);
+            target->queuedBytes += job.size;
+        }
+    }
+
+    bool popOwn(Worker &self, Job &job)
+    {
+        std::lock_guard<std::mutex> lg(self.mutex);
+        if (self.jobs.empty()) return false;
+        job = self.jobs.front();
+        self.jobs.pop_front();
+        self.queuedBytes -= job.size;
+        return true;
+    }
+
+    bool steal(Worker &self, Job &job)
+    {
+        // Retry until every same-type deque is seen empty, a victim may be drained between the scan and the lock
+        for (;;)
+        {
+            Worker *victim = nullptr;
+            uintmax_t most = 0;
+            for (const std::unique_ptr<Worker> &w : mWorkers)
+            {
+                if (w.get() == &self || w->kind != self.kind) continue;
+                std::lock_guard<std::mutex> lg(w->mutex);
+                if (!w->jobs.empty() && (!victim || w->queuedBytes > most))
+                {
+                    victim = w.get();
+                    most = w->queuedBytes;
+                }
+            }
+            if (!victim) return false;
+
+            std::lock_guard<std::mutex> lg(victim->mutex);
+            if (victim->jobs.empty()) continue;
+            job = victim->jobs.back();
+            victim->jobs.pop_back();
+            victim->queuedBytes -= job.size;
+            self.stolen++;
+            return true;
+        }
+    }
+
+    void worker(const size_t index)
+    {
+        Worker &self = *mWorkers[index];
+        if (mPlacement) mPlacement->pin("worker " + std::to_string(index));
+
+        const DetectorType type = self.kind == VIDEO ? DetectorType::Video : DetectorType::Photo;
+
+        Job job;
+        while (popOwn(self, job) || steal(self, job))
+        {
+            const auto startT = std::chrono::steady_clock::now();
+
+            boost::filesystem::path csvPath(job.file);
+            csvPath.replace_extension(".csv");
+            std::ofstream csvFileStream(csvPath.c_str());
+            if (!csvFileStream.is_open())
+            {
+                LOG(LogLevel::Error) << "Unable to open csv file " << csvPath;
+                mFailed++;
+                continue;
+            }
+
+            DetectorPool::Lease lease;
+            try
+            {
+                lease = mPool->checkout(type);
+                lease.listener().setOutputStream(csvFileStream);
+
+                const bool ok = self.kind == VIDEO ? processVideo(&lease.as<VideoDetector>(), lease.listener(), job.file)
+                                                   : processPhoto(&lease.as<PhotoDetector>(), lease.listener(), job.file);
+                if (!ok)
+                {
+                    mFailed++;
+                    // A detector that failed or never answered may still deliver results, don't reuse it
+                    lease.discard();
+                    self.busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - startT).count();
+                    continue;
+                }
+            }
+            catch (AffdexException ex)
+            {
+                LOG(LogLevel::Error) << "Worker " << index << " failed on " << job.file << ": " << ex.what();
+                mFailed++;
+                // The detector may be left in an unknown state, the pool starts a fresh one for the next file
+                if (lease.valid()) lease.discard();
+                self.busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - startT).count();
+                continue;
+            }
+            csvFileStream.close();
+
+            const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startT).count();
+            self.busy += elapsed;
+            self.processed++;
+            const size_t completed = ++mCompleted;
+            LOG(LogLevel::Info) << "[" << completed << "/" << mTotal << "] " << job.file
+                << " -> " << csvPath << " (" << elapsed << " s, worker " << index << ")";
+        }
+    }
+
+    bool processVideo(VideoDetector *detector, PlottingImageListener &listener, const boost::filesystem::path &file)
+    {
+        StatusListener status;
+        detector->setProcessStatusListener(&status);
+        detector->process(affdex::path(file.native()));
+
+        while (status.isRunning() || listener.getDataSize() > 0)
+        {
+            if (listener.waitForData(std::chrono::milliseconds(10)))
+            {
+                std::pair<Frame, std::map<FaceId, Face> > dataPoint = listener.getData();
+                listener.outputToFile(dataPoint.second, dataPoint.first.getTimestamp());
+            }
+        }
+        detector->setProcessStatusListener(nullptr);
+        if (status.failed())
+        {
+            LOG(LogLevel::Error) << "Processing failed for " << file;
+            return false;
+        }
+        return true;
+    }
+
+    bool processPhoto(PhotoDetector *detector, PlottingImageListener &listener, const boost::filesystem::path &file)
+    {
+        cv::Mat img = cv::imread(file.string());
+        if (img.empty())
+        {
+            LOG(LogLevel::Error) << "Unable to read image " << file;
+            return false;
+        }
+        Frame frame(img.size().width, img.size().height, img.data, Frame::COLOR_FORMAT::BGR);
+
+        // The results may be delivered after process() returns, wait for them
+        detector->process(frame);
+        if (!listener.waitForData(std::chrono::milliseconds(RESULT_TIMEOUT_MS)))
+        {
+            LOG(LogLevel::Error) << "No results for " << file << " after " << RESULT_TIMEOUT_MS << " ms";
+            return false;
+        }
+        while (listener.getDataSize() > 0)
+        {
+            std::pair<Frame, std::map<FaceId, Face> > dataPoint = listener.getData();
+            listener.outputToFile(dataPoint.second, dataPoint.first.getTimestamp());
+        }
+        return true;
+    }
+
+    const int RESULT_TIMEOUT_MS = 10000;
+
+    const DetectorSettings mSettings;
+    const unsigned int mNumWorkers;
+    PipelineMetrics *mMetrics;
+    ThreadPlacement *mPlacement;
+
+    std::unique_ptr<DetectorPool> mPool;
+    std::vector<std::unique_ptr<Worker> > mWorkers;
+    size_t mTotal;
+    std::atomic<size_t> mCompleted;
+    std::atomic<size_t> mFailed;
+};
@@ -0,0 +1,463 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "FrameDetector.h"
+#include "ImageListener.h"
+#include "FaceListener.h"
+#include "AffdexException.h"
+
+#include "DetectorPool.hpp"
+#include "FramePool.hpp"
+#include "FrameSampler.hpp"
+#include "MPMCQueue.hpp"
+#include "MetricSmoother.hpp"
+#include "ResultSink.hpp"
+#include "ThreadPlacement.hpp"
+#include "PipelineMetrics.hpp"
+#include "Logger.h"
+
+using namespace affdex;
+
+/** @brief Runs a video through decode, detect and sink stages connected by bounded lock-free queues
+ *
+ *   decode thread --[decode queue]--> detect thread --> FrameDetector --[sink queues]--> sink threads
+ *
+ * The decode thread reads the frames the detector will analyze at --pfps (see FrameSampler) and queues them,
+ * so decoding the next frames overlaps the detection of the current ones.  The detect thread hands them to a FrameDetector,
+ * keeping no more frames in flight than its buffer holds (it would drop the rest).  The detector's result
+ * callback converts each result to a MetricBatch (smoothing it, see setSmoother) and fans that one batch out
+ * to a queue per sink thread; every sink thread owns a subset of the sinks.
+ * A sink that is only for show (the display) can be lossy: when its thread falls behind it skips results
+ * instead of holding up the others.  A slow csv sink backs up into the detector, never into the decoder.
+ */
+class FramePipeline
+{
+public:
+
+    struct Config
+    {
+        Config() : decodeQueueSize(64), sinkQueueSize(256), sinkThreads(1) {}
+        size_t decodeQueueSize;     // Decoded frames waiting for the detector
+        size_t sinkQueueSize;       // Results waiting per sink thread
+        unsigned int sinkThreads;   // Threads the sinks are spread over
+    };
+
+    /** @brief FramePipeline
+     * @param settings -- Detector configuration (frameBufferSize is the detector's buffer)
+     * @param config   -- Queue sizes and thread counts
+     * @param metrics  -- Pipeline counters to update, or nullptr (must outlive the pipeline)
+     */
+    FramePipeline(const DetectorSettings &settings, const Config &config, PipelineMetrics *metrics = nullptr)
+        : mSettings(settings), mConfig(config), mMetrics(metrics), mPlacement(nullptr), mSmoother(nullptr), mStop(false), mDecodeDone(false), mDetectDone(false),
+          mDecodeBusy(0), mDetectBusy(0), mMaxDecodeDepth(0), mGrabbed(0), mRetrieved(0), mResults(0)
+    {
+        if (mSettings.frameBufferSize <= 0) mSettings.frameBufferSize = DEFAULT_BUFFER_SIZE;
+        if (mConfig.sinkThreads == 0) mConfig.sinkThreads = 1;
+    }
+
+    /** @brief SetPlacement pins the decode, detect and sink threads to cpus, call before run()
+     * The detect stage runs on the thread calling run(), which stays pinned afterwards.
+     * @param placement -- Thread placement, or nullptr (must outlive the pipeline)
+     */
+    void setPlacement(ThreadPlacement *placement) { mPlacement = placement; }
+
+    /** @brief SetSmoother smooths the metrics once, before they reach the sinks, call before run()
+     * @param smoother -- The smoother, or nullptr (must outlive the pipeline)
+     */
+    void setSmoother(MetricSmoother *smoother) { mSmoother = smoother; }
+
+    /** @brief AddSink registers a sink, call before run()
+     * @param sink  -- The sink, must outlive the pipeline
+     * @param lossy -- Skip results for this sink when it falls behind
+     */
+    void addSink(ResultSink *sink, const bool lossy = false)
+    {
+        mSinks.push_back(std::make_pair(sink, lossy));
+    }
+
+    /** @brief Run processes the video and returns once every sink has consumed every result
+     * @return false if the video couldn't be opened or the detector failed
+     */
+    bool run(const boost::filesystem::path &videoPath)
+    {
+        cv::VideoCapture capture(videoPath.string());
+        if (!capture.isOpened())
+        {
+            LOG(LogLevel::Error) << "Unable to open video " << videoPath;
+            return false;
+        }
+        double fps = capture.get(CV_CAP_PROP_FPS);
+        if (fps <= 0)
+        {
+            LOG(LogLevel::Warning) << "Unknown frame rate for " << videoPath << ", assuming 30 fps";
+            fps = 30;
+        }
+
+        // One queue per sink thread, sinks dealt out round robin
+        mSinkThreads.clear();
+        const unsigned int numSinkThreads = std::max(1u, std::min<unsigned int>(mConfig.sinkThreads, (unsigned int)mSinks.size()));
+        for (unsigned int i = 0; i < numSinkThreads; i++)
+        {
+            mSinkThreads.emplace_back(new SinkThread(mConfig.sinkQueueSize));
+        }
+        for (size_t i = 0; i < mSinks.size(); i++)
+        {
+            SinkThread &t = *mSinkThreads[i % numSinkThreads];
+            t.sinks.push_back(mSinks[i].first);
+            t.lossy = (t.sinks.size() == 1 ? true : t.lossy) && mSinks[i].second;
+        }
+
+        MPMCQueue<Decoded> decodeQueue(mConfig.decodeQueueSize);
+        ResultFanOut fanOut(*this);
+        FrameDetector detector(mSettings.frameBufferSize, (float)mSettings.processFrameRate, mSettings.numFaces, mSettings.faceMode);
+        detector.setClassifierPath(mSettings.classifierPath);
+        detector.setDetectAllEmotions(true);
+        detector.setDetectAllExpressions(true);
+        detector.setDetectAllEmojis(true);
+        detector.setDetectAllAppearances(true);
+        detector.setImageListener(&fanOut);
+        detector.setFaceListener(&fanOut);
+
+        mStop = false;
+        mDecodeDone = false;
+        mDetectDone = false;
+        mDecodeBusy = mDetectBusy = 0;
+        mMaxDecodeDepth = 0;
+        mGrabbed = mRetrieved = 0;
+        mResults = 0;
+        const auto startT = std::chrono::steady_clock::now();
+        // The SDK threads inherit the affinity of the thread that starts the detector: the detect thread's node
+        ThreadPlacement::Slot detectSlot;
+        if (mPlacement)
+        {
+            detectSlot = mPlacement->next();
+            mPlacement->bind(detectSlot, "detect", true);
+        }
+        try
+        {
+            detector.start();
+            if (mPlacement) mPlacement->bind(detectSlot, "detect");
+        }
+        catch (AffdexException ex)
+        {
+            LOG(LogLevel::Error) << "Unable to start the FrameDetector: " << ex.what();
+            return false;
+        }
+
+        std::vector<std::thread> sinkThreads;
+        for (std::unique_ptr<SinkThread> &t : mSinkThreads)
+        {
+            sinkThreads.push_back(std::thread(&FramePipeline::sinkLoop, this, std::ref(*t)));
+        }
+        std::thread decodeThread(&FramePipeline::decodeLoop, this, std::ref(capture), fps, std::ref(decodeQueue));
+        const bool ok = detectLoop(detector, fanOut, decodeQueue);
+
+        decodeThread.join();
+        detector.stop();
+        mDetectDone = true;
+        for (std::thread &t : sinkThreads) t.join();
+        for (auto &sink : mSinks) sink.first->finish();
+
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startT).count();
+        LOG(LogLevel::Info) << "Pipeline processed " << mResults << " frames in " << elapsed << " s ("
+            << (elapsed > 0 ? mResults / elapsed : 0.0) << " fps)";
+        LOG(LogLevel::Info) << "  decode: busy " << mDecodeBusy << " s, max queue " << mMaxDecodeDepth
+            << " of " << decodeQueue.capacity() << ", retrieved " << mRetrieved << " of " << mGrabbed << " frames";
+        LOG(LogLevel::Info) << "  detect: busy " << mDetectBusy << " s";
+        for (size_t i = 0; i < mSinkThreads.size(); i++)
+        {
+            const SinkThread &t = *mSinkThreads[i];
+            std::string names;
+            for (ResultSink *sink : t.sinks) names += (names.empty() ? "" : ",") + std::string(sink->name());
+            LOG(LogLevel::Info) << "  sink " << i << " (" << names << "): busy " << t.busy << " s, max queue "
+                << t.maxDepth << " of " << t.queue.capacity() << (t.lossy ? ", skipped " + std::to_string(t.dropped) : "");
+        }
+        return ok;
+    }
+
+private:
+
+    struct Decoded
+    {
+        Decoded() : timestamp(0) {}
+        double timestamp;
+        cv::Mat image;
+    };
+
+    struct Result
+    {
+        Frame frame;
+        std::shared_ptr<const MetricBatch> rows;    // Shared by the sink threads
+    };
+
+    struct SinkThread
+    {
+        explicit SinkThread(size_t queueSize) : queue(queueSize), lossy(false), busy(0), maxDepth(0), dropped(0) {}
+        MPMCQueue<Result> queue;
+        std::vector<ResultSink *> sinks;
+        bool lossy;
+        double busy;
+        size_t maxDepth;
+        std::atomic<size_t> dropped;
+    };
+
+    /** Detector callback, pushes every result to the queue of each sink thread */
+    class ResultFanOut : public ImageListener, public FaceListener
+    {
+    public:
+        explicit ResultFanOut(FramePipeline &pipeline)
+            : mPipeline(pipeline), mReceived(0), mLastResult(-1.0f), mLastCapture(-1.0f) {}
+
+        void onImageResults(std::map<FaceId, Face> faces, Frame image) override
+        {
+            PipelineMetrics *metrics = mPipeline.mMetrics;
+            if (metrics)
+            {
+                metrics->framesProcessed.inc();
+                metrics->facesFound.inc(faces.size());
+                metrics->facesTracked.set(faces.size());
+            }
+
+            std::shared_ptr<MetricBatch> rows = std::make_shared<MetricBatch>();
+            rows->append(image.getTimestamp(), faces);
+            if (mPipeline.mSmoother) mPipeline.mSmoother->apply(*rows);
+
+            size_t deepest = 0;
+            for (std::unique_ptr<SinkThread> &t : mPipeline.mSinkThreads)
+            {
+                Result result;
+                result.frame = image;
+                result.rows = rows;
+                if (t->lossy)
+                {
+                    if (!t->queue.tryPush(std::move(result)))
+                    {
+                        t->dropped++;
+                        if (metrics) metrics->sinkDropped.inc();
+                    }
+                }
+                else
+                {
+                    BackoffWait backoff;
+                    while (!t->queue.tryPush(std::move(result)) && !mPipeline.mStop) backoff.wait();
+                }
+                deepest = std::max(deepest, t->queue.size());
+            }
+            if (metrics) metrics->sinkQueueDepth.set(deepest);
+            mLastResult.store(image.getTimestamp(), std::memory_order_release);
+            mReceived.fetch_add(1, std::memory_order_release);
+        }
+
+        void onImageCapture(Frame image) override
+        {
+            if (mPipeline.mMetrics) mPipeline.mMetrics->framesCaptured.inc();
+            mLastCapture.store(image.getTimestamp(), std::memory_order_release);
+        }
+
+        void onFaceFound(float timestamp, FaceId faceId) override {}
+
+        void onFaceLost(float timestamp, FaceId faceId) override
+        {
+            if (mPipeline.mSmoother) mPipeline.mSmoother->onFaceLost(timestamp, faceId);
+            for (auto &sink : mPipeline.mSinks) sink.first->onFaceLost(timestamp, faceId);
+        }
+
+        size_t received() const { return mReceived.load(std::memory_order_acquire); }
+
+        /** Timestamps of the last frame with results and of the last frame the detector took, -1 before any */
+        float lastResult() const { return mLastResult.load(std::memory_order_acquire); }
+        float lastCapture() const { return mLastCapture.load(std::memory_order_acquire); }
+
+    private:
+        FramePipeline &mPipeline;
+        std::atomic<size_t> mReceived;
+        std::atomic<float> mLastResult;
+        std::atomic<float> mLastCapture;
+    };
+
+    const int DEFAULT_BUFFER_SIZE = 16;
+    const int STALL_TIMEOUT_MS = 10000;
+
+    void decodeLoop(cv::VideoCapture &capture, const double fps, MPMCQueue<Decoded> &queue)
+    {
+        ThreadPlacement::Slot slot;
+        if (mPlacement) slot = mPlacement->pin("decode");
+
+        // Decode into buffers on this thread's node.  One can be reused once it has gone through the queue
+        // and the detect thread is done with it, so there is one for every queue cell, the one being
+        // submitted and the one being decoded.
+        FramePool frames(queue.capacity() + 2, slot.node);
+        const int width = (int)capture.get(CV_CAP_PROP_FRAME_WIDTH);
+        const int height = (int)capture.get(CV_CAP_PROP_FRAME_HEIGHT);
+
+        // Only the frames the detector would analyze are retrieved and go on
+        FrameSampler sampler(capture, fps, mSettings.processFrameRate);
+        double busy = 0;
+        size_t maxDepth = 0;
+        while (!mStop)
+        {
+            const auto startT = std::chrono::steady_clock::now();
+            Decoded decoded;
+            if (width > 0 && height > 0) decoded.image = frames.next(height, width);
+            if (!sampler.next(decoded.image, decoded.timestamp)) break;
+            busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - startT).count();
+
+            BackoffWait backoff;
+            while (!queue.tryPush(std::move(decoded)) && !mStop) backoff.wait();
+            maxDepth = std::max(maxDepth, queue.size());
+            if (mMetrics) mMetrics->decodeQueueDepth.set(queue.size());
+        }
+        mGrabbed = sampler.grabbed();
+        mRetrieved = sampler.retrieved();
+        mDecodeBusy = busy;
+        mMaxDecodeDepth = maxDepth;
+        mDecodeDone = true;
+    }
+
+    bool detectLoop(FrameDetector &detector, ResultFanOut &fanOut, MPMCQueue<Decoded> &queue)
+    {
+        std::deque<float> inFlight;     // Timestamps of the frames submitted and not answered yet
+        double busy = 0;
+        bool ok = true;
+        BackoffWait backoff;
+        for (;;)
+        {
+            Decoded decoded;
+            if (!queue.tryPop(decoded))
+            {
+                // Everything was pushed before the flag was set, so one more try after seeing it is conclusive
+                if (!mDecodeDone)
+                {
+                    backoff.wait();
+                    continue;
+                }
+                if (!queue.tryPop(decoded)) break;
+            }
+            backoff.reset();
+            if (mMetrics) mMetrics->decodeQueueDepth.set(queue.size());
+
+            if (!waitForRoom(fanOut, inFlight, (size_t)mSettings.frameBufferSize - 1))
+            {
+                ok = false;
+                break;
+            }
+            const auto startT = std::chrono::steady_clock::now();
+            Frame frame(decoded.image.size().width, decoded.image.size().height, decoded.image.data,
+                        Frame::COLOR_FORMAT::BGR, (float)decoded.timestamp);
+            try
+            {
+                detector.process(frame);
+            }
+            catch (AffdexException ex)
+            {
+                LOG(LogLevel::Error) << "FrameDetector failed: " << ex.what();
+                ok = false;
+                break;
+            }
+            inFlight.push_back(frame.getTimestamp());
+            busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - startT).count();
+        }
+
+        // Let the detector finish the frames it holds before it is stopped
+        if (ok) ok = waitForRoom(fanOut, inFlight, 0);
+        if (!ok) mStop = true;
+        mDetectBusy = busy;
+        mResults = fanOut.received();
+        return ok;
+    }
+
+    /** @brief Waits until no more than maxInFlight submitted frames are without results
+     * The detector may skip a frame without a result, so frames are not counted but retired by timestamp:
+     * results come back in submission order, and one retires its own frame and any skipped before it.  Frames
+     * the detector took but has no results for after the stall timeout were skipped with no later result
+     * to retire them, e.g. the last ones of the video.
+     * @return false if the detector stalls without taking the frames
+     */
+    bool waitForRoom(ResultFanOut &fanOut, std::deque<float> &inFlight, const size_t maxInFlight)
+    {
+        BackoffWait backoff;
+        auto lastProgress = std::chrono::steady_clock::now();
+        size_t received = fanOut.received();
+        for (;;)
+        {
+            const float answered = fanOut.lastResult();
+            while (!inFlight.empty() && inFlight.front() <= answered) inFlight.pop_front();
+            if (inFlight.size() <= maxInFlight) return true;
+
+            backoff.wait();
+            const size_t now = fanOut.received();
+            if (now != received)
+            {
+                received = now;
+                lastProgress = std::chrono::steady_clock::now();
+            }
+            else if (std::chrono::steady_clock::now() - lastProgress > std::chrono::milliseconds(STALL_TIMEOUT_MS))
+            {
+                if (fanOut.lastCapture() >= inFlight.back())
+                {
+                    LOG(LogLevel::Warning) << "No results for " << inFlight.size()
+                        << " frames the detector took, taking them as skipped";
+                    inFlight.clear();
+                    return true;
+                }
+                LOG(LogLevel::Error) << "No results from the detector for " << STALL_TIMEOUT_MS << " ms, "
+                    << inFlight.size() << " frames outstanding";
+                return false;
+            }
+        }
+    }
+
+    void sinkLoop(SinkThread &t)
+    {
+        if (mPlacement) mPlacement->pin("sink");
+        BackoffWait backoff;
+        for (;;)
+        {
+            Result result;
+            if (!t.queue.tryPop(result))
+            {
+                if (!mDetectDone)
+                {
+                    backoff.wait();
+                    continue;
+                }
+                if (!t.queue.tryPop(result)) return;
+            }
+            backoff.reset();
+            t.maxDepth = std::max(t.maxDepth, t.queue.size() + 1);
+
+            const auto startT = std::chrono::steady_clock::now();
+            for (ResultSink *sink : t.sinks) sink->consume(result.frame, *result.rows);
+            t.busy += std::chrono::duration<double>(std::chrono::steady_clock::now() - startT).count();
+        }
+    }
+
+    DetectorSettings mSettings;
+    Config mConfig;
+    PipelineMetrics *mMetrics;
+    ThreadPlacement *mPlacement;
+    MetricSmoother *mSmoother;
+    std::vector<std::pair<ResultSink *, bool> > mSinks;
+    std::vector<std::unique_ptr<SinkThread> > mSinkThreads;
+
+    std::atomic<bool> mStop;
+    std::atomic<bool> mDecodeDone;
+    std::atomic<bool> mDetectDone;
+    double mDecodeBusy;
+    double mDetectBusy;
+    size_t mMaxDecodeDepth;
+    long long mGrabbed;
+    long long mRetrieved;
+    size_t mResults;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <opencv2/highgui/highgui.hpp>
+
+/** @brief Reads only the frames of a video that will be analyzed at the processing frame rate
+ * The index of the next frame to analyze is known before decoding (the first frame at least one processing
+ * interval after the last one analyzed), so the frames in between are only grab()bed: demuxed and decoded,
+ * but never retrieve()d, which skips the conversion to BGR and the copy into a cv::Mat.  At --pfps 5 on a
+ * 60 fps source that leaves 11 of every 12 frames without the most expensive part of their decode.
+ */
+class FrameSampler
+{
+public:
+
+    /** @brief FrameSampler
+     * @param capture      -- Video to read, positioned at startFrame
+     * @param sourceFps    -- Frame rate of the video
+     * @param processFps   -- Processing frame rate (0 analyzes every frame)
+     * @param startFrame   -- Index of the frame the capture is positioned at
+     * @param endFrame     -- Index of the first frame not to read, or -1 for the end of the video
+     */
+    FrameSampler(cv::VideoCapture &capture, const double sourceFps, const double processFps,
+                 const long long startFrame = 0, const long long endFrame = -1)
+        : mCapture(capture), mSourceFps(sourceFps), mInterval(processFps > 0 ? 1.0 / processFps : 0.0),
+          mIndex(startFrame), mNextWanted(startFrame), mEndFrame(endFrame), mGrabbed(0), mRetrieved(0)
+    {
+    }
+
+    /** @brief Next reads the next frame to analyze
+     * @param image     -- Receives the frame
+     * @param timestamp -- Receives its timestamp in seconds from the start of the video
+     * @return false at the end of the video (or of the range)
+     */
+    bool next(cv::Mat &image, double &timestamp)
+    {
+        for (;;)
+        {
+            if (mEndFrame >= 0 && mIndex >= mEndFrame) return false;
+            if (!mCapture.grab()) return false;
+            mGrabbed++;
+            const long long index = mIndex++;
+            if (index < mNextWanted) continue;
+
+            if (!mCapture.retrieve(image)) return false;
+            mRetrieved++;
+            timestamp = index / mSourceFps;
+            // Same rounding as the detectors: a frame within a microsecond of the interval still counts
+            mNextWanted = std::max(index + 1, (long long)std::ceil((timestamp + mInterval - 1e-6) * mSourceFps));
+            return true;
+        }
+    }
+
+    /** @brief Frames decoded so far, including the ones skipped */
+    long long grabbed() const { return mGrabbed; }
+
+    /** @brief Frames converted and returned so far */
+    long long retrieved() const { return mRetrieved; }
+
+private:
+    cv::VideoCapture &mCapture;
+    const double mSourceFps;
+    const double mInterval;
+    long long mIndex;
+    long long mNextWanted;
+    const long long mEndFrame;
+    long long mGrabbed;
+    long long mRetrieved;
+};
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "PhotoDetector.h"
+#include "AffdexException.h"
+
+#include "BoundedQueue.hpp"
+#include "DetectorPool.hpp"
+#include "PlottingImageListener.hpp"
+#include "ThreadPlacement.hpp"
+#include "PipelineMetrics.hpp"
+#include "Logger.h"
+
+using namespace affdex;
+
+/** @brief Runs a large number of photos through started PhotoDetectors into one csv
+ * Decoder threads read the images (cv::imread) into a bounded prefetch queue, so decoding runs ahead of
+ * detection by at most the queue size.  Detector threads each check a PhotoDetector out of a pool and feed
+ * it the decoded frames.  Every frame is stamped with the index of its file as timestamp, which is how the
+ * results are correlated back to the file, and a detector thread only moves on once the results of its
+ * frame are in.  The output is the usual csv with the file name in an extra first column, one row per face
+ * (or one row of nan for a photo without faces), in the order the photos complete.
+ */
+class PhotoBatchProcessor
+{
+public:
+
+    /** @brief PhotoBatchProcessor
+     * @param settings     -- Detector configuration
+     * @param numDecoders  -- Number of image decoding threads
+     * @param numDetectors -- Number of concurrent PhotoDetectors
+     * @param prefetch     -- Decoded images allowed to wait for a detector
+     * @param metrics      -- Pipeline counters to update, or nullptr (must outlive the processor)
+     */
+    PhotoBatchProcessor(const DetectorSettings &settings, const unsigned int numDecoders, const unsigned int numDetectors,
+                        const size_t prefetch, PipelineMetrics *metrics = nullptr)
+        : mSettings(settings), mNumDecoders(std::max(1u, numDecoders)), mNumDetectors(std::max(1u, numDetectors)),
+          mPrefetch(prefetch), mMetrics(metrics), mFiles(nullptr), mOutput(nullptr), mHeaderWritten(false),
+          mPlacement(nullptr), mNextFile(0), mCompleted(0), mFailed(0), mStartFailures(0)
+    {
+    }
+
+    /** @brief SetPlacement pins the decoder and detector threads to cpus, call before run()
+     * @param placement -- Thread placement, or nullptr (must outlive the processor)
+     */
+    void setPlacement(ThreadPlacement *placement) { mPlacement = placement; }
+
+    /** @brief Run processes every photo and returns when all the results are written
+     * @param files   -- Photos to process
+     * @param csvPath -- Consolidated output
+     * @return number of photos that failed, or all of them if the output couldn't be opened
+     */
+    size_t run(const std::vector<boost::filesystem::path> &files, const boost::filesystem::path &csvPath)
+    {
+        std::ofstream csvFileStream(csvPath.c_str());
+        if (!csvFileStream.is_open())
+        {
+            LOG(LogLevel::Error) << "Unable to open csv file " << csvPath;
+            return files.size();
+        }
+
+        mFiles = &files;
+        mOutput = &csvFileStream;
+        mHeaderWritten = false;
+        mNextFile = 0;
+        mCompleted = 0;
+        mFailed = 0;
+        mStartFailures = 0;
+
+        std::vector<unsigned int> capacity(3, 0);
+        capacity[(int)DetectorType::Photo] = mNumDetectors;
+        DetectorPool pool(mSettings, capacity, mMetrics);
+        BoundedQueue<Decoded> queue(mPrefetch);
+
+        LOG(LogLevel::Info) << "Processing " << files.size() << " photos with " << mNumDecoders << " decoders and "
+            << mNumDetectors << " detectors";
+        const auto startT = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> decoders;
+        std::vector<std::thread> detectors;
+        for (unsigned int i = 0; i < mNumDecoders; i++)
+        {
+            decoders.push_back(std::thread(&PhotoBatchProcessor::decoder, this, std::ref(queue)));
+        }
+        for (unsigned int i = 0; i < mNumDetectors; i++)
+        {
+            detectors.push_back(std::thread(&PhotoBatchProcessor::detector, this, std::ref(pool), std::ref(queue)));
+        }
+
+        // Completion barrier: every file is decoded, then every decoded frame has its results written
+        for (std::thread &t : decoders) t.join();
+        queue.close();
+        for (std::thread &t : detectors) t.join();
+        csvFileStream.close();
+
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startT).count();
+        LOG(LogLevel::Info) << "Photo batch finished: " << mCompleted << " of " << files.size() << " photos processed, "
+            << mFailed << " failed, in " << elapsed << " s (" << (elapsed > 0 ? mCompleted / elapsed : 0.0)
+            << " photos/s), output written to " << csvPath;
+        return mFailed;
+    }
+
+private:
+
+    struct Decoded
+    {
+        size_t index;
+        cv::Mat image;
+    };
+
+    const int RESULT_TIMEOUT_MS = 10000;
+
+    void decoder(BoundedQueue<Decoded> &queue)
+    {
+        if (mPlacement) mPlacement->pin("photo decoder");
+        for (;;)
+        {
+            const size_t index = mNextFile++;
+            if (index >= mFiles->size()) return;
+
+            Decoded decoded;
+            decoded.index = index;
+            decoded.image = cv::imread((*mFiles)[index].string());
+            if (decoded.image.empty())
+            {
+                LOG(LogLevel::Error) << "Unable to read image " << (*mFiles)[index];
+                mFailed++;
+                continue;
+            }
+            if (mMetrics) mMetrics->framesCaptured.inc();
+            if (!queue.push(std::move(decoded))) return;
+        }
+    }
+
+    void detector(DetectorPool &pool, BoundedQueue<Decoded> &queue)
+    {
+        DetectorPool::Lease lease;
+        std::ostringstream rows;
+        // The detector is started here, with this thread allowed on its whole node so the SDK threads stay there
+        ThreadPlacement::Slot slot;
+        if (mPlacement)
+        {
+            slot = mPlacement->next();
+            mPlacement->bind(slot, "photo detector", true);
+        }
+        try
+        {
+            lease = pool.checkout(DetectorType::Photo);
+            if (mPlacement) mPlacement->bind(slot, "photo detector");
+            lease.listener().setOutputStream(rows);
+            writeHeader(rows.str());
+            rows.str("");
+        }
+        catch (AffdexException ex)
+        {
+            LOG(LogLevel::Error) << "Unable to start a PhotoDetector: " << ex.what();
+            // Leave the photos to the other detectors, or fail them if there are none
+            if (lease.valid()) lease.discard();
+            lease.release();
+            if (mStartFailures.fetch_add(1) + 1 < mNumDetectors) return;
+            Decoded decoded;
+            while (queue.pop(decoded)) mFailed++;
+            return;
+        }
+
+        Decoded decoded;
+        while (queue.pop(decoded))
+        {
+            const float timestamp = (float)decoded.index;
+            Frame frame(decoded.image.size().width, decoded.image.size().height, decoded.image.data,
+                        Frame::COLOR_FORMAT::BGR, timestamp);
+            try
+            {
+                lease.as<PhotoDetector>().process(frame);
+            }
+            catch (AffdexException ex)
+            {
+                LOG(LogLevel::Error) << "Failed to process " << (*mFiles)[decoded.index] << ": " << ex.what();
+                mFailed++;
+                continue;
+            }
+
+            // The results may be delivered after process() returns, wait for the ones of this frame
+            bool done = false;
+            while (!done)
+            {
+                if (!lease.listener().waitForData(std::chrono::milliseconds(RESULT_TIMEOUT_MS)))
+                {
+                    LOG(LogLevel::Error) << "No results for " << (*mFiles)[decoded.index] << " after "
+                        << RESULT_TIMEOUT_MS << " ms";
+                    mFailed++;
+                    break;
+                }
+                while (lease.listener().getDataSize() > 0)
+                {
+                    std::pair<Frame, std::map<FaceId, Face> > dataPoint = lease.listener().getData();
+                    const float resultTimestamp = dataPoint.first.getTimestamp();
+                    if (resultTimestamp != timestamp)
+                    {
+                        LOG(LogLevel::Warning) << "Dropping results for timestamp " << resultTimestamp
+                            << ", expected " << timestamp;
+                        continue;
+                    }
+                    lease.listener().outputToFile(dataPoint.second, timestamp);
+                    writeRows((*mFiles)[decoded.index], rows.str());
+                    rows.str("");
+                    done = true;
+                }
+            }
+            if (done) mCompleted++;
+        }
+    }
+
+    void writeHeader(const std::string &header)
+    {
+        std::lock_guard<std::mutex> lg(mOutputMutex);
+        if (mHeaderWritten) return;
+        *mOutput << "File," << header;
+        mHeaderWritten = true;
+    }
+
+    /** Prefixes every row the listener wrote with the (quoted) file name */
+    void writeRows(const boost::filesystem::path &file, const std::string &rows)
+    {
+        std::string label = file.string();
+        for (size_t pos = label.find('"'); pos != std::string::npos; pos = label.find('"', pos + 2)) label.insert(pos, 1, '"');
+        label = "\"" + label + "\",";
+
+        std::string out;
+        size_t start = 0;
+        for (size_t end = rows.find('\n'); end != std::string::npos; start = end + 1, end = rows.find('\n', start))
+        {
+            out += label;
+            out.append(rows, start, end - start + 1);
+        }
+        std::lock_guard<std::mutex> lg(mOutputMutex);
+        *mOutput << out;
+    }
+
+    const DetectorSettings mSettings;
+    const unsigned int mNumDecoders;
+    const unsigned int mNumDetectors;
+    const size_t mPrefetch;
+    PipelineMetrics *mMetrics;
+    ThreadPlacement *mPlacement;
+
+    const std::vector<boost::filesystem::path> *mFiles;
+    std::mutex mOutputMutex;
+    std::ostream *mOutput;
+    bool mHeaderWritten;
+    std::atomic<size_t> mNextFile;
+    std::atomic<size_t> mCompleted;
+    std::atomic<size_t> mFailed;
+    std::atomic<unsigned int> mStartFailures;
+};
@@ -0,0 +1,382 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "FrameDetector.h"
+#include "AffdexException.h"
+
+#include "DetectorPool.hpp"
+#include "FramePool.hpp"
+#include "FrameSampler.hpp"
+#include "ThreadPlacement.hpp"
+#include "PlottingImageListener.hpp"
+#include "PipelineMetrics.hpp"
+#include "Logger.h"
+
+using namespace affdex;
+
+/** @brief Processes one long video as K time segments in parallel
+ * Every segment gets its own cv::VideoCapture, seeked to the segment start, and its own FrameDetector fed
+ * with the frames at the processing frame rate and their timestamps in the whole video.  Each segment writes
+ * a temporary csv; once all are done the files are concatenated in segment (and so timestamp) order into the
+ * output csv.
+ *
+ * The detectors assign face IDs independently, so IDs are reconciled across every boundary: the last box of
+ * each face near the end of a segment is matched to the first box of each face near the start of the next
+ * by their overlap (intersection over union), and matching faces keep the ID of the earlier segment.  All IDs
+ * in the output are renumbered in order of first appearance.
+ */
+class SegmentProcessor
+{
+public:
+
+    /** @brief SegmentProcessor
+     * @param settings    -- Detector configuration
+     * @param numSegments -- Number of segments (and concurrent detectors)
+     * @param metrics     -- Pipeline counters to update, or nullptr (must outlive the processor)
+     */
+    SegmentProcessor(const DetectorSettings &settings, const unsigned int numSegments, PipelineMetrics *metrics = nullptr)
+        : mSettings(settings), mNumSegments(std::max(1u, numSegments)), mMetrics(metrics), mPlacement(nullptr)
+    {
+        if (mSettings.frameBufferSize <= 0) mSettings.frameBufferSize = DEFAULT_BUFFER_SIZE;
+    }
+
+    /** @brief SetPlacement pins the segment threads to cpus, call before run()
+     * @param placement -- Thread placement, or nullptr (must outlive the processor)
+     */
+    void setPlacement(ThreadPlacement *placement) { mPlacement = placement; }
+
+    /** @brief Run processes the video and writes the merged results
+     * @param videoPath -- Video to process
+     * @param csvPath   -- Output csv
+     * @return false if the video couldn't be opened or a segment failed
+     */
+    bool run(const boost::filesystem::path &videoPath, const boost::filesystem::path &csvPath)
+    {
+        cv::VideoCapture probe(videoPath.string());
+        if (!probe.isOpened())
+        {
+            LOG(LogLevel::Error) << "Unable to open video " << videoPath;
+            return false;
+        }
+        const double fps = probe.get(CV_CAP_PROP_FPS);
+        const long long frameCount = (long long)probe.get(CV_CAP_PROP_FRAME_COUNT);
+        probe.release();
+        if (fps <= 0 || frameCount <= 0)
+        {
+            LOG(LogLevel::Error) << "Unable to read the frame rate and length of " << videoPath << ", can't split it";
+            return false;
+        }
+
+        const unsigned int numSegments = (unsigned int)std::min<long long>(mNumSegments, frameCount);
+        mSegments.assign(numSegments, Segment());
+        for (unsigned int i = 0; i < numSegments; i++)
+        {
+            Segment &segment = mSegments[i];
+            segment.startFrame = frameCount * i / numSegments;
+            segment.endFrame = frameCount * (i + 1) / numSegments;
+            segment.csvPath = csvPath;
+            segment.csvPath += ".segment" + std::to_string(i);
+        }
+        LOG(LogLevel::Info) << "Processing " << videoPath << " (" << frameCount << " frames at " << fps
+            << " fps) as " << numSegments << " segments";
+
+        const auto startT = std::chrono::steady_clock::now();
+        std::vector<unsigned int> capacity(3, 0);
+        capacity[(int)DetectorType::Frame] = numSegments;
+        mPool.reset(new DetectorPool(mSettings, capacity, mMetrics));
+        mPool->setPlacement(mPlacement);
+        try
+        {
+            mPool->warmUp(DetectorType::Frame, numSegments);
+        }
+        catch (AffdexException ex)
+        {
+            LOG(LogLevel::Error) << "Unable to start the detectors: " << ex.what();
+            mPool.reset();
+            return false;
+        }
+
+        std::vector<std::thread> threads;
+        for (unsigned int i = 0; i < numSegments; i++)
+        {
+            threads.push_back(std::thread(&SegmentProcessor::processSegment, this, std::ref(mSegments[i]),
+                                          videoPath, fps));
+        }
+        for (std::thread &t : threads) t.join();
+        mPool.reset();
+
+        bool ok = true;
+        for (const Segment &segment : mSegments) ok = ok && segment.ok;
+        if (ok)
+        {
+            reconcileIds(fps);
+            ok = merge(csvPath);
+        }
+        for (const Segment &segment : mSegments)
+        {
+            boost::system::error_code ec;
+            boost::filesystem::remove(segment.csvPath, ec);
+        }
+
+        const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startT).count();
+        if (ok) LOG(LogLevel::Info) << "Segments merged into " << csvPath << " in " << elapsed << " s";
+        return ok;
+    }
+
+private:
+
+    struct Box
+    {
+        float x0, y0, x1, y1;
+        float timestamp;
+    };
+
+    struct Segment
+    {
+        Segment() : startFrame(0), endFrame(0), ok(false) {}
+        long long startFrame;
+        long long endFrame;
+        boost::filesystem::path csvPath;
+        bool ok;
+        std::vector<FaceId> order;              // Face IDs in order of first appearance
+        std::map<FaceId, Box> firstBox;         // First and last box of every face
+        std::map<FaceId, Box> lastBox;
+        std::map<FaceId, FaceId> globalIds;     // Filled in by reconcileIds
+    };
+
+    /** Frames submitted to a segment's detector and not answered yet */
+    struct InFlight
+    {
+        InFlight() : lastResult(std::chrono::steady_clock::now()), longestGap(0) {}
+        std::deque<float> timestamps;
+        std::chrono::steady_clock::time_point lastResult;
+        std::chrono::steady_clock::duration longestGap;    // Between two results, bounds the time one takes
+    };
+
+    // Faces are matched across a boundary only if seen this close to it (seconds)
+    const float BOUNDARY_WINDOW = 2.0f;
+    const float MIN_OVERLAP = 0.3f;
+    // Frames in flight in each FrameDetector, it drops frames once its buffer is full
+    const int DEFAULT_BUFFER_SIZE = 16;
+    const int STALL_TIMEOUT_MS = 10000;
+    // The frames the detector took get their results within twice the longest gap between results, or at least this
+    const int MIN_GRACE_MS = 100;
+
+    void processSegment(Segment &segment, const boost::filesystem::path &videoPath, const double fps)
+    {
+        ThreadPlacement::Slot slot;
+        if (mPlacement) slot = mPlacement->pin("segment " + std::to_string(&segment - &mSegments[0]));
+        std::ofstream csvFileStream(segment.csvPath.c_str());
+        if (!csvFileStream.is_open())
+        {
+            LOG(LogLevel::Error) << "Unable to open csv file " << segment.csvPath;
+            return;
+        }
+
+        try
+        {
+            cv::VideoCapture capture(videoPath.string());
+            if (!capture.isOpened() || !capture.set(CV_CAP_PROP_POS_FRAMES, (double)segment.startFrame))
+            {
+                LOG(LogLevel::Error) << "Unable to seek " << videoPath << " to frame " << segment.startFrame;
+                return;
+            }
+
+            DetectorPool::Lease lease = mPool->checkout(DetectorType::Frame);
+            FrameDetector &detector = lease.as<FrameDetector>();
+            PlottingImageListener &listener = lease.listener();
+            listener.setOutputStream(csvFileStream);
+
+            // Only the frames the detector would analyze are retrieved, and no more are passed on than its buffer holds
+            FrameSampler sampler(capture, fps, mSettings.processFrameRate, segment.startFrame, segment.endFrame);
+            InFlight inFlight;
+            FramePool frames(1, slot.node);
+            const int width = (int)capture.get(CV_CAP_PROP_FRAME_WIDTH);
+            const int height = (int)capture.get(CV_CAP_PROP_FRAME_HEIGHT);
+            cv::Mat img = width > 0 && height > 0 ? frames.next(height, width) : cv::Mat();
+            double timestamp = 0;
+            while (sampler.next(img, timestamp))
+            {
+                while ((int)inFlight.timestamps.size() >= mSettings.frameBufferSize)
+                {
+                    if (!drain(listener, segment, inFlight)) return;
+                }
+                Frame frame(img.size().width, img.size().height, img.data, Frame::COLOR_FORMAT::BGR, (float)timestamp);
+                detector.process(frame);
+                inFlight.timestamps.push_back(frame.getTimestamp());
+            }
+            while (!inFlight.timestamps.empty())
+            {
+                if (!drain(listener, segment, inFlight)) return;
+            }
+            segment.ok = true;
+        }
+        catch (AffdexException ex)
+        {
+            LOG(LogLevel::Error) << "Segment starting at frame " << segment.startFrame << " failed: " << ex.what();
+        }
+    }
+
+    /** @brief Writes out the waiting results and retires the frames they answer
+     * Results come back in the order the frames were submitted, so a result also retires every earlier frame
+     * still in flight: those were skipped by the detector and won't get one.  Frames with no later result to
+     * retire them, the last ones of the segment, are taken as skipped once the detector has taken them and
+     * their results are overdue.
+     * @return false if the detector stalls without taking the frames
+     */
+    bool drain(PlottingImageListener &listener, Segment &segment, InFlight &inFlight)
+    {
+        const auto startT = std::chrono::steady_clock::now();
+        while (!listener.waitForData(std::chrono::milliseconds(10)))
+        {
+            const auto waited = std::chrono::steady_clock::now() - startT;
+            const auto grace = std::min<std::chrono::steady_clock::duration>(std::chrono::milliseconds(STALL_TIMEOUT_MS),
+                std::max<std::chrono::steady_clock::duration>(std::chrono::milliseconds(MIN_GRACE_MS), 2 * inFlight.longestGap));
+            if (listener.getLastCaptureTimestamp() >= inFlight.timestamps.back() && waited > grace)
+            {
+                inFlight.timestamps.clear();
+                return true;
+            }
+            if (waited > std::chrono::milliseconds(STALL_TIMEOUT_MS))
+            {
+                LOG(LogLevel::Error) << "No results for " << STALL_TIMEOUT_MS << " ms, " << inFlight.timestamps.size()
+                    << " frames outstanding in the segment starting at frame " << segment.startFrame;
+                return false;
+            }
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+        inFlight.longestGap = std::max(inFlight.longestGap, now - inFlight.lastResult);
+        inFlight.lastResult = now;
+        while (listener.getDataSize() > 0)
+        {
+            std::pair<Frame, std::map<FaceId, Face> > dataPoint = listener.getData();
+            const float timestamp = dataPoint.first.getTimestamp();
+            for (auto &face : dataPoint.second)
+            {
+                if (face.second.featurePoints.empty()) continue;
+                const BoundingBox bounds = listener.CalculateBoundingBox(face.second.featurePoints);
+                const Box box = { bounds.left, bounds.top, bounds.right, bounds.bottom, timestamp };
+                if (segment.firstBox.insert(std::make_pair(face.first, box)).second) segment.order.push_back(face.first);
+                segment.lastBox[face.first] = box;
+            }
+            listener.outputToFile(dataPoint.second, timestamp);
+            std::deque<float> &timestamps = inFlight.timestamps;
+            while (!timestamps.empty() && timestamps.front() <= timestamp) timestamps.pop_front();
+        }
+        return true;
+    }
+
+    static float overlap(const Box &a, const Box &b)
+    {
+        const float w = std::min(a.x1, b.x1) - std::max(a.x0, b.x0);
+        const float h = std::min(a.y1, b.y1) - std::max(a.y0, b.y0);
+        if (w <= 0 || h <= 0) return 0.0f;
+        const float intersection = w * h;
+        return intersection / ((a.x1 - a.x0) * (a.y1 - a.y0) + (b.x1 - b.x0) * (b.y1 - b.y0) - intersection);
+    }
+
+    void reconcileIds(const double fps)
+    {
+        FaceId nextId = 0;
+        for (size_t i = 0; i < mSegments.size(); i++)
+        {
+            Segment &segment = mSegments[i];
+            if (i > 0)
+            {
+                // Greedily pair the faces that overlap the most across the boundary
+                const Segment &previous = mSegments[i - 1];
+                const float boundary = (float)(segment.startFrame / fps);
+                std::vector<std::pair<float, std::pair<FaceId, FaceId> > > candidates;
+                for (const auto &before : previous.lastBox)
+                {
+                    if (boundary - before.second.timestamp > BOUNDARY_WINDOW) continue;
+                    for (const auto &after : segment.firstBox)
+                    {
+                        if (after.second.timestamp - boundary > BOUNDARY_WINDOW) continue;
+                        const float iou = overlap(before.second, after.second);
+                        if (iou >= MIN_OVERLAP) candidates.push_back(std::make_pair(iou, std::make_pair(before.first, after.first)));
+                    }
+                }
+                std::sort(candidates.begin(), candidates.end(),
+                          [](const std::pair<float, std::pair<FaceId, FaceId> > &a,
+                             const std::pair<float, std::pair<FaceId, FaceId> > &b) { return a.first > b.first; });
+
+                std::map<FaceId, bool> used;
+                for (const auto &candidate : candidates)
+                {
+                    const FaceId before = candidate.second.first;
+                    const FaceId after = candidate.second.second;
+                    if (used[before] || segment.globalIds.count(after)) continue;
+                    used[before] = true;
+                    segment.globalIds[after] = previous.globalIds.at(before);
+                }
+                LOG(LogLevel::Debug) << segment.globalIds.size() << " faces carried over at " << boundary << " s";
+            }
+            for (FaceId id : segment.order)
+            {
+                if (!segment.globalIds.count(id)) segment.globalIds[id] = nextId++;
+            }
+        }
+    }
+
+    bool merge(const boost::filesystem::path &csvPath)
+    {
+        std::ofstream out(csvPath.c_str());
+        if (!out.is_open())
+        {
+            LOG(LogLevel::Error) << "Unable to open csv file " << csvPath;
+            return false;
+        }
+
+        for (size_t i = 0; i < mSegments.size(); i++)
+        {
+            const Segment &segment = mSegments[i];
+            std::ifstream in(segment.csvPath.c_str());
+            std::string line;
+            for (bool header = true; std::getline(in, line); header = false)
+            {
+                if (header)
+                {
+                    if (i == 0) out << line << '\n';
+                    continue;
+                }
+                // TimeStamp,faceId,... rows without faces have "nan" as the ID
+                const size_t first = line.find(',');
+                const size_t second = first == std::string::npos ? first : line.find(',', first + 1);
+                if (second != std::string::npos)
+                {
+                    char *end = nullptr;
+                    const std::string field = line.substr(first + 1, second - first - 1);
+                    const long id = std::strtol(field.c_str(), &end, 10);
+                    const auto mapped = segment.globalIds.find((FaceId)id);
+                    if (end != field.c_str() && *end == '\0' && mapped != segment.globalIds.end())
+                    {
+                        line = line.substr(0, first + 1) + std::to_string(mapped->second) + line.substr(second);
+                    }
+                }
+                out << line << '\n';
+            }
+        }
+        return out.good();
+    }
+
+    DetectorSettings mSettings;
+    const unsigned int mNumSegments;
+    PipelineMetrics *mMetrics;
+    ThreadPlacement *mPlacement;
+    std::unique_ptr<DetectorPool> mPool;
+    std::vector<Segment> mSegments;
+};
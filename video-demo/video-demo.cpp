@@ -1,7 +1,9 @@
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <chrono>
 #include <fstream>
+#include <thread>
 
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -12,10 +14,27 @@
 #include "VideoDetector.h"
 #include "PhotoDetector.h"
 #include "AffdexException.h"
+#ifdef AFFDEX_MOCK
+#include "MockConfig.h"
+#endif // AFFDEX_MOCK
 
 #include "AFaceListener.hpp"
 #include "PlottingImageListener.hpp"
+#include "FaceSummary.hpp"
+#include "EventSink.hpp"
+#include "DeltaCsv.hpp"
+#include "RollupSink.hpp"
+#include "FaceCropSink.hpp"
+#include "MetricSmoother.hpp"
 #include "StatusListener.hpp"
+#include "MetricsServer.h"
+#include "ResultBus.h"
+#include "Logger.h"
+#include "BatchProcessor.hpp"
+#include "SegmentProcessor.hpp"
+#include "PhotoBatchProcessor.hpp"
+#include "FramePipeline.hpp"
+#include "ThreadPlacement.hpp"
 
 
 using namespace std;
@@ -26,24 +45,48 @@ int main(int argsc, char ** argsv)
 
 
 
-    std::map<boost::filesystem::path, bool> VIDEO_EXTS  = { {boost::filesystem::path(".avi"), 1},
-                                                            {boost::filesystem::path(".mov"), 1},
-                                                            {boost::filesystem::path(".flv"), 1},
-                                                            {boost::filesystem::path(".webm"), 1},
-                                                            {boost::filesystem::path(".wmv"), 1},
-                                                            {boost::filesystem::path(".mp4"), 1} };
     affdex::path DATA_FOLDER;
     affdex::path videoPath;
+    affdex::path inputDir;
+    affdex::path manifestPath;
+    affdex::path photoOutput;
+    unsigned int numWorkers = std::max(1u, std::thread::hardware_concurrency());
+    unsigned int numSegments = 1;
+    bool use_pipeline = false;
+    unsigned int sinkThreads = 1;
+    bool write_summary = false;
+    float summaryThreshold = 50.f;
+    std::string eventRulesPath;
+    bool write_csv = true;
+    float deltaEpsilon = 0;
+    double keyframeInterval = 10;
+    std::string expandPath;
+    std::vector<double> rollupIntervals;
+    int cropSize = 0;
+    float cropMargin = 0.25f;
+    bool cropAlign = true;
+    std::string busName;
+    size_t busCapacity = 4096;
+    std::string busReadName;
+    std::string sparkline;
+    double historySeconds = 10;
+    std::string smoothFilter;
+    std::string smoothParamsPath;
+    MetricSmoother::Filter filter = MetricSmoother::Filter::Ema;
 
     int process_framerate = 30;
     bool draw_display = true;
     bool loop = false;
     unsigned int nFaces = 1;
     int faceDetectorMode = (int)FaceDetectorMode::LARGE_FACES;
+    std::string metrics_endpoint;
+    std::string log_level;
+    std::string affinity;
+    AffinityPolicy affinityPolicy = AffinityPolicy::None;
+    std::vector<int> affinityCpus;
 
     const int precision = 2;
-    std::cerr.precision(precision);
-    std::cout.precision(precision);
+    Logger::instance().setPrecision(precision);
 
     namespace po = boost::program_options; // abbreviate namespace
     po::options_description description("Project for demoing the Affdex SDK VideoDetector class (processing video files).");
@@ -51,17 +94,66 @@ int main(int argsc, char ** argsv)
     ("help,h", po::bool_switch()->default_value(false), "Display this help message.")
 #ifdef _WIN32
     ("data,d", po::wvalue< affdex::path >(&DATA_FOLDER)->default_value(affdex::path(L"data"), std::string("data")), "Path to the data folder")
-    ("input,i", po::wvalue< affdex::path >(&videoPath)->required(), "Video file to processs")
+    ("input,i", po::wvalue< affdex::path >(&videoPath), "Video file to processs")
+    ("input-dir", po::wvalue< affdex::path >(&inputDir), "Process every video and photo in this folder (batch mode).")
+    ("manifest", po::wvalue< affdex::path >(&manifestPath), "Process the files listed in this file, one per line (batch mode).")
+    ("photo-output", po::wvalue< affdex::path >(&photoOutput), "In batch mode, write the results of all the photos to this one csv.")
 #else // _WIN32
     ("data,d", po::value< affdex::path >(&DATA_FOLDER)->default_value(affdex::path("data"), std::string("data")), "Path to the data folder")
-    ("input,i", po::value< affdex::path >(&videoPath)->required(), "Video file to processs")
+    ("input,i", po::value< affdex::path >(&videoPath), "Video file to processs")
+    ("input-dir", po::value< affdex::path >(&inputDir), "Process every video and photo in this folder (batch mode).")
+    ("manifest", po::value< affdex::path >(&manifestPath), "Process the files listed in this file, one per line (batch mode).")
+    ("photo-output", po::value< affdex::path >(&photoOutput), "In batch mode, write the results of all the photos to this one csv.")
 #endif // _WIN32
     ("pfps", po::value< int >(&process_framerate)->default_value(30), "Processing framerate.")
     ("draw", po::value< bool >(&draw_display)->default_value(true), "Draw video on screen.")
     ("faceMode", po::value< int >(&faceDetectorMode)->default_value((int)FaceDetectorMode::SMALL_FACES), "Face detector mode (large faces vs small faces).")
     ("numFaces", po::value< unsigned int >(&nFaces)->default_value(1), "Number of faces to be tracked.")
     ("loop", po::value< bool >(&loop)->default_value(false), "Loop over the video being processed.")
+    ("workers", po::value< unsigned int >(&numWorkers)->default_value(numWorkers), "Number of concurrent detectors in batch mode.")
+    ("segments", po::value< unsigned int >(&numSegments)->default_value(1), "Split the input video into this many segments processed in parallel.")
+    ("pipeline", po::bool_switch(&use_pipeline)->default_value(false), "Decode, detect and write results in separate pipeline stages.")
+    ("sinkThreads", po::value< unsigned int >(&sinkThreads)->default_value(1), "Number of threads for the result sinks in --pipeline mode.")
+    ("summary", po::bool_switch(&write_summary)->default_value(false), "Write per-face summary statistics of the emotions and expressions to <input>.summary.csv.")
+    ("summaryThreshold", po::value< float >(&summaryThreshold)->default_value(50.f), "Metric value counted as time above threshold in the summary.")
+    ("events", po::value< std::string >(&eventRulesPath), "Detect the events described in this rules file and write them to <input>.events.csv.")
+    ("csv", po::value< bool >(&write_csv)->default_value(true), "Write every frame's results to <input>.csv.")
+    ("deltaEpsilon", po::value< float >(&deltaEpsilon)->default_value(0), "Write the csv as <input>.delta.csv, with only the values that changed by more than this.")
+    ("keyframeInterval", po::value< double >(&keyframeInterval)->default_value(10), "With --deltaEpsilon, write every value of a face at least this often, in seconds.")
+    ("rollup", po::value< std::vector<double> >(&rollupIntervals)->multitoken(), "Write per-face mean/min/max/count over buckets of these lengths in seconds (e.g. 1 10) to <input>.rollup.csv.")
+    ("crops", po::value< int >(&cropSize)->default_value(0), "Write a crop of this many pixels square of every face to <input>.crops.bin, 0 for none.")
+    ("cropMargin", po::value< float >(&cropMargin)->default_value(0.25f), "With --crops, margin added around each face's box, as a fraction of its size.")
+    ("cropAlign", po::value< bool >(&cropAlign)->default_value(true), "With --crops, turn the crops by the head's roll so the faces are upright.")
+    ("bus", po::value< std::string >(&busName), "Publish every frame's results on this shared memory result bus (e.g. /affdex) for other processes.")
+    ("busCapacity", po::value< size_t >(&busCapacity)->default_value(4096), "Records kept in the --bus ring for slow readers.")
+    ("busRead", po::value< std::string >(&busReadName), "Read the result bus of another video-demo and report its latency, then exit.")
+    ("sparkline", po::value< std::string >(&sparkline), "With --draw, plot the recent history of this metric (e.g. valence) under each face.")
+    ("history", po::value< double >(&historySeconds)->default_value(10), "Seconds of history kept per face for --sparkline.")
+    ("smooth", po::value< std::string >(&smoothFilter)->default_value("none"), "Smooth the metrics over time before they are drawn and written: none, ema or oneeuro.")
+    ("smoothParams", po::value< std::string >(&smoothParamsPath), "With --smooth, read per-metric smoothing parameters from this file.")
+    ("expand", po::value< std::string >(&expandPath), "Rebuild the full csv from a .delta.csv written with --deltaEpsilon, then exit.")
+    ("affinity", po::value< std::string >(&affinity)->default_value("none"), "Pin the sample's threads: none, compact, scatter or a cpu list such as 0,2,8-11.")
+    ("metrics", po::value< std::string >(&metrics_endpoint)->default_value(""), "Serve Prometheus metrics on [host:]port or unix:/path instead of logging every frame.")
+    ("logLevel", po::value< std::string >(&log_level)->default_value("info"), "Log level (debug, info, warning, error).")
     ;
+#ifdef AFFDEX_MOCK
+    affdex::mock::MockConfig mockConfig;
+    po::options_description mockDescription("Mock detector (AFFDEX_MOCK build)");
+    mockDescription.add_options()
+    ("mockSeed", po::value< uint32_t >(&mockConfig.seed)->default_value(mockConfig.seed), "Random seed for the synthetic results.")
+    ("mockFaces", po::value< unsigned int >(&mockConfig.numFaces)->default_value(mockConfig.numFaces), "Number of synthetic faces in view.")
+    ("mockJitter", po::value< float >(&mockConfig.landmarkJitter)->default_value(mockConfig.landmarkJitter), "Landmark jitter (pixels, standard deviation).")
+    ("mockMetricMean", po::value< float >(&mockConfig.metricMean)->default_value(mockConfig.metricMean), "Mean of the synthetic metric values.")
+    ("mockMetricStdDev", po::value< float >(&mockConfig.metricStdDev)->default_value(mockConfig.metricStdDev), "Standard deviation of the synthetic metric values.")
+    ("mockFps", po::value< float >(&mockConfig.frameRate)->default_value(mockConfig.frameRate), "Frame rate of the synthetic video.")
+    ("mockDuration", po::value< float >(&mockConfig.duration)->default_value(mockConfig.duration), "Length of the synthetic video in seconds.")
+    ("mockFaceLifetime", po::value< float >(&mockConfig.faceLifetime)->default_value(mockConfig.faceLifetime), "Mean seconds before a face is lost (0 = never).")
+    ("mockProcessingTime", po::value< float >(&mockConfig.processingTime)->default_value(mockConfig.processingTime), "Simulated detector cost per frame in seconds.")
+    ("mockRealtime", po::value< bool >(&mockConfig.realtime)->default_value(mockConfig.realtime), "Play the synthetic video in real time.")
+    ;
+    description.add(mockDescription);
+#endif // AFFDEX_MOCK
+
     po::variables_map args;
     try
     {
@@ -72,39 +164,368 @@ int main(int argsc, char ** argsv)
             return 0;
         }
         po::notify(args);
+        if (!args.count("expand") && !args.count("busRead") && args.count("input") + args.count("input-dir") + args.count("manifest") != 1)
+        {
+            throw po::error("exactly one of --input, --input-dir or --manifest is required");
+        }
+        LogLevel level;
+        if (!Logger::parseLevel(log_level, level))
+        {
+            throw po::validation_error(po::validation_error::invalid_option_value, "logLevel", log_level);
+        }
+        Logger::instance().setLevel(level);
+        for (double interval : rollupIntervals)
+        {
+            if (!(interval > 0)) throw po::validation_error(po::validation_error::invalid_option_value, "rollup", std::to_string(interval));
+        }
+        if (busCapacity == 0) throw po::validation_error(po::validation_error::invalid_option_value, "busCapacity", "0");
+        if (cropSize < 0) throw po::validation_error(po::validation_error::invalid_option_value, "crops", std::to_string(cropSize));
+        if (!(cropMargin >= 0)) throw po::validation_error(po::validation_error::invalid_option_value, "cropMargin", std::to_string(cropMargin));
+        if (smoothFilter != "none" && !MetricSmoother::parseFilter(smoothFilter, filter))
+        {
+            throw po::validation_error(po::validation_error::invalid_option_value, "smooth", smoothFilter);
+        }
+        if (!ThreadPlacement::parsePolicy(affinity, affinityPolicy, affinityCpus))
+        {
+            throw po::validation_error(po::validation_error::invalid_option_value, "affinity", affinity);
+        }
     }
     catch (po::error& e)
     {
-        std::cerr << "ERROR: " << e.what() << std::endl << std::endl;
-        std::cerr << "For help, use the -h option." << std::endl << std::endl;
+        LOG(LogLevel::Error) << e.what();
+        LOG(LogLevel::Error) << "For help, use the -h option.";
         return 1;
     }
 
+    if (!expandPath.empty())
+    {
+        // <name>.delta.csv is expanded to <name>.csv, anything else next to it with .expanded.csv
+        std::string outputPath = expandPath;
+        const std::string suffix = ".delta.csv";
+        if (outputPath.size() > suffix.size() && outputPath.compare(outputPath.size() - suffix.size(), suffix.size(), suffix) == 0)
+        {
+            outputPath.replace(outputPath.size() - suffix.size(), suffix.size(), ".csv");
+        }
+        else outputPath = boost::filesystem::path(outputPath).replace_extension(".expanded.csv").string();
+        std::ifstream in(expandPath.c_str());
+        std::ofstream out(outputPath.c_str());
+        if (!in.is_open() || !out.is_open())
+        {
+            LOG(LogLevel::Error) << "Unable to open " << (in.is_open() ? outputPath : expandPath);
+            return 1;
+        }
+        if (!expandDeltaCsv(in, out))
+        {
+            LOG(LogLevel::Error) << expandPath << " is not a delta csv";
+            return 1;
+        }
+        LOG(LogLevel::Info) << "Output written to file: " << outputPath;
+        return 0;
+    }
+
+    if (!busReadName.empty())
+    {
+        // Waits for the publisher to start, then reads until it closes the bus, timing every record from its
+        // publication to here
+        // The publisher may not be up yet, and may die without closing the bus: give up after this long
+        const auto busTimeout = std::chrono::seconds(30);
+        ResultBusReader reader(busReadName);
+        const auto deadline = std::chrono::steady_clock::now() + busTimeout;
+        while (!reader.open())
+        {
+            if (std::chrono::steady_clock::now() > deadline)
+            {
+                LOG(LogLevel::Error) << reader.getError();
+                return 1;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        LOG(LogLevel::Info) << "Reading result bus " << busReadName;
+        std::vector<int64_t> latencies;
+        size_t faceRecords = 0;
+        ResultBusRecord record;
+        auto lastRecord = std::chrono::steady_clock::now();
+        int idlePolls = 0;
+        bool abandoned = false;
+        for (;;)
+        {
+            const bool closed = reader.closed();
+            if (reader.read(record))
+            {
+                const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+                latencies.push_back(now - record.publishedNs);
+                if (record.faceId != MetricBatch::NO_FACE) faceRecords++;
+                lastRecord = std::chrono::steady_clock::now();
+                idlePolls = 0;
+            }
+            else if (closed) break;
+            else if (std::chrono::steady_clock::now() - lastRecord > busTimeout)
+            {
+                LOG(LogLevel::Error) << "No records on " << busReadName << " for "
+                                     << busTimeout.count() << " s, giving up";
+                abandoned = true;
+                break;
+            }
+            // Yield right after a record, as the next face of the frame may follow, then sleep briefly between frames
+            else if (++idlePolls < 1000) std::this_thread::yield();
+            else std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        LOG(LogLevel::Info) << latencies.size() << " record(s) read, " << faceRecords << " with a face, "
+                            << reader.dropped() << " dropped";
+        if (!latencies.empty())
+        {
+            std::sort(latencies.begin(), latencies.end());
+            LOG(LogLevel::Info) << "Latency from publication, ns: median " << latencies[latencies.size() / 2]
+                                << " p99 " << latencies[latencies.size() * 99 / 100]
+                                << " max " << latencies.back();
+        }
+        return abandoned ? 1 : 0;
+    }
+
+#ifdef AFFDEX_MOCK
+    affdex::mock::setConfig(mockConfig);
+    LOG(LogLevel::Info) << "Using the mock detector, results are synthetic";
+#else // AFFDEX_MOCK
     // Parse and check the data folder (with assets)
     if (!boost::filesystem::exists(DATA_FOLDER))
     {
-        std::cerr << "Data folder doesn't exist: " << std::string(DATA_FOLDER.begin(), DATA_FOLDER.end()) << std::endl;
-        std::cerr << "Try specifying the folder through the command line" << std::endl;
-        std::cerr << description << std::endl;
+        LOG(LogLevel::Error) << "Data folder doesn't exist: " << std::string(DATA_FOLDER.begin(), DATA_FOLDER.end());
+        LOG(LogLevel::Error) << "Try specifying the folder through the command line";
+        LOG(LogLevel::Info) << description;
         return 1;
     }
+#endif // AFFDEX_MOCK
+    std::vector<EventRule> eventRules;
+    if (!eventRulesPath.empty())
+    {
+        std::string error;
+        if (!readEventRules(eventRulesPath, eventRules, error))
+        {
+            LOG(LogLevel::Error) << "Invalid event rules: " << error;
+            return 1;
+        }
+    }
+    std::unique_ptr<MetricSmoother> smoother;
+    if (smoothFilter != "none")
+    {
+        smoother.reset(new MetricSmoother(filter));
+        std::string error;
+        if (!smoothParamsPath.empty() && !readSmoothingParams(smoothParamsPath, *smoother, error))
+        {
+            LOG(LogLevel::Error) << "Invalid smoothing parameters: " << error;
+            return 1;
+        }
+    }
+
     try
     {
         std::shared_ptr<Detector> detector;
+        PipelineMetrics metrics;
+        std::unique_ptr<MetricsServer> metricsServer;
+        if (!metrics_endpoint.empty())
+        {
+            metricsServer.reset(new MetricsServer(metrics, metrics_endpoint));
+            if (!metricsServer->start())
+            {
+                LOG(LogLevel::Error) << "Unable to start metrics endpoint: " << metricsServer->getError();
+                return 1;
+            }
+            LOG(LogLevel::Info) << "Serving metrics on " << metrics_endpoint;
+        }
+
+        ThreadPlacement placement(affinityPolicy, affinityCpus);
+        ThreadPlacement *placementPtr = placement.enabled() ? &placement : nullptr;
+        if (affinityPolicy != AffinityPolicy::None) placement.report();
+
+        if (videoPath.empty())
+        {
+            // Batch mode, one detector per worker and no display
+            std::vector<boost::filesystem::path> files;
+            if (!inputDir.empty())
+            {
+                if (!boost::filesystem::is_directory(inputDir))
+                {
+                    LOG(LogLevel::Error) << "Input folder doesn't exist: " << boost::filesystem::path(inputDir);
+                    return 1;
+                }
+                files = listDirectory(inputDir);
+            }
+            else if (!readManifest(manifestPath, files))
+            {
+                LOG(LogLevel::Error) << "Unable to read manifest " << boost::filesystem::path(manifestPath);
+                return 1;
+            }
+
+            DetectorSettings settings = { process_framerate, nFaces, (affdex::FaceDetectorMode) faceDetectorMode, DATA_FOLDER, 0 };
+            size_t failed = 0;
+            if (!photoOutput.empty())
+            {
+                // The photos go through the decode/detect pipeline into one csv, the videos through the batch workers
+                std::vector<boost::filesystem::path> photos;
+                std::vector<boost::filesystem::path> others;
+                for (const boost::filesystem::path &file : files)
+                {
+                    (isPhotoFile(file) ? photos : others).push_back(file);
+                }
+                files.swap(others);
+                PhotoBatchProcessor photoBatch(settings, numWorkers, numWorkers, 2 * numWorkers, metricsServer ? &metrics : nullptr);
+                photoBatch.setPlacement(placementPtr);
+                failed += photoBatch.run(photos, photoOutput);
+            }
+            if (!files.empty())
+            {
+                BatchProcessor batch(settings, numWorkers, metricsServer ? &metrics : nullptr);
+                batch.setPlacement(placementPtr);
+                failed += batch.run(files);
+            }
+            return failed == 0 ? 0 : 1;
+        }
 
         //Initialize out file
         boost::filesystem::path csvPath(videoPath);
-        boost::filesystem::path fileExt = csvPath.extension();
+        const bool isVideo = isVideoFile(boost::filesystem::path(videoPath));
         csvPath.replace_extension(".csv");
-        std::ofstream csvFileStream(csvPath.c_str());
+        boost::filesystem::path summaryPath(videoPath);
+        summaryPath.replace_extension(".summary.csv");
+        boost::filesystem::path eventsPath(videoPath);
+        eventsPath.replace_extension(".events.csv");
+        boost::filesystem::path rollupPath(videoPath);
+        rollupPath.replace_extension(".rollup.csv");
+        boost::filesystem::path cropsPath(videoPath);
+        cropsPath.replace_extension(".crops.bin");
+        if ((write_summary || !eventRules.empty() || deltaEpsilon > 0 || !rollupIntervals.empty() || cropSize > 0
+             || !busName.empty()) && numSegments > 1 && isVideo)
+        {
+            LOG(LogLevel::Warning) << "--summary, --events, --deltaEpsilon, --rollup, --crops and --bus are not supported with --segments, only the full csv will be written";
+        }
+        if (smoother && numSegments > 1 && isVideo)
+        {
+            LOG(LogLevel::Warning) << "--smooth is not supported with --segments, the metrics are written as detected";
+        }
 
-        if (!csvFileStream.is_open())
+        if (numSegments > 1 && isVideo)
         {
-            std::cerr << "Unable to open csv file " << csvPath << std::endl;
-            return 1;
+            DetectorSettings settings = { process_framerate, nFaces, (affdex::FaceDetectorMode) faceDetectorMode, DATA_FOLDER, 0 };
+            SegmentProcessor segments(settings, numSegments, metricsServer ? &metrics : nullptr);
+            segments.setPlacement(placementPtr);
+            return segments.run(videoPath, csvPath) ? 0 : 1;
+        }
+        if (deltaEpsilon > 0) csvPath.replace_extension(".delta.csv");
+        std::ofstream csvFileStream;
+        if (write_csv)
+        {
+            csvFileStream.open(csvPath.c_str());
+            if (!csvFileStream.is_open())
+            {
+                LOG(LogLevel::Error) << "Unable to open csv file " << csvPath;
+                return 1;
+            }
+        }
+
+        // The summary statistics are computed as the results come in, rather than from the csv afterwards
+        std::ofstream summaryFileStream;
+        std::unique_ptr<FaceSummarySink> summarySink;
+        if (write_summary)
+        {
+            summaryFileStream.open(summaryPath.c_str());
+            if (!summaryFileStream.is_open())
+            {
+                LOG(LogLevel::Error) << "Unable to open summary file " << summaryPath;
+                return 1;
+            }
+            summarySink.reset(new FaceSummarySink(summaryFileStream, summaryThreshold));
+        }
+
+        std::ofstream rollupFileStream;
+        std::unique_ptr<RollupSink> rollupSink;
+        if (!rollupIntervals.empty())
+        {
+            rollupFileStream.open(rollupPath.c_str());
+            if (!rollupFileStream.is_open())
+            {
+                LOG(LogLevel::Error) << "Unable to open rollup file " << rollupPath;
+                return 1;
+            }
+            rollupSink.reset(new RollupSink(rollupFileStream, rollupIntervals));
+        }
+
+        std::unique_ptr<ResultBusWriter> bus;
+        std::unique_ptr<ResultBusSink> busSink;
+        if (!busName.empty())
+        {
+            bus.reset(new ResultBusWriter(busName, busCapacity));
+            if (!bus->open())
+            {
+                LOG(LogLevel::Error) << "Unable to open result bus: " << bus->getError();
+                return 1;
+            }
+            busSink.reset(new ResultBusSink(*bus));
+        }
+
+        std::ofstream cropsFileStream;
+        std::unique_ptr<FaceCropSink> cropSink;
+        if (cropSize > 0)
+        {
+            cropsFileStream.open(cropsPath.c_str(), std::ios::binary);
+            if (!cropsFileStream.is_open())
+            {
+                LOG(LogLevel::Error) << "Unable to open crops file " << cropsPath;
+                return 1;
+            }
+            cropSink.reset(new FaceCropSink(cropsFileStream, cropSize, cropMargin, cropAlign));
+        }
+
+        std::unique_ptr<DeltaCsvSink> deltaSink;
+        if (write_csv && deltaEpsilon > 0)
+        {
+            deltaSink.reset(new DeltaCsvSink(csvFileStream, deltaEpsilon, keyframeInterval, metricsServer ? &metrics : nullptr));
+        }
+
+        // Only the events are written, an alternative to the per-frame csv with --csv 0
+        std::ofstream eventsFileStream;
+        std::unique_ptr<EventSink> eventSink;
+        if (!eventRules.empty())
+        {
+            eventsFileStream.open(eventsPath.c_str());
+            if (!eventsFileStream.is_open())
+            {
+                LOG(LogLevel::Error) << "Unable to open events file " << eventsPath;
+                return 1;
+            }
+            eventSink.reset(new EventSink(eventsFileStream, eventRules));
         }
 
-        if (VIDEO_EXTS[fileExt]) // IF it is a video file.
+        if (use_pipeline && isVideo)
+        {
+            DetectorSettings settings = { process_framerate, nFaces, (affdex::FaceDetectorMode) faceDetectorMode, DATA_FOLDER, 0 };
+            FramePipeline::Config config;
+            config.sinkThreads = sinkThreads;
+            FramePipeline pipeline(settings, config, metricsServer ? &metrics : nullptr);
+            pipeline.setPlacement(placementPtr);
+            pipeline.setSmoother(smoother.get());
+            CsvSink csvSink(csvFileStream, metricsServer ? &metrics : nullptr);
+            DisplaySink displaySink(metricsServer ? &metrics : nullptr);
+            if (busSink) pipeline.addSink(busSink.get());
+            if (deltaSink) pipeline.addSink(deltaSink.get());
+            else if (write_csv) pipeline.addSink(&csvSink);
+            if (summarySink) pipeline.addSink(summarySink.get());
+            if (eventSink) pipeline.addSink(eventSink.get());
+            if (rollupSink) pipeline.addSink(rollupSink.get());
+            if (cropSink) pipeline.addSink(cropSink.get());
+            if (draw_display) pipeline.addSink(&displaySink, true);
+            const bool ok = pipeline.run(videoPath);
+            csvFileStream.close();
+            if (write_csv) LOG(LogLevel::Info) << "Output written to file: " << csvPath;
+            if (summarySink) LOG(LogLevel::Info) << "Summary written to file: " << summaryPath;
+            if (eventSink) LOG(LogLevel::Info) << "Events written to file: " << eventsPath;
+            if (rollupSink) LOG(LogLevel::Info) << "Rollup written to file: " << rollupPath;
+            if (cropSink) LOG(LogLevel::Info) << "Crops written to file: " << cropsPath;
+            if (busSink) LOG(LogLevel::Info) << bus->published() << " record(s) published on " << busName;
+            return ok ? 0 : 1;
+        }
+
+        if (isVideo) // IF it is a video file.
         {
             detector = std::make_shared<VideoDetector>(process_framerate, nFaces, (affdex::FaceDetectorMode) faceDetectorMode);
         }
@@ -118,7 +539,7 @@ int main(int argsc, char ** argsv)
 
 
 
-        std::cout << "Max num of faces set to: " << detector->getMaxNumberFaces() << std::endl;
+        LOG(LogLevel::Info) << "Max num of faces set to: " << detector->getMaxNumberFaces();
         std::string mode;
         switch (detector->getFaceDetectorMode())
         {
@@ -132,8 +553,32 @@ int main(int argsc, char ** argsv)
                 break;
         }
 
-        std::cout << "Face detector mode set to: " << mode << std::endl;
-        shared_ptr<PlottingImageListener> listenPtr(new PlottingImageListener(csvFileStream, draw_display));
+        LOG(LogLevel::Info) << "Face detector mode set to: " << mode;
+        shared_ptr<PlottingImageListener> listenPtr(write_csv && !deltaSink ? new PlottingImageListener(csvFileStream, draw_display)
+                                                              : new PlottingImageListener(draw_display));
+        if (metricsServer) listenPtr->setMetrics(&metrics);
+
+        // The tracks keep the recent history of every face for the sparklines
+        std::unique_ptr<FaceTrackStore> trackStore;
+        std::unique_ptr<AFaceListener> faceListener;
+        if (!sparkline.empty() && draw_display)
+        {
+            trackStore.reset(new FaceTrackStore(historySeconds, process_framerate));
+            const int metric = trackStore->metricIndex(sparkline);
+            if (metric < 0)
+            {
+                LOG(LogLevel::Error) << "Unknown metric for --sparkline: " << sparkline;
+                return 1;
+            }
+            listenPtr->setTrackStore(trackStore.get(), metric);
+        }
+        if (trackStore || smoother || summarySink || eventSink)
+        {
+            faceListener.reset(new AFaceListener(trackStore.get(), smoother.get()));
+            if (summarySink) faceListener->addSink(summarySink.get());
+            if (eventSink) faceListener->addSink(eventSink.get());
+            detector->setFaceListener(faceListener.get());
+        }
 
         detector->setClassifierPath(DATA_FOLDER);
         detector->setDetectAllEmotions(true);
@@ -149,7 +594,7 @@ int main(int argsc, char ** argsv)
         {
             shared_ptr<StatusListener> videoListenPtr = std::make_shared<StatusListener>();
             detector->setProcessStatusListener(videoListenPtr.get());
-            if (VIDEO_EXTS[fileExt])
+            if (isVideo)
             {
                 ((VideoDetector *)detector.get())->process(videoPath); //Process a video
             }
@@ -164,38 +609,86 @@ int main(int argsc, char ** argsv)
                 ((PhotoDetector *)detector.get())->process(frame); //Process an image
             }
 
+            // A video is done once the detector says so and the queue is drained, a photo once its results are in
+            bool photoDone = false;
+            MetricBatch rows;
             do
             {
-                if (listenPtr->getDataSize() > 0)
+                if (listenPtr->waitForData(std::chrono::milliseconds(10)))
                 {
                     std::pair<Frame, std::map<FaceId, Face> > dataPoint = listenPtr->getData();
                     Frame frame = dataPoint.first;
                     std::map<FaceId, Face> faces = dataPoint.second;
 
+                    // Converted once, the display and every output read the same rows
+                    rows.clear();
+                    rows.append(frame.getTimestamp(), faces);
+                    if (smoother) smoother->apply(rows);
+                    if (trackStore) trackStore->add(rows);
+                    if (busSink) busSink->consume(frame, rows);
 
                     if (draw_display)
                     {
-                        listenPtr->draw(faces, frame);
+                        listenPtr->draw(rows, frame);
                     }
 
-                    std::cerr << "timestamp: " << frame.getTimestamp()
-                    << " cfps: " << listenPtr->getCaptureFrameRate()
-                    << " pfps: " << listenPtr->getProcessingFrameRate()
-                    << " faces: "<< faces.size() << endl;
+                    if (!metricsServer)
+                    {
+                        LOG_EVERY_MS(LogLevel::Info, 1000) << "timestamp: " << frame.getTimestamp()
+                        << " cfps: " << listenPtr->getCaptureFrameRate()
+                        << " pfps: " << listenPtr->getProcessingFrameRate()
+                        << " faces: "<< faces.size();
+                    }
 
-                    listenPtr->outputToFile(faces, frame.getTimestamp());
+                    if (deltaSink) deltaSink->consume(frame, rows);
+                    else if (write_csv) listenPtr->outputToFile(rows);
+                    if (summarySink) summarySink->consume(frame, rows);
+                    if (eventSink) eventSink->consume(frame, rows);
+                    if (rollupSink) rollupSink->consume(frame, rows);
+                    if (cropSink) cropSink->consume(frame, rows);
+                    photoDone = true;
                 }
-            } while (VIDEO_EXTS[fileExt] && (videoListenPtr->isRunning() || listenPtr->getDataSize() > 0));
+                else if (!isVideo && !videoListenPtr->isRunning())
+                {
+                    break;    // Processing failed, there won't be results
+                }
+            } while (isVideo ? (videoListenPtr->isRunning() || listenPtr->getDataSize() > 0) : !photoDone);
         } while(loop);
 
         detector->stop();
+        if (deltaSink) deltaSink->finish();
         csvFileStream.close();
 
-        std::cout << "Output written to file: " << csvPath << std::endl;
+        if (write_csv) LOG(LogLevel::Info) << "Output written to file: " << csvPath;
+        if (summarySink)
+        {
+            summarySink->finish();
+            LOG(LogLevel::Info) << "Summary written to file: " << summaryPath;
+        }
+        if (eventSink)
+        {
+            eventSink->finish();
+            LOG(LogLevel::Info) << "Events written to file: " << eventsPath;
+        }
+        if (rollupSink)
+        {
+            rollupSink->finish();
+            LOG(LogLevel::Info) << "Rollup written to file: " << rollupPath;
+        }
+        if (cropSink)
+        {
+            cropSink->finish();
+            LOG(LogLevel::Info) << "Crops written to file: " << cropsPath;
+        }
+        if (busSink)
+        {
+            busSink->finish();
+            LOG(LogLevel::Info) << bus->published() << " record(s) published on " << busName;
+        }
     }
     catch (AffdexException ex)
     {
-        std::cerr << ex.what();
+        LOG(LogLevel::Error) << ex.what();
     }
 
     return 0;